@@ -0,0 +1,23 @@
+// Host run of the hot path benchmarks (benchmark.h)
+//
+// Same benchmark table and budgets as the on-board BENCHMARK build, timed in
+// host nanoseconds.  Exits non-zero if anything is over its host budget.
+
+#include "benchmark.h"
+
+int main() {
+  simReset(AMBIENT_TEMP);
+  Serial.setEcho(stdout);
+  Serial.begin(SERIAL_BAUD);
+  initializeBenchmarks();
+
+  // let the sampler fill in a reading for every input
+  simAdvanceMicros(10000);
+
+  int overBudget = runBenchmarks();
+  if (overBudget) {
+    printf("\nFAIL: %d benchmark(s) over budget\n", overBudget);
+    return 1;
+  }
+  return 0;
+}
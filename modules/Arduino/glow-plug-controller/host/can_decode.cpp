@@ -0,0 +1,134 @@
+// Decodes the glow plug controller's CAN telemetry (can_telemetry.h) to CSV
+//
+//   can-decode [candump.log] > can.csv
+//
+// Reads a candump -L log (`candump -L can0 > candump.log` on a SocketCAN
+// interface, or the simulator's --can-out) from the file or stdin, one row per
+// batch.  Frames with other ids are skipped, so it works on a shared bus.
+// Reports incomplete batches, sequence gaps and the frame rate on stderr.
+// Decodes the channel count this host build was made with.
+
+#include "can_telemetry.h"
+
+#include <stdlib.h>
+
+static const char* stateNames[] = {"BOOT_DELAY", "MEASURING", "MEASURE_PAUSE", "FULL_POWER", "RAMP_DOWN", "IDLE", "LOW_POWER"};
+
+struct Batch {
+  bool started;
+  uint8_t status[8];
+  bool haveFrame[CAN_TELEMETRY_FRAMES];
+  uint8_t channels[CAN_TELEMETRY_FRAMES - 1][8];
+};
+
+static unsigned long incompleteBatches = 0;
+
+static void printBatch(const Batch& batch, unsigned long timeHigh) {
+  const uint8_t* s = batch.status;
+  int state = s[0];
+  printf("%u,%lu,%s,%u", s[4], timeHigh + (s[6] | (s[7] << 8)),
+         state < (int)(sizeof(stateNames) / sizeof(stateNames[0])) ? stateNames[state] : "?", s[5]);
+
+  bool complete = true;
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    int frame = i / CAN_TELEMETRY_CHANNELS_PER_FRAME;
+    printf(",%d,%d,%d", (s[2] >> i) & 1, (s[1] >> i) & 1, (s[3] >> i) & 1);
+    if (!batch.haveFrame[1 + frame]) {
+      printf(",,,,");
+      complete = false;
+      continue;
+    }
+    const uint8_t* p = batch.channels[frame] + (i % CAN_TELEMETRY_CHANNELS_PER_FRAME) * CAN_TELEMETRY_CHANNEL_SIZE;
+    uint16_t tempAndState = p[2] | (p[3] << 8);
+    int tempC = tempAndState & 0x0FFF;
+    if (tempC & 0x0800) tempC -= 0x1000;
+    printf(",%d,%.1f,%.1f,%d", tempAndState >> 12, p[1] * 100.0 / 255.0, p[0] / 10.0, tempC);
+  }
+  printf("\n");
+  if (!complete) incompleteBatches++;
+}
+
+int main(int argc, char** argv) {
+  FILE* in = stdin;
+  if (argc > 1) {
+    in = fopen(argv[1], "r");
+    if (!in) {
+      fprintf(stderr, "could not open %s\n", argv[1]);
+      return 2;
+    }
+  }
+
+  printf("seq,time_ms,state,skipped");
+  for (int i = 1; i <= NUM_OUTPUTS; i++) {
+    printf(",ch%d_enabled,ch%d_fault,ch%d_tripped,ch%d_state,ch%d_duty,ch%d_a,ch%d_temp_c", i, i, i, i, i, i, i);
+  }
+  printf("\n");
+
+  Batch batch;
+  memset(&batch, 0, sizeof(batch));
+  unsigned long frames = 0;
+  unsigned long batches = 0;
+  unsigned long otherFrames = 0;
+  unsigned long sequenceGaps = 0;
+  int lastSequence = -1;
+  uint16_t lastTime = 0;
+  unsigned long timeHigh = 0;
+  double firstSeconds = -1;
+  double lastSeconds = 0;
+
+  char line[128];
+  while (fgets(line, sizeof(line), in)) {
+    unsigned long seconds, micros;
+    unsigned int id;
+    char data[17];
+    if (sscanf(line, "(%lu.%lu) %*s %x#%16[0-9A-Fa-f]", &seconds, &micros, &id, data) != 4) {
+      continue;
+    }
+    if (id < CAN_TELEMETRY_BASE_ID || id >= CAN_TELEMETRY_BASE_ID + CAN_TELEMETRY_FRAMES) {
+      otherFrames++;
+      continue;
+    }
+    uint8_t bytes[8];
+    int length = strlen(data) / 2;
+    for (int i = 0; i < length; i++) {
+      char hex[3] = {data[2 * i], data[2 * i + 1], 0};
+      bytes[i] = strtoul(hex, nullptr, 16);
+    }
+    frames++;
+    lastSeconds = seconds + micros / 1e6;
+    if (firstSeconds < 0) firstSeconds = lastSeconds;
+
+    int index = id - CAN_TELEMETRY_BASE_ID;
+    if (index == 0) {
+      if (length != 8) continue;
+      if (batch.started) printBatch(batch, timeHigh);
+      memset(&batch, 0, sizeof(batch));
+      batch.started = true;
+      memcpy(batch.status, bytes, 8);
+      batches++;
+
+      int sequence = bytes[4];
+      if (lastSequence >= 0 && sequence != ((lastSequence + 1) & 0xFF)) {
+        sequenceGaps++;
+      }
+      lastSequence = sequence;
+
+      // unwrap the 16 bit millisecond clock
+      uint16_t time = bytes[6] | (bytes[7] << 8);
+      if (batches > 1 && time < lastTime) {
+        timeHigh += 0x10000;
+      }
+      lastTime = time;
+    } else if (batch.started) {
+      batch.haveFrame[index] = true;
+      memcpy(batch.channels[index - 1], bytes, length);
+    }
+  }
+  if (batch.started) printBatch(batch, timeHigh);
+
+  double span = lastSeconds - firstSeconds;
+  fprintf(stderr, "%lu frames (%.1f/s), %lu batches, %lu incomplete, %lu sequence gaps, %lu other frames\n",
+          frames, span > 0 ? (frames - 1) / span : 0.0, batches, incompleteBatches, sequenceGaps, otherFrames);
+  if (in != stdin) fclose(in);
+  return 0;
+}
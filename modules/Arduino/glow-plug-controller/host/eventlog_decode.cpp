@@ -0,0 +1,73 @@
+// Decodes the glow plug controller's EEPROM event log (event_log.h) to CSV
+//
+//   eventlog-decode eeprom.bin > events.csv
+//
+// Takes a raw EEPROM image, e.g. from the simulator's --eeprom option or read
+// off the board with `avrdude -p m328p -c arduino -P /dev/ttyUSB0 -U eeprom:r:eeprom.bin:r`.
+// Prints the records oldest first, and the number of slots that hold no valid
+// record (erased or torn) on stderr.
+
+#include "event_log.h"
+
+#include <stdlib.h>
+
+static const char* faultReasons[] = {"?", "overcurrent", "undercurrent", "fast-trip"};
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s eeprom.bin\n", argv[0]);
+    return 2;
+  }
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) {
+    fprintf(stderr, "could not open %s\n", argv[1]);
+    return 2;
+  }
+  uint8_t image[HAL_EEPROM_SIZE];
+  memset(image, 0xFF, sizeof(image));
+  size_t length = fread(image, 1, sizeof(image), in);
+  fclose(in);
+  if (length < (size_t)(EVENT_LOG_BASE + EVENT_LOG_RECORD_SIZE)) {
+    fprintf(stderr, "%s is too short for an EEPROM image\n", argv[1]);
+    return 2;
+  }
+
+  EventLogRecord records[EVENT_LOG_SLOTS];
+  int count = 0;
+  int emptySlots = 0;
+  for (int slot = 0; slot < EVENT_LOG_SLOTS; slot++) {
+    if (decodeEventLogRecord(image + EVENT_LOG_BASE + slot * EVENT_LOG_RECORD_SIZE, records[count])) {
+      count++;
+    } else {
+      emptySlots++;
+    }
+  }
+
+  // Oldest first, in sequence number order allowing for wrap
+  qsort(records, count, sizeof(records[0]), [](const void* a, const void* b) {
+    int16_t diff = ((const EventLogRecord*)a)->sequence - ((const EventLogRecord*)b)->sequence;
+    return (int)diff;
+  });
+
+  printf("sequence,type,output,value,detail\n");
+  for (int i = 0; i < count; i++) {
+    const EventLogRecord& record = records[i];
+    switch (record.type) {
+      case EVENT_LOG_FAULT:
+        printf("%u,fault,%u,%u mA,%s\n", record.sequence, record.channel + 1, record.value,
+               faultReasons[record.detail < 4 ? record.detail : 0]);
+        break;
+      case EVENT_LOG_COLD_RESISTANCE:
+        printf("%u,cold resistance,%u,%u mohm,%u C\n", record.sequence, record.channel + 1,
+               record.value, record.detail);
+        break;
+      case EVENT_LOG_RUN_SUMMARY:
+        printf("%u,run summary,0x%02x,%u ms,%u starts skipped\n", record.sequence, record.channel,
+               record.value, record.detail);
+        break;
+    }
+  }
+
+  fprintf(stderr, "%d records, %d empty slots\n", count, emptySlots);
+  return 0;
+}
@@ -0,0 +1,140 @@
+// Accuracy and timing comparison of the integer conversion chain
+// (fixed_point.h) and the flash lookup table (conversion_tables.h) against the
+// float reference in current_monitor.cpp.
+//
+// Walks every ADC code, reports the worst current and temperature error over
+// the operating current range, and times all three.  Exits non-zero if either
+// integer version is out of tolerance.
+
+#include "config.h"
+#include "current_monitor.h"
+#include "conversion_tables.h"
+#include "overcurrent_trip.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+// Tolerances over the operating range (MIN_CURRENT_THRESHOLD..MAX_CURRENT_THRESHOLD)
+const float CURRENT_TOLERANCE_MA = 5.0;
+const float TEMPERATURE_TOLERANCE_C = 1.0;
+
+// The table is generated from the reference model, so it only carries rounding
+const float TABLE_CURRENT_TOLERANCE_MA = 0.51;
+const float TABLE_TEMPERATURE_TOLERANCE_C = 0.05;
+
+static double nowNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main() {
+  float worstCurrentError = 0;
+  float worstTempError = 0;
+  int worstCurrentCode = 0;
+  int worstTempCode = 0;
+  float worstTableCurrentError = 0;
+  float worstTableTempError = 0;
+
+  printf("scale factors (from config.h):\n");
+  printf("  mA per code:        %.4f (Q8 %u)\n", MILLIAMPS_PER_ADC_CODE, MA_PER_CODE_Q8);
+  printf("  resistance step:    1/%d mohm\n", 1 << RESISTANCE_SHIFT);
+  printf("  supply numerator:   %lu\n", (unsigned long)RESISTANCE_NUMERATOR);
+  printf("  cold resistance:    %u steps\n", COLD_RESISTANCE_Q);
+  printf("  temp per step:      %.6f C (Q4.Q16 %lu)\n",
+         TEMP_Q4_PER_MOHM / (1 << RESISTANCE_SHIFT) / TEMP_Q4_ONE, (unsigned long)TEMP_Q4_PER_RES_Q16);
+  printf("  max delta R:        %u steps\n\n", MAX_DELTA_RES_Q);
+
+  for (int code = 0; code < 1024; code++) {
+    float amps = convertVoltageToCurrent(convertAdcToVoltage(code));
+    float temp = estimateGlowPlugTemperature(amps);
+
+    uint16_t milliamps = adcCodeToMilliamps(code);
+    float tempFixed = (float)estimateGlowPlugTemperatureQ4(milliamps) / TEMP_Q4_ONE;
+
+    // table covers every code
+    float tableCurrentError = fabs(amps * 1000.0 - lookupMilliamps(code));
+    float tableTempError = fabs(temp - (float)lookupTemperatureQ4(code) / TEMP_Q4_ONE);
+    if (tableCurrentError > worstTableCurrentError) worstTableCurrentError = tableCurrentError;
+    if (tableTempError > worstTableTempError) worstTableTempError = tableTempError;
+
+    if (amps < MIN_CURRENT_THRESHOLD || amps > MAX_CURRENT_THRESHOLD) {
+      continue;
+    }
+
+    float currentError = fabs(amps * 1000.0 - milliamps);
+    float tempError = fabs(temp - tempFixed);
+    if (currentError > worstCurrentError) {
+      worstCurrentError = currentError;
+      worstCurrentCode = code;
+    }
+    if (tempError > worstTempError) {
+      worstTempError = tempError;
+      worstTempCode = code;
+    }
+  }
+
+  printf("accuracy over %.1fA..%.1fA:\n", MIN_CURRENT_THRESHOLD, MAX_CURRENT_THRESHOLD);
+  printf("  worst current error:     %.2f mA (code %d)\n", worstCurrentError, worstCurrentCode);
+  printf("  worst temperature error: %.2f C (code %d)\n", worstTempError, worstTempCode);
+  printf("lookup table, all codes (%u bytes of flash):\n", (unsigned)sizeof(ADC_CONVERSION_TABLE));
+  printf("  worst current error:     %.2f mA\n", worstTableCurrentError);
+  printf("  worst temperature error: %.3f C\n\n", worstTableTempError);
+
+  // Host timing only - AVR cycle counts have to come from the board, where the
+  // float path is soft-float and the gap is far wider
+  const int ROUNDS = 2000;
+  volatile float floatSink = 0;
+  volatile int fixedSink = 0;
+
+  double start = nowNanos();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int code = 0; code < 1024; code++) {
+      floatSink = estimateGlowPlugTemperature(convertVoltageToCurrent(convertAdcToVoltage(code)));
+    }
+  }
+  double floatNanos = (nowNanos() - start) / (ROUNDS * 1024.0);
+
+  start = nowNanos();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (volatile int code = 0; code < 1024; code++) {
+      fixedSink = estimateGlowPlugTemperatureQ4(adcCodeToMilliamps(code));
+    }
+  }
+  double fixedNanos = (nowNanos() - start) / (ROUNDS * 1024.0);
+
+  start = nowNanos();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (volatile int code = 0; code < 1024; code++) {
+      fixedSink = lookupMilliamps(code) + lookupTemperatureQ4(code);
+    }
+  }
+  double tableNanos = (nowNanos() - start) / (ROUNDS * 1024.0);
+  (void)floatSink;
+  (void)fixedSink;
+
+  printf("host time per conversion:\n");
+  printf("  float:   %.1f ns\n", floatNanos);
+  printf("  integer: %.1f ns\n", fixedNanos);
+  printf("  table:   %.1f ns\n", tableNanos);
+
+  // The fast-trip compares raw codes; it must trip exactly where the table
+  // starts reading over the limit
+  printf("overcurrent trip code: %u (%u mA)\n", OVERCURRENT_TRIP_CODE, lookupMilliamps(OVERCURRENT_TRIP_CODE));
+  if (lookupMilliamps(OVERCURRENT_TRIP_CODE) <= MAX_CURRENT_MA ||
+      lookupMilliamps(OVERCURRENT_TRIP_CODE - 1) > MAX_CURRENT_MA) {
+    printf("\nFAIL: overcurrent trip code does not match the lookup table\n");
+    return 1;
+  }
+
+  if (worstCurrentError > CURRENT_TOLERANCE_MA || worstTempError > TEMPERATURE_TOLERANCE_C) {
+    printf("\nFAIL: integer chain out of tolerance (%.1f mA, %.1f C)\n",
+           CURRENT_TOLERANCE_MA, TEMPERATURE_TOLERANCE_C);
+    return 1;
+  }
+  if (worstTableCurrentError > TABLE_CURRENT_TOLERANCE_MA || worstTableTempError > TABLE_TEMPERATURE_TOLERANCE_C) {
+    printf("\nFAIL: lookup table does not match the reference model\n");
+    return 1;
+  }
+  return 0;
+}
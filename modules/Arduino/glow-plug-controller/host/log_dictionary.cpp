@@ -0,0 +1,62 @@
+// Lists the tokenized debug log's dictionary (debug_log.h)
+//
+//   log-dictionary > glow-plug-controller.logdict
+//
+// Built from the sketch compiled with DEBUG, so it holds every log site the
+// firmware has.  Prints one line per site, tab separated:
+//
+//   token (4 hex digits)  signature  file:line  format
+//
+// where the signature has an 'i' for each integer argument and an 'f' for each
+// float.  Checks that each site's format has a conversion for each argument of
+// the right kind, and that sites with different formats (or the same format
+// and different arguments) don't share a token; a clash means one of the
+// formats needs rewording.  Exits non-zero if any check fails.
+
+#include "debug_log.h"
+#include "log_format.h"
+
+#include <string.h>
+
+// The linker brackets the debug_log section with these
+extern const DebugLogEntry __start_debug_log[];
+extern const DebugLogEntry __stop_debug_log[];
+
+int main() {
+  int errors = 0;
+  int sites = 0;
+  for (const DebugLogEntry* entry = __start_debug_log; entry < __stop_debug_log; entry++) {
+    sites++;
+    std::string signature;
+    if (!logFormatSignature(entry->format, signature)) {
+      fprintf(stderr, "%s:%d: unsupported conversion in \"%s\"\n", entry->file, entry->line, entry->format);
+      errors++;
+      continue;
+    }
+    if (signature != entry->signature) {
+      fprintf(stderr, "%s:%d: \"%s\" wants arguments %s but is given %s\n", entry->file, entry->line,
+              entry->format, signature.empty() ? "(none)" : signature.c_str(),
+              *entry->signature ? entry->signature : "(none)");
+      errors++;
+      continue;
+    }
+    if (strpbrk(entry->format, "\t\n")) {
+      fprintf(stderr, "%s:%d: tab or newline in \"%s\"\n", entry->file, entry->line, entry->format);
+      errors++;
+      continue;
+    }
+    for (const DebugLogEntry* other = __start_debug_log; other < entry; other++) {
+      if (other->token == entry->token &&
+          (strcmp(other->format, entry->format) != 0 || strcmp(other->signature, entry->signature) != 0)) {
+        fprintf(stderr, "%s:%d: token %04x of \"%s\" is also %s:%d \"%s\"\n", entry->file, entry->line,
+                entry->token, entry->format, other->file, other->line, other->format);
+        errors++;
+        break;
+      }
+    }
+    printf("%04x\t%s\t%s:%d\t%s\n", entry->token, entry->signature, entry->file, entry->line, entry->format);
+  }
+
+  fprintf(stderr, "%d log sites, %d errors\n", sites, errors);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+// Expands the tokenized debug log (debug_log.h) to text
+//
+//   log-expand glow-plug-controller.logdict [capture.bin] > log.txt
+//
+// The dictionary comes from log-dictionary, built from the same sources as the
+// firmware.  The capture is the serial output of a board built with DEBUG,
+// e.g. `stty -F /dev/ttyUSB0 115200 raw && cat /dev/ttyUSB0 > capture.bin`, or
+// of the simulator built the same way (build/debug/glow-sim --serial-out);
+// stdin if no file is given.  Prints one line per message.  Resynchronizes on
+// the sync bytes, and reports checksum failures, unknown tokens and frames
+// that don't match their format's arguments on stderr.
+//
+// Exits non-zero if the dictionary can't be read or any frame was bad.
+
+#include "debug_log.h"
+#include "telemetry.h"
+#include "log_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+struct DictionaryEntry {
+  std::string signature;
+  std::string format;
+};
+
+static bool readDictionary(const char* path, std::map<uint16_t, DictionaryEntry>& dictionary) {
+  FILE* in = fopen(path, "r");
+  if (!in) {
+    fprintf(stderr, "could not open %s\n", path);
+    return false;
+  }
+  char line[512];
+  int lineNumber = 0;
+  bool ok = true;
+  while (fgets(line, sizeof(line), in)) {
+    lineNumber++;
+    line[strcspn(line, "\n")] = '\0';
+    // token, signature, file:line, format
+    char* fields[4];
+    char* p = line;
+    int count = 0;
+    for (; count < 4 && p; count++) {
+      fields[count] = p;
+      p = count < 3 ? strchr(p, '\t') : nullptr;
+      if (p) *p++ = '\0';
+    }
+    std::string signature;
+    if (count != 4 || !logFormatSignature(fields[3], signature) || signature != fields[1]) {
+      fprintf(stderr, "%s:%d: bad dictionary line\n", path, lineNumber);
+      ok = false;
+      continue;
+    }
+    DictionaryEntry& entry = dictionary[(uint16_t)strtoul(fields[0], nullptr, 16)];
+    entry.signature = fields[1];
+    entry.format = fields[3];
+  }
+  fclose(in);
+  return ok;
+}
+
+// Decodes a frame's arguments, false if they don't fill it exactly
+static bool decodeArguments(const uint8_t* p, int length, const std::string& signature, LogArgument* args) {
+  int offset = 0;
+  for (size_t n = 0; n < signature.size(); n++) {
+    if (signature[n] == 'f') {
+      if (offset + 4 > length) return false;
+      memcpy(&args[n].real, p + offset, 4);
+      offset += 4;
+      continue;
+    }
+    uint32_t zigzag = 0;
+    for (int shift = 0; ; shift += 7) {
+      if (offset >= length || shift > 28) return false;
+      uint8_t byte = p[offset++];
+      zigzag |= (uint32_t)(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) break;
+    }
+    args[n].integer = (int32_t)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+  }
+  return offset == length;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: log-expand dictionary [capture.bin]\n");
+    return 2;
+  }
+  std::map<uint16_t, DictionaryEntry> dictionary;
+  if (!readDictionary(argv[1], dictionary)) {
+    return 2;
+  }
+  FILE* in = stdin;
+  if (argc > 2) {
+    in = fopen(argv[2], "rb");
+    if (!in) {
+      fprintf(stderr, "could not open %s\n", argv[2]);
+      return 2;
+    }
+  }
+
+  unsigned long messages = 0;
+  unsigned long bytes = 0;
+  unsigned long badFrames = 0;
+  unsigned long unknownTokens = 0;
+
+  uint8_t frame[TELEMETRY_HEADER_SIZE + 255 + TELEMETRY_CHECKSUM_SIZE];
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    if (c != TELEMETRY_SYNC1) continue;
+    if ((c = fgetc(in)) != DEBUG_LOG_SYNC2) {
+      if (c == EOF) break;
+      ungetc(c, in);
+      continue;
+    }
+    int length = fgetc(in);
+    if (length == EOF) break;
+    frame[2] = length;
+    if (fread(frame + 3, 1, length + TELEMETRY_CHECKSUM_SIZE, in) != (size_t)(length + TELEMETRY_CHECKSUM_SIZE)) {
+      break;
+    }
+    const uint8_t* p = frame + TELEMETRY_HEADER_SIZE;
+    if (length < 2 || (p[length] | (p[length + 1] << 8)) != telemetryChecksum(frame + 2, length + 1)) {
+      badFrames++;
+      continue;
+    }
+
+    uint16_t token = p[0] | (p[1] << 8);
+    auto found = dictionary.find(token);
+    if (found == dictionary.end()) {
+      fprintf(stderr, "unknown token %04x\n", token);
+      unknownTokens++;
+      continue;
+    }
+    const DictionaryEntry& entry = found->second;
+    LogArgument args[DEBUG_LOG_MAX_ARGS];
+    if (entry.signature.size() > DEBUG_LOG_MAX_ARGS ||
+        !decodeArguments(p + 2, length - 2, entry.signature, args)) {
+      fprintf(stderr, "frame for token %04x doesn't match \"%s\"\n", token, entry.format.c_str());
+      badFrames++;
+      continue;
+    }
+    printLogMessage(stdout, entry.format.c_str(), args);
+    fputc('\n', stdout);
+    messages++;
+    bytes += TELEMETRY_HEADER_SIZE + length + TELEMETRY_CHECKSUM_SIZE;
+  }
+
+  fprintf(stderr, "%lu messages in %lu bytes, %lu unknown tokens, %lu bad frames\n",
+          messages, bytes, unknownTokens, badFrames);
+  if (in != stdin) fclose(in);
+  return badFrames || unknownTokens ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+#include "log_format.h"
+
+#include <string.h>
+
+// One conversion: the spec as written, less any length modifier, and its type
+struct Conversion {
+  std::string spec;
+  char type;      // 'i' or 'f'
+  char letter;    // d, u, x, f...
+};
+
+// Parses the conversion at format (just past the '%').  Returns the length
+// consumed, or 0 if it isn't one debug_log.h allows.
+static int parseConversion(const char* format, Conversion& conversion) {
+  const char* p = format;
+  conversion.spec = "%";
+  while (*p && strchr("-+ #0", *p)) {
+    conversion.spec += *p++;
+  }
+  while (*p >= '0' && *p <= '9') {
+    conversion.spec += *p++;
+  }
+  if (*p == '.') {
+    conversion.spec += *p++;
+    while (*p >= '0' && *p <= '9') {
+      conversion.spec += *p++;
+    }
+  }
+  if (*p == 'l' || *p == 'h') {
+    p++;
+  }
+  if (*p && strchr("diuxXc", *p)) {
+    conversion.type = 'i';
+  } else if (*p && strchr("feEgG", *p)) {
+    conversion.type = 'f';
+  } else {
+    return 0;
+  }
+  conversion.letter = *p++;
+  return p - format;
+}
+
+bool logFormatSignature(const char* format, std::string& signature) {
+  signature.clear();
+  for (const char* p = format; *p; p++) {
+    if (*p != '%') continue;
+    if (p[1] == '%') {
+      p++;
+      continue;
+    }
+    Conversion conversion;
+    int length = parseConversion(p + 1, conversion);
+    if (length == 0) {
+      return false;
+    }
+    signature += conversion.type;
+    p += length;
+  }
+  return true;
+}
+
+void printLogMessage(FILE* out, const char* format, const LogArgument* args) {
+  for (const char* p = format; *p; p++) {
+    if (*p != '%') {
+      fputc(*p, out);
+      continue;
+    }
+    if (p[1] == '%') {
+      fputc('%', out);
+      p++;
+      continue;
+    }
+    Conversion conversion;
+    p += parseConversion(p + 1, conversion);
+    const LogArgument& arg = *args++;
+    if (conversion.type == 'f') {
+      fprintf(out, (conversion.spec + conversion.letter).c_str(), (double)arg.real);
+    } else if (conversion.letter == 'c') {
+      fprintf(out, (conversion.spec + 'c').c_str(), (int)arg.integer);
+    } else if (strchr("uxX", conversion.letter)) {
+      // the device sent the value as 32 bits, whatever its type
+      fprintf(out, (conversion.spec + "ll" + conversion.letter).c_str(), (unsigned long long)(uint32_t)arg.integer);
+    } else {
+      fprintf(out, (conversion.spec + "ll" + conversion.letter).c_str(), (long long)arg.integer);
+    }
+  }
+}
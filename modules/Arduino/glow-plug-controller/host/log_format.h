@@ -0,0 +1,24 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+// Format strings of the tokenized debug log (debug_log.h), shared by
+// log-dictionary and log-expand
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// One decoded argument; which member is set follows the signature
+struct LogArgument {
+  int32_t integer;
+  float real;
+};
+
+// The signature a format takes ('i' per integer conversion, 'f' per float),
+// or false if it has a conversion debug_log.h doesn't allow
+bool logFormatSignature(const char* format, std::string& signature);
+
+// Prints a message from its format and the arguments its signature gave
+void printLogMessage(FILE* out, const char* format, const LogArgument* args);
+
+#endif
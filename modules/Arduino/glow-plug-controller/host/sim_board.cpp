@@ -0,0 +1,1217 @@
+#include "config.h"
+#include "fixed_point.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <time.h>
+
+SimSerial Serial;
+
+// Glow plug electrical/thermal model
+// R(T) = R0 * (1 + a * (T - Tamb)), heated by I^2R, losing heat linearly to
+// ambient.  The constants give roughly 900C after 5 seconds at full power,
+// which is in the right neighborhood for a modern steel plug.
+const float PLUG_HEAT_CAPACITY = 0.25;  // J/C
+const float PLUG_HEAT_LOSS = 0.03;      // W/C
+const float SHORTED_PLUG_CURRENT = 60.0; // A
+
+struct SimPlug {
+  float temperature;
+  float energy;            // J drawn from the supply
+  float peakTemperature;
+  unsigned long hotMillis; // first time at SIM_TARGET_TEMP, 0 if not yet
+  SimAdcMode mode;
+  int fixedCode;
+};
+
+struct SimScriptEvent {
+  unsigned long atMillis;
+  int channel;           // -1 for supply voltage, wake and CAN bus events
+  bool wake;
+  int canAck;            // a CAN bus event: 1 acknowledged, 0 not; else -1
+  SimAdcMode mode;
+  int code;
+  float volts;
+};
+
+static const int MAX_SCRIPT_EVENTS = 64;
+
+static unsigned long simMicros = 0;
+static unsigned long lastModelMicros = 0;
+static float supplyVoltage = 13.8;
+static int pwmValue[SIM_NUM_PINS];
+static int digitalValue[SIM_NUM_PINS];
+static SimPlug plugs[NUM_OUTPUTS];
+static float peakSupplyCurrent = 0.0;
+static SimScriptEvent script[MAX_SCRIPT_EVENTS];
+static int scriptLength = 0;
+static int scriptNext = 0;
+
+// The controller's clock starts again from zero when it restarts
+static unsigned long bootMicros = 0;
+static bool restartPending = false;
+static int restarts = 0;
+
+// Wake input: a script "wake" holds it low for SIM_WAKE_PULSE_MS, like a key
+// turned off and on again.  Power-down sleep ends early on a change while the
+// pin change interrupt is on.
+static int wakePin = -1;
+static bool wakeInterruptEnabled = false;
+static int wakeLevel = HIGH;
+static unsigned long wakeReleaseMicros = 0;
+static int wakePulses = 0;
+static unsigned long sleepMicros = 0;
+static unsigned long wakeups = 0;
+static unsigned long adcStartMicros = 0;
+static unsigned long adcStopMicros = 0;
+
+// Free running ADC model.  Like the real part, the mux setting is latched when a
+// conversion starts, so a channel change made in the interrupt handler only
+// takes effect on the conversion after the one already in progress.
+static bool adcRunning = false;
+static int adcMuxPin = A0;
+static int adcConvertingPin = A0;
+static unsigned long adcNextCompleteMicros = 0;
+static SimAdcSource adcSource = nullptr;
+
+// LED pattern timer, and the blink codes read back off the LED
+static bool ledTimerRunning = false;
+static unsigned long ledTimerNextMicros = 0;
+static int ledLevel = LOW;
+static unsigned long ledLastEdgeMicros = 0;
+static int ledEdges = 0;
+static unsigned int ledCodes = 0;
+
+static void closeLedCode() {
+  if (ledEdges >= 2 && ledEdges / 2 <= 16) {
+    ledCodes |= 1u << (ledEdges / 2 - 1);
+  }
+  ledEdges = 0;
+}
+
+// Fast-trip timing: when each plug started being driven into an overcurrent
+// and whether it was full on at the time.  At partial duty the sense output
+// only carries current during the on time, so the trip waits for a sample to
+// land there; those are tracked separately.
+static bool overloaded[NUM_OUTPUTS];
+static bool overloadFullDuty[NUM_OUTPUTS];
+static unsigned long overloadStartMicros[NUM_OUTPUTS];
+static unsigned long worstTripMicros[2];  // [0] partial duty, [1] full duty
+static int tripCount = 0;
+
+// Sampling of the driven plugs: how long each has been driven, the samples
+// taken of it meanwhile, and the longest it went without one, counting from
+// when it was switched on, overall and in the window after a start at full
+// duty
+static bool drivenForSampling[NUM_OUTPUTS];
+static unsigned long drivenStartMicros[NUM_OUTPUTS];
+static unsigned long drivenMicros[NUM_OUTPUTS];
+static unsigned long drivenSamples[NUM_OUTPUTS];
+static unsigned long lastDrivenSampleMicros[NUM_OUTPUTS];
+static unsigned long worstDrivenGapMicros[NUM_OUTPUTS];
+static bool drivenFullDutyStart[NUM_OUTPUTS];
+static unsigned long worstStartGapMicros[NUM_OUTPUTS];
+
+// EEPROM model: only one byte write can be in progress, and starting another
+// before it's done stalls the CPU until it is
+static uint8_t eeprom[HAL_EEPROM_SIZE];
+static bool eepromInitialized = false;
+static unsigned long eepromBusyUntilMicros = 0;
+static unsigned long eepromWrites = 0;
+static unsigned long eepromStallMicros = 0;
+
+// MCP2515 model (see sim_board.h).  Only the parts of the register map the
+// driver can reach are modelled: mode, bit timing, interrupt flags and the
+// three transmit buffers.
+const uint8_t MCP_RESET = 0xC0;
+const uint8_t MCP_READ = 0x03;
+const uint8_t MCP_WRITE = 0x02;
+const uint8_t MCP_BIT_MODIFY = 0x05;
+const uint8_t MCP_READ_STATUS = 0xA0;
+const uint8_t MCP_CANSTAT = 0x0E;
+const uint8_t MCP_CANCTRL = 0x0F;
+const uint8_t MCP_CNF3 = 0x28;
+const uint8_t MCP_CNF2 = 0x29;
+const uint8_t MCP_CNF1 = 0x2A;
+const uint8_t MCP_CANINTF = 0x2C;
+const uint8_t MCP_TXB_CTRL[3] = {0x30, 0x40, 0x50};
+const uint8_t MCP_TXREQ = 0x08;
+const uint8_t MCP_ABTF = 0x40;
+
+static bool canAttached = false;
+static FILE* canLog = nullptr;
+static uint8_t mcpRegisters[128];
+static bool spiSelected = false;
+static int spiByteCount = 0;
+static uint8_t spiInstruction = 0;
+static uint8_t spiAddress = 0;
+static uint8_t spiMask = 0;
+static unsigned long canRequestMicros[3];
+static int canOnBus = -1;              // buffer being transmitted
+static unsigned long canFrameEndMicros = 0;
+static unsigned long canFrameMicros = 0;
+static bool canAcknowledged = true;      // something on the bus ACKs frames
+static bool canAckMissed = false;        // it didn't at some point
+static unsigned long canBusFreeMicros = 0;
+static unsigned long canFrames = 0;
+static unsigned long canBusBusyMicros = 0;
+static long canBitrate = 0;              // as of the last switch to normal mode
+
+static void updateCanBus();
+static long mcpBitrate();
+
+static float plugResistance(int channel) {
+  return GLOW_PLUG_RESISTANCE_COLD * (1.0 + TEMP_COEFFICIENT * (plugs[channel].temperature - AMBIENT_TEMP));
+}
+
+// Effective duty cycle seen by the plug: PWM value, or full on if the pin was
+// driven with digitalWrite
+static float plugDuty(int channel) {
+  int pin = OutputPins::PINS[channel];
+  if (pwmValue[pin] > 0) {
+    return pwmValue[pin] / 255.0;
+  }
+  return digitalValue[pin] ? 1.0 : 0.0;
+}
+
+static bool plugConducting(int channel) {
+  float duty = plugDuty(channel);
+  if (duty <= 0.0) return false;
+  if (duty >= 1.0) return true;
+  // sample lands somewhere in the PWM period
+  unsigned long phase = simMicros % SIM_PWM_PERIOD_US;
+  return phase < (unsigned long)(duty * SIM_PWM_PERIOD_US);
+}
+
+// Current the plug draws while its output is on
+static float plugOnCurrent(int channel) {
+  switch (plugs[channel].mode) {
+    case SIM_ADC_OPEN:
+      return 0.0;
+    case SIM_ADC_SHORT:
+      return SHORTED_PLUG_CURRENT;
+    case SIM_ADC_FIXED:
+      return plugs[channel].fixedCode * MILLIAMPS_PER_ADC_CODE / 1000.0;
+    default:
+      return supplyVoltage / plugResistance(channel);
+  }
+}
+
+// Called whenever an output or a plug changes.  An overload ends either because
+// the controller cut the output (a trip) or because the script removed it.
+static void updateOverloads(unsigned long atMicros) {
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    bool driven = plugDuty(i) > 0.0;
+    bool now = driven && plugOnCurrent(i) > MAX_CURRENT_THRESHOLD;
+    if (now && !overloaded[i]) {
+      overloadStartMicros[i] = atMicros;
+      overloadFullDuty[i] = plugDuty(i) >= 1.0;
+    } else if (!now && overloaded[i] && !driven) {
+      unsigned long latency = atMicros - overloadStartMicros[i];
+      unsigned long& worst = worstTripMicros[overloadFullDuty[i] ? 1 : 0];
+      if (latency > worst) worst = latency;
+      tripCount++;
+    }
+    overloaded[i] = now;
+  }
+}
+
+static void noteDrivenGap(int channel) {
+  unsigned long gap = simMicros - lastDrivenSampleMicros[channel];
+  if (gap > worstDrivenGapMicros[channel]) worstDrivenGapMicros[channel] = gap;
+  if (drivenFullDutyStart[channel] && simMicros - drivenStartMicros[channel] <= SIM_START_WINDOW_MS * 1000 &&
+      gap > worstStartGapMicros[channel]) {
+    worstStartGapMicros[channel] = gap;
+  }
+  lastDrivenSampleMicros[channel] = simMicros;
+}
+
+// Called whenever an output changes
+static void updateDrivenSampling() {
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    bool driven = plugDuty(i) > 0.0;
+    if (driven && !drivenForSampling[i]) {
+      drivenStartMicros[i] = simMicros;
+      drivenFullDutyStart[i] = plugDuty(i) >= 1.0;
+      lastDrivenSampleMicros[i] = simMicros;
+    } else if (!driven && drivenForSampling[i]) {
+      drivenMicros[i] += simMicros - drivenStartMicros[i];
+      noteDrivenGap(i);
+    }
+    drivenForSampling[i] = driven;
+  }
+}
+
+static void setWakeLevel(int level) {
+  if (level == wakeLevel) {
+    return;
+  }
+  wakeLevel = level;
+  if (wakeInterruptEnabled) {
+    halWakePinChanged();
+  }
+}
+
+static void applyScript() {
+  if (wakeLevel == LOW && simMicros >= wakeReleaseMicros) {
+    setWakeLevel(HIGH);
+  }
+  while (scriptNext < scriptLength && script[scriptNext].atMillis <= simMicros / 1000) {
+    const SimScriptEvent& e = script[scriptNext++];
+    if (e.wake) {
+      wakePulses++;
+      wakeReleaseMicros = (e.atMillis + SIM_WAKE_PULSE_MS) * 1000;
+      setWakeLevel(LOW);
+    } else if (e.canAck >= 0) {
+      updateCanBus();
+      canAcknowledged = e.canAck;
+      canAckMissed |= !canAcknowledged;
+    } else if (e.channel < 0) {
+      supplyVoltage = e.volts;
+    } else {
+      simSetAdcMode(e.channel, e.mode, e.code);
+    }
+    updateOverloads(e.atMillis * 1000);
+  }
+}
+
+static void updateModel() {
+  // integrate in 1ms steps so long delays stay stable
+  while (simMicros - lastModelMicros >= 1000) {
+    lastModelMicros += 1000;
+    const float dt = 0.001;
+    // supply current averaged over the PWM period
+    float supplyCurrent = 0.0;
+    for (int i = 0; i < NUM_OUTPUTS; i++) {
+      supplyCurrent += plugOnCurrent(i) * plugDuty(i);
+    }
+    if (supplyCurrent > peakSupplyCurrent) {
+      peakSupplyCurrent = supplyCurrent;
+    }
+    for (int i = 0; i < NUM_OUTPUTS; i++) {
+      float power = 0.0;
+      if (plugs[i].mode == SIM_ADC_MODEL) {
+        float current = supplyVoltage / plugResistance(i);
+        power = current * supplyVoltage * plugDuty(i);
+      }
+      float loss = PLUG_HEAT_LOSS * (plugs[i].temperature - AMBIENT_TEMP);
+      plugs[i].temperature += (power - loss) * dt / PLUG_HEAT_CAPACITY;
+      plugs[i].energy += power * dt;
+      if (plugs[i].temperature > plugs[i].peakTemperature) {
+        plugs[i].peakTemperature = plugs[i].temperature;
+      }
+      if (plugs[i].hotMillis == 0 && plugs[i].temperature >= SIM_TARGET_TEMP) {
+        plugs[i].hotMillis = lastModelMicros / 1000;
+      }
+    }
+  }
+}
+
+void simReset(float initialPlugTemp) {
+  simMicros = 0;
+  bootMicros = 0;
+  restartPending = false;
+  restarts = 0;
+  wakePin = -1;
+  wakeInterruptEnabled = false;
+  wakeLevel = HIGH;
+  wakePulses = 0;
+  sleepMicros = 0;
+  wakeups = 0;
+  lastModelMicros = 0;
+  supplyVoltage = 13.8;
+  scriptNext = 0;
+  memset(pwmValue, 0, sizeof(pwmValue));
+  memset(digitalValue, 0, sizeof(digitalValue));
+  adcRunning = false;
+  adcStartMicros = 0;
+  adcStopMicros = 0;
+  ledTimerRunning = false;
+  ledLevel = LOW;
+  ledLastEdgeMicros = 0;
+  ledEdges = 0;
+  ledCodes = 0;
+  peakSupplyCurrent = 0.0;
+  worstTripMicros[0] = 0;
+  worstTripMicros[1] = 0;
+  tripCount = 0;
+  if (!eepromInitialized) {
+    simEraseEeprom();
+  }
+  eepromBusyUntilMicros = 0;
+  eepromWrites = 0;
+  eepromStallMicros = 0;
+  memset(mcpRegisters, 0, sizeof(mcpRegisters));
+  spiSelected = false;
+  canOnBus = -1;
+  canBusFreeMicros = 0;
+  canFrames = 0;
+  canBusBusyMicros = 0;
+  canBitrate = 0;
+  canAcknowledged = true;
+  canAckMissed = false;
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    overloaded[i] = false;
+    drivenForSampling[i] = false;
+    drivenMicros[i] = 0;
+    drivenSamples[i] = 0;
+    worstDrivenGapMicros[i] = 0;
+    worstStartGapMicros[i] = 0;
+    plugs[i].temperature = initialPlugTemp;
+    plugs[i].energy = 0.0;
+    plugs[i].peakTemperature = initialPlugTemp;
+    plugs[i].hotMillis = 0;
+    plugs[i].mode = SIM_ADC_MODEL;
+    plugs[i].fixedCode = 0;
+  }
+}
+
+static int sampleAdcPin(int pin) {
+  for (int i = 0; i < NUM_INPUTS; i++) {
+    if (InputPins::PINS[i] != pin) continue;
+    if (plugs[i].mode == SIM_ADC_FIXED) {
+      return plugs[i].fixedCode;
+    }
+    return simCurrentToAdcCode(simGetPlugCurrent(i));
+  }
+  return 0;
+}
+
+void simAdvanceMicros(unsigned long us) {
+  unsigned long target = simMicros + us;
+
+  // deliver every conversion and timer tick in this step, in order
+  for (;;) {
+    bool adcDue = adcRunning && adcNextCompleteMicros <= target;
+    bool ledDue = ledTimerRunning && ledTimerNextMicros <= target;
+    if (ledDue && (!adcDue || ledTimerNextMicros < adcNextCompleteMicros)) {
+      simMicros = ledTimerNextMicros;
+      ledTimerNextMicros += HAL_LED_TIMER_TICK_US;
+      halLedTimerTick();
+      continue;
+    }
+    if (!adcDue) {
+      break;
+    }
+    simMicros = adcNextCompleteMicros;
+    int value;
+    if (adcSource) {
+      // nothing the model does can reach the controller
+      value = adcSource(adcConvertingPin);
+    } else {
+      applyScript();
+      updateModel();
+      value = sampleAdcPin(adcConvertingPin);
+    }
+    for (int i = 0; i < NUM_INPUTS; i++) {
+      if (InputPins::PINS[i] == adcConvertingPin && drivenForSampling[i]) {
+        drivenSamples[i]++;
+        noteDrivenGap(i);
+      }
+    }
+    adcConvertingPin = adcMuxPin;  // next conversion has already started
+    adcNextCompleteMicros += HAL_ADC_CONVERSION_US;
+    halAdcConversionComplete(value);
+  }
+
+  simMicros = target;
+  applyScript();
+  updateModel();
+  updateCanBus();
+}
+
+void simSetSupplyVoltage(float volts) {
+  supplyVoltage = volts;
+}
+
+void simSetAdcSource(SimAdcSource source) {
+  adcSource = source;
+}
+
+void simSetAdcMode(int channel, SimAdcMode mode, int fixedCode) {
+  if (channel < 0 || channel >= NUM_OUTPUTS) {
+    return;
+  }
+  plugs[channel].mode = mode;
+  plugs[channel].fixedCode = fixedCode;
+}
+
+// Script format, one event per line, '#' starts a comment:
+//   <ms> ch<N> model|open|short
+//   <ms> ch<N> adc <code>
+//   <ms> supply <volts>
+//   <ms> wake
+//   <ms> can ack|noack
+// Events must be in time order.
+bool simLoadScript(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    return false;
+  }
+
+  char line[128];
+  int lineNumber = 0;
+  scriptLength = 0;
+  scriptNext = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineNumber++;
+    char* comment = strchr(line, '#');
+    if (comment) *comment = '\0';
+
+    unsigned long atMillis;
+    char target[16], mode[16];
+    int fields = sscanf(line, "%lu %15s %15s", &atMillis, target, mode);
+    if (fields <= 0) continue;
+
+    SimScriptEvent e = {atMillis, -1, false, -1, SIM_ADC_MODEL, 0, 0.0};
+    bool ok = false;
+    if (fields == 2 && strcmp(target, "wake") == 0) {
+      e.wake = true;
+      ok = true;
+    } else if (fields == 3 && strcmp(target, "can") == 0) {
+      e.canAck = strcmp(mode, "ack") == 0 ? 1 : strcmp(mode, "noack") == 0 ? 0 : -1;
+      ok = e.canAck >= 0;
+    } else if (fields == 3 && strcmp(target, "supply") == 0) {
+      e.volts = atof(mode);
+      ok = true;
+    } else if (fields == 3 && sscanf(target, "ch%d", &e.channel) == 1) {
+      ok = true;
+      if (strcmp(mode, "model") == 0) {
+        e.mode = SIM_ADC_MODEL;
+      } else if (strcmp(mode, "open") == 0) {
+        e.mode = SIM_ADC_OPEN;
+      } else if (strcmp(mode, "short") == 0) {
+        e.mode = SIM_ADC_SHORT;
+      } else if (strcmp(mode, "adc") == 0) {
+        e.mode = SIM_ADC_FIXED;
+        ok = sscanf(line, "%*s %*s %*s %d", &e.code) == 1;
+      } else {
+        ok = false;
+      }
+    }
+
+    if (!ok || scriptLength >= MAX_SCRIPT_EVENTS) {
+      fprintf(stderr, "%s:%d: bad script line\n", path, lineNumber);
+      fclose(f);
+      return false;
+    }
+    script[scriptLength++] = e;
+  }
+
+  fclose(f);
+  return true;
+}
+
+// Inverse of the controller's conversion chain (BTS50010 sense -> divider -> ADC)
+int simCurrentToAdcCode(float amps) {
+  float senseVoltage = amps / CURRENT_CALIBRATION_FACTOR * SENSE_RESISTOR / (BTS50010_SENSE_RATIO / 10000.0);
+  float adcVoltage = SenseDivider::outputVolts(senseVoltage);
+  int code = (int)(adcVoltage / BoardAdc::VOLTS_PER_CODE);
+  return constrain(code, 0, 1023);
+}
+
+int simGetPwm(int pin) {
+  return pwmValue[pin];
+}
+
+int simGetDigital(int pin) {
+  return digitalValue[pin];
+}
+
+float simGetPlugTemperature(int channel) {
+  return plugs[channel].temperature;
+}
+
+float simGetPeakSupplyCurrent() {
+  return peakSupplyCurrent;
+}
+
+float simGetPlugPeakTemperature(int channel) {
+  return plugs[channel].peakTemperature;
+}
+
+float simGetPlugEnergy(int channel) {
+  return plugs[channel].energy;
+}
+
+unsigned long simGetPlugHotMillis(int channel) {
+  return plugs[channel].hotMillis;
+}
+
+unsigned long simGetWorstTripMicros(bool fullDuty) {
+  return worstTripMicros[fullDuty ? 1 : 0];
+}
+
+int simGetTripCount() {
+  return tripCount;
+}
+
+unsigned long simGetDrivenMicros(int channel) {
+  return drivenMicros[channel] + (drivenForSampling[channel] ? simMicros - drivenStartMicros[channel] : 0);
+}
+
+unsigned long simGetDrivenSamples(int channel) {
+  return drivenSamples[channel];
+}
+
+unsigned long simGetWorstDrivenGapMicros(int channel) {
+  return worstDrivenGapMicros[channel];
+}
+
+unsigned long simGetWorstStartGapMicros(int channel) {
+  return worstStartGapMicros[channel];
+}
+
+int simGetOverloadedCount() {
+  int count = 0;
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    if (overloaded[i]) count++;
+  }
+  return count;
+}
+
+float simGetPlugCurrent(int channel) {
+  switch (plugs[channel].mode) {
+    case SIM_ADC_OPEN:
+      return 0.0;
+    case SIM_ADC_SHORT:
+      return plugConducting(channel) ? SHORTED_PLUG_CURRENT : 0.0;
+    default:
+      return plugConducting(channel) ? supplyVoltage / plugResistance(channel) : 0.0;
+  }
+}
+
+void simEraseEeprom() {
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  eepromInitialized = true;
+}
+
+bool simLoadEeprom(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  simEraseEeprom();
+  fread(eeprom, 1, sizeof(eeprom), f);
+  fclose(f);
+  return true;
+}
+
+bool simSaveEeprom(const char* path) {
+  FILE* f = fopen(path, "wb");
+  if (!f) {
+    return false;
+  }
+  size_t written = fwrite(eeprom, 1, sizeof(eeprom), f);
+  fclose(f);
+  return written == sizeof(eeprom);
+}
+
+unsigned long simGetEepromWrites() {
+  return eepromWrites;
+}
+
+unsigned long simGetEepromStallMicros() {
+  return eepromStallMicros;
+}
+
+// CAN controller
+
+static void mcpReset() {
+  memset(mcpRegisters, 0, sizeof(mcpRegisters));
+  mcpRegisters[MCP_CANSTAT] = 0x80;  // configuration mode
+  mcpRegisters[MCP_CANCTRL] = 0x87;
+  canOnBus = -1;
+}
+
+static bool mcpNormalMode() {
+  return (mcpRegisters[MCP_CANSTAT] & 0xE0) == 0x00;
+}
+
+static bool mcpTransmitPending() {
+  for (int i = 0; i < 3; i++) {
+    if (mcpRegisters[MCP_TXB_CTRL[i]] & MCP_TXREQ) return true;
+  }
+  return false;
+}
+
+// A requested mode change waits for every pending frame to go or be aborted
+static void mcpUpdateMode() {
+  uint8_t requested = mcpRegisters[MCP_CANCTRL] & 0xE0;
+  if ((mcpRegisters[MCP_CANSTAT] & 0xE0) == requested || mcpTransmitPending()) {
+    return;
+  }
+  mcpRegisters[MCP_CANSTAT] = (mcpRegisters[MCP_CANSTAT] & 0x1F) | requested;
+  if (mcpNormalMode()) {
+    canBitrate = mcpBitrate();
+  }
+}
+
+static void mcpWrite(uint8_t address, uint8_t value) {
+  address &= 0x7F;
+  if (address == MCP_CANSTAT) {
+    return;  // read only
+  }
+  for (int i = 0; i < 3; i++) {
+    if (address != MCP_TXB_CTRL[i]) continue;
+    if ((value & MCP_TXREQ) && !(mcpRegisters[address] & MCP_TXREQ)) {
+      canRequestMicros[i] = simMicros;
+    }
+    // aborted while retrying for an ACK: the attempt on the wire fails
+    // and the frame is dropped; one that will be acknowledged finishes
+    if (!(value & MCP_TXREQ) && (mcpRegisters[address] & MCP_TXREQ) && canOnBus == i && !canAcknowledged) {
+      value |= MCP_ABTF;
+      canOnBus = -1;
+      canBusFreeMicros = simMicros;
+    }
+  }
+  mcpRegisters[address] = value;
+  mcpUpdateMode();
+}
+
+static long mcpBitrate() {
+  int prescaler = (mcpRegisters[MCP_CNF1] & 0x3F) + 1;
+  int propagation = (mcpRegisters[MCP_CNF2] & 0x07) + 1;
+  int phase1 = ((mcpRegisters[MCP_CNF2] >> 3) & 0x07) + 1;
+  int phase2 = (mcpRegisters[MCP_CNF2] & 0x80) ? (mcpRegisters[MCP_CNF3] & 0x07) + 1 : (phase1 > 2 ? phase1 : 2);
+  return SIM_CAN_OSC_HZ / (2L * prescaler * (1 + propagation + phase1 + phase2));
+}
+
+long simGetCanBitrate() {
+  return canBitrate;
+}
+
+// Bits on the wire for a standard data frame: the stuffed part (start of frame
+// to the CRC, with a stuff bit after every five equal bits), then the CRC
+// delimiter, ACK, end of frame and the intermission before the next frame
+static int canFrameBits(uint16_t id, int length, const uint8_t* data) {
+  uint8_t bits[1 + 11 + 3 + 4 + 64 + 15];
+  int n = 0;
+  bits[n++] = 0;
+  for (int i = 10; i >= 0; i--) bits[n++] = (id >> i) & 1;
+  bits[n++] = 0;  // RTR
+  bits[n++] = 0;  // IDE
+  bits[n++] = 0;  // r0
+  for (int i = 3; i >= 0; i--) bits[n++] = (length >> i) & 1;
+  for (int b = 0; b < length; b++) {
+    for (int i = 7; i >= 0; i--) bits[n++] = (data[b] >> i) & 1;
+  }
+  uint16_t crc = 0;
+  for (int i = 0; i < n; i++) {
+    bool feedback = bits[i] ^ ((crc >> 14) & 1);
+    crc = (crc << 1) & 0x7FFF;
+    if (feedback) crc ^= 0x4599;
+  }
+  for (int i = 14; i >= 0; i--) bits[n++] = (crc >> i) & 1;
+
+  int stuffBits = 0;
+  int run = 0;
+  uint8_t last = 2;
+  for (int i = 0; i < n; i++) {
+    if (bits[i] == last) {
+      run++;
+    } else {
+      last = bits[i];
+      run = 1;
+    }
+    if (run == 5) {
+      stuffBits++;
+      last = !last;
+      run = 1;
+    }
+  }
+  return n + stuffBits + 1 + 2 + 7 + 3;
+}
+
+// Frames go out one at a time: the pending buffer with the highest TXP
+// priority, then the highest buffer number, as on the real part
+static void updateCanBus() {
+  if (!canAttached) return;
+  for (;;) {
+    if (canOnBus >= 0) {
+      if (canFrameEndMicros > simMicros) return;
+      if (!canAcknowledged) {
+        // no ACK: an error frame, then the frame again, for as long as it's pending
+        unsigned long retryMicros = canFrameMicros + (14 * 1000000L + canBitrate - 1) / canBitrate;
+        unsigned long retries = (simMicros - canFrameEndMicros) / retryMicros + 1;
+        canFrameEndMicros += retries * retryMicros;
+        canBusBusyMicros += retries * retryMicros;
+        return;
+      }
+      uint8_t* buffer = mcpRegisters + MCP_TXB_CTRL[canOnBus];
+      uint16_t id = (buffer[1] << 3) | (buffer[2] >> 5);
+      int length = buffer[5] & 0x0F;
+      if (length > 8) length = 8;
+      if (canLog) {
+        fprintf(canLog, "(%lu.%06lu) can0 %03X#", canFrameEndMicros / 1000000, canFrameEndMicros % 1000000, id);
+        for (int i = 0; i < length; i++) fprintf(canLog, "%02X", buffer[6 + i]);
+        fprintf(canLog, "\n");
+      }
+      buffer[0] &= ~MCP_TXREQ;
+      mcpRegisters[MCP_CANINTF] |= 0x04 << canOnBus;
+      canFrames++;
+      canBusFreeMicros = canFrameEndMicros;
+      canOnBus = -1;
+      mcpUpdateMode();
+    }
+
+    long bitrate = simGetCanBitrate();
+    int next = -1;
+    for (int i = 0; i < 3; i++) {
+      uint8_t ctrl = mcpRegisters[MCP_TXB_CTRL[i]];
+      if ((ctrl & MCP_TXREQ) && (next < 0 || (ctrl & 0x03) >= (mcpRegisters[MCP_TXB_CTRL[next]] & 0x03))) {
+        next = i;
+      }
+    }
+    if (next < 0 || bitrate == 0) return;
+
+    const uint8_t* buffer = mcpRegisters + MCP_TXB_CTRL[next];
+    int length = buffer[5] & 0x0F;
+    if (length > 8) length = 8;
+    uint16_t id = (buffer[1] << 3) | (buffer[2] >> 5);
+    unsigned long frameMicros = (canFrameBits(id, length, buffer + 6) * 1000000L + bitrate - 1) / bitrate;
+    unsigned long start = canBusFreeMicros > canRequestMicros[next] ? canBusFreeMicros : canRequestMicros[next];
+    canOnBus = next;
+    canFrameMicros = frameMicros;
+    canFrameEndMicros = start + frameMicros;
+    canBusBusyMicros += frameMicros;
+  }
+}
+
+static uint8_t mcpReadStatus() {
+  uint8_t flags = mcpRegisters[MCP_CANINTF];
+  uint8_t status = flags & 0x03;
+  for (int i = 0; i < 3; i++) {
+    if (mcpRegisters[MCP_TXB_CTRL[i]] & MCP_TXREQ) status |= 0x04 << (2 * i);
+    if (flags & (0x04 << i)) status |= 0x08 << (2 * i);
+  }
+  return status;
+}
+
+// One byte of an SPI transaction, after the instruction byte
+static uint8_t mcpTransfer(int index, uint8_t value) {
+  switch (spiInstruction) {
+    case MCP_READ:
+      if (index == 1) {
+        spiAddress = value;
+        return 0xFF;
+      }
+      return mcpRegisters[spiAddress++ & 0x7F];
+    case MCP_WRITE:
+      if (index == 1) {
+        spiAddress = value;
+      } else {
+        mcpWrite(spiAddress++, value);
+      }
+      return 0xFF;
+    case MCP_BIT_MODIFY:
+      if (index == 1) {
+        spiAddress = value;
+      } else if (index == 2) {
+        spiMask = value;
+      } else if (index == 3) {
+        mcpWrite(spiAddress, (mcpRegisters[spiAddress & 0x7F] & ~spiMask) | (value & spiMask));
+      }
+      return 0xFF;
+    case MCP_READ_STATUS:
+      return mcpReadStatus();
+    default:
+      // LOAD TX BUFFER: the address was set by the instruction
+      if ((spiInstruction & 0xF8) == 0x40) {
+        mcpRegisters[spiAddress++ & 0x7F] = value;
+      }
+      return 0xFF;
+  }
+}
+
+void simAttachCanController(FILE* log) {
+  canAttached = true;
+  canLog = log;
+  mcpReset();
+}
+
+bool simCanAckMissed() {
+  return canAckMissed;
+}
+
+bool simIsCanControllerAsleep() {
+  return canAttached && (mcpRegisters[MCP_CANSTAT] & 0xE0) == 0x20;
+}
+
+unsigned long simGetCanFrames() {
+  return canFrames;
+}
+
+unsigned long simGetCanBusBusyMicros() {
+  return canBusBusyMicros;
+}
+
+// HAL
+
+unsigned long halMillis() {
+  return (simMicros - bootMicros) / 1000;
+}
+
+unsigned long halMicros() {
+  return simMicros - bootMicros;
+}
+
+void halDelay(unsigned long ms) {
+  simAdvanceMicros(ms * 1000);
+}
+
+// Nothing else can happen until the next scheduled task, so jump straight there
+void halIdleUntil(unsigned long wakeMillis) {
+  unsigned long wakeMicros = bootMicros + wakeMillis * 1000;
+  if (wakeMicros > simMicros) {
+    simAdvanceMicros(wakeMicros - simMicros);
+  }
+}
+
+void halPinMode(int pin, int mode) {
+  (void)pin;
+  (void)mode;
+}
+
+int halDigitalRead(int pin) {
+  if (pin == wakePin) return wakeLevel;
+  if (pin < 0 || pin >= SIM_NUM_PINS) return LOW;
+  return digitalValue[pin];
+}
+
+void halWakePinBegin(uint8_t pin) {
+  wakePin = pin;
+}
+
+void halWakePinInterrupt(uint8_t pin, bool enabled) {
+  if (pin == wakePin) {
+    wakeInterruptEnabled = enabled;
+  }
+}
+
+// The next change of the wake pin, or ULONG_MAX if there isn't one coming
+static unsigned long nextWakeEdgeMicros() {
+  if (wakeLevel == LOW) {
+    return wakeReleaseMicros;
+  }
+  for (int i = scriptNext; i < scriptLength; i++) {
+    if (script[i].wake) {
+      return script[i].atMillis * 1000;
+    }
+  }
+  return ULONG_MAX;
+}
+
+void halPowerDown(uint8_t period) {
+  unsigned long wakeMicros = simMicros + ((unsigned long)HAL_WATCHDOG_TICK_MS << period) * 1000;
+  if (wakeInterruptEnabled) {
+    unsigned long edge = nextWakeEdgeMicros();
+    if (edge < wakeMicros) {
+      wakeMicros = edge > simMicros ? edge : simMicros;
+    }
+  }
+  sleepMicros += wakeMicros - simMicros;
+  simAdvanceMicros(wakeMicros - simMicros);
+  simAdvanceMicros(SIM_WAKE_START_US);
+  wakeups++;
+}
+
+void halRestart() {
+  // the watchdog times out, then the sketch starts from the top with the pins
+  // back to inputs and its clock at zero
+  halAdcStop();
+  ledTimerRunning = false;
+  closeLedCode();   // the reset ends whatever code was showing
+  ledLevel = LOW;
+  wakeInterruptEnabled = false;
+  memset(pwmValue, 0, sizeof(pwmValue));
+  memset(digitalValue, 0, sizeof(digitalValue));
+  updateDrivenSampling();
+  simAdvanceMicros(SIM_RESTART_US);
+  bootMicros = simMicros;
+  restartPending = true;
+  restarts++;
+}
+
+bool simTakeRestart() {
+  bool pending = restartPending;
+  restartPending = false;
+  return pending;
+}
+
+int simGetRestarts() {
+  return restarts;
+}
+
+int simGetWakePulses() {
+  return wakePulses;
+}
+
+unsigned long simGetMicros() {
+  return simMicros;
+}
+
+unsigned long simGetSleepMicros() {
+  return sleepMicros;
+}
+
+unsigned long simGetWakeups() {
+  return wakeups;
+}
+
+void halLedTimerStart() {
+  if (!ledTimerRunning) {
+    ledTimerNextMicros = simMicros + HAL_LED_TIMER_TICK_US;
+  }
+  ledTimerRunning = true;
+}
+
+void halLedTimerStop() {
+  ledTimerRunning = false;
+}
+
+unsigned int simGetLedCodes() {
+  if (simMicros - ledLastEdgeMicros >= SIM_LED_CODE_GAP_MS * 1000) {
+    closeLedCode();
+  }
+  return ledCodes;
+}
+
+unsigned long simGetAdcRunMicros() {
+  return (adcRunning ? simMicros : adcStopMicros) - adcStartMicros;
+}
+
+void halDigitalWrite(int pin, int value) {
+  if (pin < 0 || pin >= SIM_NUM_PINS) return;
+  if (pin == LED_BUILTIN && value != ledLevel) {
+    if (simMicros - ledLastEdgeMicros >= SIM_LED_CODE_GAP_MS * 1000) {
+      closeLedCode();
+    }
+    ledLevel = value;
+    ledLastEdgeMicros = simMicros;
+    ledEdges++;
+  }
+  digitalValue[pin] = value;
+  pwmValue[pin] = 0;
+  updateOverloads(simMicros);
+  updateDrivenSampling();
+}
+
+void halAnalogWrite(int pin, int value) {
+  if (pin < 0 || pin >= SIM_NUM_PINS) return;
+  pwmValue[pin] = constrain(value, 0, 255);
+  digitalValue[pin] = value >= 255 ? HIGH : LOW;
+  updateOverloads(simMicros);
+  updateDrivenSampling();
+}
+
+int halAnalogRead(int pin) {
+  simAdvanceMicros(SIM_ANALOG_READ_US);
+  return sampleAdcPin(pin);
+}
+
+void halAdcSelectPin(int pin) {
+  adcMuxPin = pin;
+}
+
+// Conversions complete, and their interrupt runs, only inside simAdvanceMicros()
+bool halAdcResultPending() {
+  return false;
+}
+
+void halAdcStartFreeRunning(int firstPin) {
+  adcMuxPin = firstPin;
+  adcConvertingPin = firstPin;
+  adcNextCompleteMicros = simMicros + HAL_ADC_CONVERSION_US;
+  adcStartMicros = simMicros;
+  adcRunning = true;
+}
+
+void halAdcStop() {
+  if (adcRunning) {
+    adcStopMicros = simMicros;
+  }
+  adcRunning = false;
+}
+
+uint8_t halEepromRead(int address) {
+  if (address < 0 || address >= HAL_EEPROM_SIZE) return 0xFF;
+  return eeprom[address];
+}
+
+bool halEepromReady() {
+  return simMicros >= eepromBusyUntilMicros;
+}
+
+void halEepromWrite(int address, uint8_t value) {
+  if (address < 0 || address >= HAL_EEPROM_SIZE) return;
+  if (!halEepromReady()) {
+    unsigned long stall = eepromBusyUntilMicros - simMicros;
+    eepromStallMicros += stall;
+    simAdvanceMicros(stall);
+  }
+  eeprom[address] = value;
+  eepromWrites++;
+  eepromBusyUntilMicros = simMicros + SIM_EEPROM_WRITE_US;
+}
+
+static struct timespec benchStart;
+
+void halBenchStart() {
+  clock_gettime(CLOCK_MONOTONIC, &benchStart);
+}
+
+uint32_t halBenchElapsed() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - benchStart.tv_sec) * 1000000000UL + (now.tv_nsec - benchStart.tv_nsec);
+}
+
+void halSpiBegin() {
+  spiSelected = false;
+}
+
+void halSpiSelect(bool selected) {
+  if (selected && !spiSelected) {
+    spiByteCount = 0;
+  }
+  spiSelected = selected;
+}
+
+uint8_t halSpiTransfer(uint8_t value) {
+  simAdvanceMicros(SIM_SPI_BYTE_US);
+  if (!canAttached || !spiSelected) {
+    return 0xFF;
+  }
+  int index = spiByteCount++;
+  if (index > 0) {
+    return mcpTransfer(index, value);
+  }
+
+  spiInstruction = value;
+  if (value == MCP_RESET) {
+    mcpReset();
+  } else if ((value & 0xF8) == 0x40) {
+    // LOAD TX BUFFER n, from the id or from the data
+    int buffer = ((value >> 1) & 0x03) % 3;
+    spiAddress = MCP_TXB_CTRL[buffer] + ((value & 1) ? 6 : 1);
+  } else if ((value & 0xF8) == 0x80) {
+    // REQUEST TO SEND, a bit per buffer
+    for (int i = 0; i < 3; i++) {
+      if (value & (1 << i)) {
+        mcpWrite(MCP_TXB_CTRL[i], mcpRegisters[MCP_TXB_CTRL[i]] | MCP_TXREQ);
+      }
+    }
+    updateCanBus();
+  }
+  return 0xFF;
+}
+
+// Serial
+
+void SimSerial::begin(unsigned long baudRate) {
+  baud = baudRate;
+  txBytesQueued = 0;
+  lastDrainMicros = simMicros;
+}
+
+void SimSerial::drain() {
+  if (baud == 0) return;
+  // 10 bits per byte on the wire
+  unsigned long byteMicros = 10000000UL / baud;
+  unsigned long sent = (simMicros - lastDrainMicros) / byteMicros;
+  if (sent >= txBytesQueued) {
+    txBytesQueued = 0;
+    lastDrainMicros = simMicros;
+  } else {
+    txBytesQueued -= sent;
+    lastDrainMicros += sent * byteMicros;
+  }
+}
+
+size_t SimSerial::write(uint8_t b) {
+  drain();
+  if (baud != 0 && txBytesQueued >= 64) {
+    // buffer full - block until one byte has gone out
+    unsigned long byteMicros = 10000000UL / baud;
+    simAdvanceMicros(lastDrainMicros + byteMicros - simMicros);
+    drain();
+  }
+  txBytesQueued++;
+  totalBytes++;
+  if (echo) fputc(b, echo);
+  return 1;
+}
+
+size_t SimSerial::write(const uint8_t* buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+void SimSerial::flush() {
+  drain();
+  if (baud != 0 && txBytesQueued > 0) {
+    unsigned long byteMicros = 10000000UL / baud;
+    simAdvanceMicros(lastDrainMicros + txBytesQueued * byteMicros - simMicros);
+    drain();
+  }
+}
+
+int SimSerial::availableForWrite() {
+  drain();
+  return 64 - (int)txBytesQueued;
+}
+
+void SimSerial::injectRx(uint8_t b) {
+  int next = (rxHead + 1) % (int)sizeof(rxBuffer);
+  if (next == rxTail) return;
+  rxBuffer[rxHead] = b;
+  rxHead = next;
+}
+
+int SimSerial::available() {
+  return (rxHead - rxTail + (int)sizeof(rxBuffer)) % (int)sizeof(rxBuffer);
+}
+
+int SimSerial::read() {
+  if (rxHead == rxTail) return -1;
+  uint8_t b = rxBuffer[rxTail];
+  rxTail = (rxTail + 1) % (int)sizeof(rxBuffer);
+  return b;
+}
+
+size_t SimSerial::print(const char* s) {
+  return write((const uint8_t*)s, strlen(s));
+}
+
+size_t SimSerial::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t SimSerial::print(int n) {
+  return print((long)n);
+}
+
+size_t SimSerial::print(unsigned int n) {
+  return print((unsigned long)n);
+}
+
+size_t SimSerial::print(long n) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%ld", n);
+  return print(buffer);
+}
+
+size_t SimSerial::print(unsigned long n) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%lu", n);
+  return print(buffer);
+}
+
+size_t SimSerial::print(double n, int digits) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+  return print(buffer);
+}
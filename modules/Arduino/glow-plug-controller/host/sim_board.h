@@ -0,0 +1,261 @@
+#ifndef SIM_BOARD_H
+#define SIM_BOARD_H
+
+// Simulated board for the host build of the glow plug controller
+// Provides the small slice of the Arduino core that the controller uses, backed
+// by a virtual microsecond clock, a thermal/electrical model of each glow plug
+// and optional scripted ADC overrides.  Nothing here is compiled for the board.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Arduino core constants (Uno pin map)
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define LED_BUILTIN 13
+
+#define SIM_NUM_PINS 20
+
+#define F_CPU 16000000UL
+
+// Flash is just memory on the host
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Hardware abstraction layer - same signatures as the inline versions in hal.h
+unsigned long halMillis();
+unsigned long halMicros();
+void halDelay(unsigned long ms);
+void halIdleUntil(unsigned long wakeMillis);
+void halPinMode(int pin, int mode);
+void halDigitalWrite(int pin, int value);
+int halDigitalRead(int pin);
+int halAnalogRead(int pin);
+void halAnalogWrite(int pin, int value);
+
+// There is no real concurrency on the host: simulated interrupts only fire
+// while the virtual clock is being advanced, so critical sections are free.
+inline uint8_t halEnterCritical() { return 0; }
+inline void halExitCritical(uint8_t sreg) { (void)sreg; }
+
+const unsigned long HAL_ADC_CONVERSION_US = 13UL * 128UL * 1000000UL / F_CPU;
+
+void halAdcSelectPin(int pin);
+bool halAdcResultPending();
+void halAdcStartFreeRunning(int firstPin);
+void halAdcStop();
+
+// Timer2 overflow at the analogWrite() carrier rate on the board
+const unsigned long HAL_LED_TIMER_TICK_US = 2040;
+void halLedTimerStart();
+void halLedTimerStop();
+
+// Power-down sleep lasts the watchdog period in virtual time, or until the
+// wake pin changes, plus SIM_WAKE_START_US for the oscillator to start again.
+// A restart takes SIM_RESTART_US, then sim_main runs setup() again.
+void halPowerDown(uint8_t period);
+void halRestart();
+inline void halWatchdogOff() {}
+void halWakePinBegin(uint8_t pin);
+void halWakePinInterrupt(uint8_t pin, bool enabled);
+
+const int HAL_EEPROM_SIZE = 1024;
+
+uint8_t halEepromRead(int address);
+bool halEepromReady();
+void halEepromWrite(int address, uint8_t value);
+
+// Benchmark timer: the host's own clock in nanoseconds, not the virtual clock,
+// which doesn't move while code runs
+const char* const HAL_BENCH_TICK_UNIT = "ns";
+
+void halBenchStart();
+uint32_t halBenchElapsed();
+
+// Each SPI byte costs SIM_SPI_BYTE_US of virtual time (the board clocks it in
+// software)
+void halSpiBegin();
+void halSpiSelect(bool selected);
+uint8_t halSpiTransfer(uint8_t value);
+
+// Serial port model
+// Bytes go into a 64 byte TX buffer (same as the AVR core) that drains at the
+// configured baud rate in virtual time.  When the buffer is full, writes block
+// and the virtual clock advances, just like they do on the board.
+class SimSerial {
+public:
+  void begin(unsigned long baud);
+  size_t write(uint8_t b);
+  size_t write(const uint8_t* buffer, size_t size);
+  int availableForWrite();
+  void flush();   // waits for the TX buffer to drain
+  int available();
+  int read();
+
+  size_t print(const char* s);
+  size_t print(char c);
+  size_t print(int n);
+  size_t print(unsigned int n);
+  size_t print(long n);
+  size_t print(unsigned long n);
+  size_t print(double n, int digits = 2);
+
+  template <typename T> size_t println(T value) {
+    size_t n = print(value);
+    return n + print("\r\n");
+  }
+  size_t println() { return print("\r\n"); }
+
+  // host-side plumbing
+  void setEcho(FILE* f) { echo = f; }
+  void injectRx(uint8_t b);
+  unsigned long bytesWritten() const { return totalBytes; }
+
+private:
+  void drain();
+
+  FILE* echo = nullptr;
+  unsigned long baud = 0;
+  unsigned long txBytesQueued = 0;
+  unsigned long lastDrainMicros = 0;
+  unsigned long totalBytes = 0;
+  uint8_t rxBuffer[64];
+  int rxHead = 0;
+  int rxTail = 0;
+};
+
+extern SimSerial Serial;
+
+// Simulation control
+
+// Per-channel ADC source
+enum SimAdcMode {
+  SIM_ADC_MODEL,   // glow plug model drives the sense line
+  SIM_ADC_FIXED,   // fixed ADC code
+  SIM_ADC_OPEN,    // open circuit plug - no current
+  SIM_ADC_SHORT    // shorted plug - sense output pinned high
+};
+
+// Cost in virtual time of the blocking calls (measured on an Uno)
+const unsigned long SIM_ANALOG_READ_US = 112;
+const unsigned long SIM_PWM_PERIOD_US = 2040;  // ~490Hz analogWrite carrier
+const unsigned long SIM_EEPROM_WRITE_US = 3400; // erase + write of one byte
+
+void simReset(float initialPlugTemp);
+void simAdvanceMicros(unsigned long us);
+void simSetSupplyVoltage(float volts);
+void simSetAdcMode(int channel, SimAdcMode mode, int fixedCode = 0);
+bool simLoadScript(const char* path);
+
+// Virtual time since simReset(), which unlike halMicros() carries on across
+// restarts of the controller
+unsigned long simGetMicros();
+
+// Low power: time spent in power-down sleep and the number of times it ended,
+// the wake input pulses the script made, and the restarts they led to.
+// simTakeRestart() is true once after each halRestart(); setup() is then due.
+const unsigned long SIM_WAKE_START_US = 1024;   // 16K cycles at 16MHz
+const unsigned long SIM_RESTART_US = 16000;     // the shortest watchdog timeout
+const unsigned long SIM_WAKE_PULSE_MS = 200;
+unsigned long simGetSleepMicros();
+unsigned long simGetWakeups();
+int simGetWakePulses();
+int simGetRestarts();
+bool simTakeRestart();
+
+// Blink codes seen on the LED since simReset(): bit n-1 for a code of n blinks.
+// A code is a burst of edges with SIM_LED_CODE_GAP_MS of steady LED either
+// side, two to a blink, so dark blinks over a lit LED count too.  The gap is
+// longer than the LED is off between blinks and much shorter than the pause
+// between codes, so an odd edge from the heating indication going on or off
+// next to a code doesn't change its count.
+const unsigned long SIM_LED_CODE_GAP_MS = 400;
+unsigned int simGetLedCodes();
+
+// How long the free running ADC has been running since it was last started
+unsigned long simGetAdcRunMicros();
+
+// Recorded ADC source: while set, every conversion takes its code from here
+// instead of the plug model and the script (trace-replay feeds a trace in
+// through it).  Null puts the model back.
+typedef int (*SimAdcSource)(int pin);
+void simSetAdcSource(SimAdcSource source);
+
+int simGetPwm(int pin);
+int simGetDigital(int pin);
+float simGetPlugTemperature(int channel);
+
+// Heating performance: energy drawn by each plug, and when it first got hot
+// enough to start an engine (0 if it never did)
+const float SIM_TARGET_TEMP = 800.0;
+float simGetPeakSupplyCurrent();  // A, averaged over the PWM period
+float simGetPlugPeakTemperature(int channel);
+float simGetPlugEnergy(int channel);
+unsigned long simGetPlugHotMillis(int channel);
+float simGetPlugCurrent(int channel);
+
+// Overcurrent fast-trip timing: time from a plug being driven over
+// MAX_CURRENT_THRESHOLD to its output being switched off, for overloads that
+// started at full duty or at a partial PWM duty
+unsigned long simGetWorstTripMicros(bool fullDuty);
+int simGetTripCount();
+int simGetOverloadedCount();  // plugs still driven into an overcurrent
+int simCurrentToAdcCode(float amps);
+
+// Current-sense sampling while each plug is driven: for how long, the samples
+// of its input meanwhile, and the longest it went without one (from being
+// switched on to its first sample included), overall and within
+// SIM_START_WINDOW_MS of being switched on at full duty, when the inrush or a
+// plug that was shorted all along shows
+const unsigned long SIM_START_WINDOW_MS = 300;
+
+unsigned long simGetDrivenMicros(int channel);
+unsigned long simGetDrivenSamples(int channel);
+unsigned long simGetWorstDrivenGapMicros(int channel);
+unsigned long simGetWorstStartGapMicros(int channel);
+
+// EEPROM contents survive simReset(), like they survive a power cycle.  Starts
+// erased (all 0xFF).  An image can be loaded before a run and saved after it to
+// carry the event log from one simulated start to the next.
+void simEraseEeprom();
+bool simLoadEeprom(const char* path);  // false if the file can't be read
+bool simSaveEeprom(const char* path);
+unsigned long simGetEepromWrites();
+unsigned long simGetEepromStallMicros(); // time spent waiting on a busy EEPROM
+
+// CAN controller model: an MCP2515 on the SPI pins, driven by the controller's
+// own driver (can_bus.cpp).  It decodes the SPI instructions, keeps the
+// registers, and sends each requested frame at the bit rate set in its
+// configuration registers, in virtual time with exact stuff bits, onto an
+// otherwise idle bus where something acknowledges it - or, after a script's
+// "can noack" (until "can ack"), where nothing does, so it repeats each frame
+// until the driver aborts it.  Like the real part it only changes mode once
+// no frame is pending.  Not fitted until
+// attached: MISO then reads 0xFF, like the pulled-up pin on a board without
+// the module.  The log gets a candump -L line per frame, which can-decode
+// reads and canplayer can replay onto a (v)can interface.
+const unsigned long SIM_SPI_BYTE_US = 10;  // ~1.2us a bit in software
+const long SIM_CAN_OSC_HZ = 8000000;
+
+void simAttachCanController(FILE* log);    // log may be null
+bool simCanAckMissed();                    // the script took the ACK away at some point
+bool simIsCanControllerAsleep();
+unsigned long simGetCanFrames();
+unsigned long simGetCanBusBusyMicros();    // time the bus spent carrying frames
+long simGetCanBitrate();                   // 0 until it has been in normal mode
+
+#endif
@@ -0,0 +1,392 @@
+// Host simulation driver for the glow plug controller
+//
+// Runs the unmodified sketch (setup()/loop()) against the simulated board and
+// reports state transitions and loop timing in virtual time.  Exits non-zero if
+// the controller does not make it from the measurement pulse through heating to
+// low power, or is awake for too much of its time there.  A restart from low
+// power (the wake input) runs setup() again and carries on, in the same run.
+
+#include "config.h"
+#include "adc_sampler.h"
+#include "scheduler.h"
+#include "overcurrent_trip.h"
+#include "boot_trace.h"
+#include "event_log.h"
+#include "timing_report.h"
+#include "can_telemetry.h"
+#include "trace_recorder.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+void setup();
+void loop();
+
+// Time in low power after the last entry to it before the run ends
+const unsigned long LOW_POWER_SETTLE_MS = 10000;
+// Most of the time in low power the controller may spend awake.  It stays up
+// for the last event log records on the way in, then about 1ms a wakeup.
+const double LOW_POWER_AWAKE_LIMIT_PERCENT = 2.0;
+
+static const char* stateName(ControllerState state) {
+  switch (state) {
+    case STATE_BOOT_DELAY: return "BOOT_DELAY";
+    case STATE_MEASURING:  return "MEASURING";
+    case STATE_MEASURE_PAUSE: return "MEASURE_PAUSE";
+    case STATE_FULL_POWER: return "FULL_POWER";
+    case STATE_RAMP_DOWN:  return "RAMP_DOWN";
+    case STATE_IDLE:       return "IDLE";
+    case STATE_LOW_POWER:  return "LOW_POWER";
+  }
+  return "?";
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+    "usage: %s [options]\n"
+    "  --until-ms <ms>     stop after this much virtual time (default 30000)\n"
+    "  --plug-temp <C>     starting plug temperature (default ambient)\n"
+    "  --supply <V>        supply voltage (default 13.8)\n"
+    "  --script <file>     scripted ADC/supply events\n"
+    "  --verbose           echo the controller's serial output (build with DEBUG)\n"
+    "  --serial-out <file> write the raw serial output to a file (e.g. telemetry)\n"
+    "  --eeprom <file>     start from this EEPROM image if it exists, save it after\n"
+    "  --query-at <ms>     send the timing report query byte at this virtual time\n"
+    "  --can-out <file>    fit the CAN controller and log its frames (candump -L format)\n",
+    name);
+}
+
+int main(int argc, char** argv) {
+  unsigned long untilMillis = 30000;
+  float plugTemp = AMBIENT_TEMP;
+  float supply = 13.8;
+  const char* scriptPath = nullptr;
+  bool verbose = false;
+  const char* serialPath = nullptr;
+  const char* eepromPath = nullptr;
+  long queryAtMillis = -1;
+  const char* canPath = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--until-ms") == 0 && i + 1 < argc) {
+      untilMillis = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--plug-temp") == 0 && i + 1 < argc) {
+      plugTemp = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--supply") == 0 && i + 1 < argc) {
+      supply = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+      scriptPath = argv[++i];
+    } else if (strcmp(argv[i], "--serial-out") == 0 && i + 1 < argc) {
+      serialPath = argv[++i];
+    } else if (strcmp(argv[i], "--eeprom") == 0 && i + 1 < argc) {
+      eepromPath = argv[++i];
+    } else if (strcmp(argv[i], "--query-at") == 0 && i + 1 < argc) {
+      queryAtMillis = strtol(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--can-out") == 0 && i + 1 < argc) {
+      canPath = argv[++i];
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  simReset(plugTemp);
+  simSetSupplyVoltage(supply);
+  if (eepromPath && !simLoadEeprom(eepromPath)) {
+    simEraseEeprom();
+  }
+  if (scriptPath && !simLoadScript(scriptPath)) {
+    fprintf(stderr, "could not load script %s\n", scriptPath);
+    return 2;
+  }
+  FILE* serialOut = nullptr;
+  if (serialPath) {
+    serialOut = fopen(serialPath, "wb");
+    if (!serialOut) {
+      fprintf(stderr, "could not open %s\n", serialPath);
+      return 2;
+    }
+  }
+  Serial.setEcho(serialOut ? serialOut : (verbose ? stdout : nullptr));
+  FILE* canOut = nullptr;
+  if (canPath) {
+    canOut = fopen(canPath, "w");
+    if (!canOut) {
+      fprintf(stderr, "could not open %s\n", canPath);
+      return 2;
+    }
+    simAttachCanController(canOut);
+  }
+
+  clock_t wallStart = clock();
+
+  setup();
+
+  ControllerState lastState = currentState;
+  bool sawFullPower = false;
+  bool sawLowPower = false;
+  bool inLowPower = false;
+  unsigned long lowPowerMillis = 0;
+  // time in low power, how much of it asleep, and wake input pulses during it
+  unsigned long lowPowerStartMicros = 0;
+  unsigned long lowPowerSleepStart = 0;
+  int lowPowerPulsesStart = 0;
+  unsigned long lowPowerMicros = 0;
+  unsigned long lowPowerSleepMicros = 0;
+  int lowPowerPulses = 0;
+  unsigned int heatingLedCodes = 0;   // blink codes seen before low power
+
+  printf("%8lu ms  %s\n", simGetMicros() / 1000, stateName(currentState));
+
+  while (simGetMicros() / 1000 < untilMillis) {
+    if (queryAtMillis >= 0 && simGetMicros() / 1000 >= (unsigned long)queryAtMillis) {
+      Serial.injectRx(TIMING_QUERY);
+      queryAtMillis = -1;
+    }
+
+    loop();
+
+    if (simTakeRestart()) {
+      printf("%8lu ms  restart\n", simGetMicros() / 1000);
+      setup();
+    }
+
+    if (currentState != lastState) {
+      unsigned long now = simGetMicros();
+      printf("%8lu ms  %s\n", now / 1000, stateName(currentState));
+      if (inLowPower) {
+        inLowPower = false;
+        lowPowerMicros += now - lowPowerStartMicros;
+        lowPowerSleepMicros += simGetSleepMicros() - lowPowerSleepStart;
+        lowPowerPulses += simGetWakePulses() - lowPowerPulsesStart;
+      }
+      lastState = currentState;
+      if (currentState == STATE_FULL_POWER) sawFullPower = true;
+      if (currentState == STATE_LOW_POWER) {
+        inLowPower = true;
+        lowPowerStartMicros = now;
+        lowPowerSleepStart = simGetSleepMicros();
+        lowPowerPulsesStart = simGetWakePulses();
+        if (sawFullPower && !sawLowPower) {
+          heatingLedCodes = simGetLedCodes();
+        }
+        if (sawFullPower) {
+          sawLowPower = true;
+          lowPowerMillis = now / 1000;
+        }
+      }
+    }
+
+    // long enough in low power to see it settle into its sleep pattern
+    if (inLowPower && sawLowPower && simGetMicros() / 1000 - lowPowerMillis >= LOW_POWER_SETTLE_MS) {
+      break;
+    }
+  }
+  if (inLowPower) {
+    lowPowerMicros += simGetMicros() - lowPowerStartMicros;
+    lowPowerSleepMicros += simGetSleepMicros() - lowPowerSleepStart;
+    lowPowerPulses += simGetWakePulses() - lowPowerPulsesStart;
+  }
+
+  double wallSeconds = (double)(clock() - wallStart) / CLOCKS_PER_SEC;
+  double virtualSeconds = simGetMicros() / 1e6;
+  // rates are per second awake; nothing is sampled or sent while asleep
+  double awakeSeconds = (simGetMicros() - simGetSleepMicros()) / 1e6;
+  double lowPowerAwakePercent = lowPowerMicros ? 100.0 * (lowPowerMicros - lowPowerSleepMicros) / lowPowerMicros : 0.0;
+
+  printf("\n");
+  printf("virtual time:   %.3f s\n", virtualSeconds);
+  printf("wall time:      %.3f s (%.0fx real time)\n", wallSeconds,
+         wallSeconds > 0 ? virtualSeconds / wallSeconds : 0.0);
+  LoopStats loopStats = getLoopStats();
+  printf("loop passes:    %lu\n", (unsigned long)loopStats.passes);
+  printf("loop period:    min %u us, max %u us, mean %u us, histogram",
+         loopStats.minPeriodUs, loopStats.maxPeriodUs, loopStats.meanPeriodUs);
+  for (int i = 0; i < LOOP_HISTOGRAM_BUCKETS; i++) {
+    if (i < LOOP_HISTOGRAM_BUCKETS - 1) {
+      printf(" <%ums:%u", LOOP_HISTOGRAM_LIMITS_MS[i], loopStats.histogram[i]);
+    } else {
+      printf(" more:%u", loopStats.histogram[i]);
+    }
+  }
+  printf("\n");
+  printf("tasks:\n");
+  for (int i = 0; i < getScheduledTaskCount(); i++) {
+    const ScheduledTask* task = getScheduledTask(i);
+    printf("  %-10s every %3u ms: %6u runs, %u deadline misses, max %u ms late, max %u us to run\n",
+           task->name, task->periodMs, task->runs, task->deadlineMisses, task->maxLatenessMs,
+           task->maxCostUs);
+  }
+  printf("serial bytes:   %lu\n", Serial.bytesWritten());
+  printf("channel state:  %u bytes x %d plugs\n", (unsigned)sizeof(GlowChannel), NUM_OUTPUTS);
+  for (Channel i : Channel::all()) {
+    printf("plug %d:         %s, %.0f C (measured %d C at start, peak %.0f C), %.0f J",
+           i + 1, glowChannels[i].faulted ? "FAULTED" : (glowChannels[i].enabled ? "ok" : "disabled"),
+           simGetPlugTemperature(i), glowChannels[i].initialTempQ4 / TEMP_Q4_ONE,
+           simGetPlugPeakTemperature(i), simGetPlugEnergy(i));
+    if (simGetDrivenMicros(i)) {
+      printf(", %.0f samples/s driven, worst gap %lu us (%lu us starting at full duty)",
+             simGetDrivenSamples(i) / (simGetDrivenMicros(i) / 1e6), simGetWorstDrivenGapMicros(i),
+             simGetWorstStartGapMicros(i));
+    }
+    if (simGetPlugHotMillis(i)) {
+      printf(", %.0f C at %lu ms", SIM_TARGET_TEMP, simGetPlugHotMillis(i));
+    }
+    printf("\n");
+  }
+
+  unsigned long allHotMillis = 0;
+  bool allHot = true;
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    if (!glowChannels[i].enabled) continue;
+    if (simGetPlugHotMillis(i) == 0) allHot = false;
+    if (simGetPlugHotMillis(i) > allHotMillis) allHotMillis = simGetPlugHotMillis(i);
+  }
+  printf("supply:         peak %.1f A", simGetPeakSupplyCurrent());
+  if (allHot) {
+    printf(", every plug at %.0f C by %lu ms", SIM_TARGET_TEMP, allHotMillis);
+  }
+  printf("\n");
+
+  // key on is virtual time zero; the board adds its bootloader on top
+  printf("boot trace:\n");
+  long firstHeatMicros = -1;
+  for (int i = 0; i < getBootTraceLength(); i++) {
+    const BootTraceEntry* entry = getBootTraceEntry(i);
+    printf("  %8lu us  %s", (unsigned long)entry->micros, bootTraceEventName(entry->event));
+    if (entry->channel >= 0) {
+      printf(" plug %d", entry->channel + 1);
+    }
+    printf("\n");
+    if (entry->event == BOOT_TRACE_HEAT_START && firstHeatMicros < 0) {
+      firstHeatMicros = entry->micros;
+    }
+  }
+  if (firstHeatMicros >= 0) {
+    printf("first heat:     %.1f ms after key on\n", firstHeatMicros / 1000.0);
+  }
+
+  printf("event log:      %lu EEPROM bytes written, %d records pending, %u dropped, %lu us stalled",
+         simGetEepromWrites(), getPendingEventLogRecords(), getDroppedEventLogRecords(),
+         simGetEepromStallMicros());
+  if (getKnownDeadOutputs()) {
+    printf(", skipped known dead plugs");
+    for (int i = 0; i < NUM_OUTPUTS; i++) {
+      if (getKnownDeadOutputs() & (1 << i)) printf(" %d", i + 1);
+    }
+  }
+  printf("\n");
+
+  if (simGetTripCount() > 0 || simGetOverloadedCount() > 0) {
+    printf("overcurrent:    %d trips, worst time-to-disable %lu us at full duty (bound %lu us), "
+           "%lu us under PWM\n", simGetTripCount(), simGetWorstTripMicros(true),
+           OVERCURRENT_TRIP_BOUND_US, simGetWorstTripMicros(false));
+  }
+
+#ifdef CAN_TELEMETRY
+  if (canOut) {
+    long bitrate = simGetCanBitrate();
+    printf("can bus:        %lu frames (%.1f/s), %.2f%% bus load at %ld kbit/s, %u batches skipped\n",
+           simGetCanFrames(), simGetCanFrames() / awakeSeconds,
+           simGetCanBusBusyMicros() / 1e4 / awakeSeconds, bitrate / 1000, getSkippedCanBatches());
+  }
+#endif
+
+#ifdef TRACE_RECORD
+  printf("trace:          %lu bytes, %.0f%% of the link at %lu baud%s\n", Serial.bytesWritten(),
+         Serial.bytesWritten() * 10 / awakeSeconds / SERIAL_BAUD * 100, SERIAL_BAUD,
+         isTraceRecording() ? "" : ", cut short by a ring overflow");
+#endif
+
+  unsigned int ledCodes = simGetLedCodes();
+  unsigned int faultedMask = 0;
+  for (Channel i : Channel::all()) {
+    if (glowChannels[i].faulted) faultedMask |= 1 << i;
+  }
+  if (ledCodes) {
+    printf("fault led:      codes for plug");
+    for (int i = 0; i < 16; i++) {
+      if (ledCodes & (1u << i)) printf(" %d%s", i + 1, heatingLedCodes & (1u << i) ? " (also while heating)" : "");
+    }
+    printf("\n");
+  }
+
+  if (lowPowerMicros) {
+    printf("low power:      %.1f s, awake %.2f%% of it, %lu watchdog wakeups (%lu us start-up each), "
+           "%d wake input pulses, %d restarts\n", lowPowerMicros / 1e6, lowPowerAwakePercent,
+           simGetWakeups(), SIM_WAKE_START_US, lowPowerPulses, simGetRestarts());
+  }
+
+  if (serialOut) {
+    fclose(serialOut);
+  }
+  if (canOut) {
+    fclose(canOut);
+  }
+  if (eepromPath && !simSaveEeprom(eepromPath)) {
+    fprintf(stderr, "could not write %s\n", eepromPath);
+    return 2;
+  }
+
+  if (simGetOverloadedCount() > 0) {
+    printf("\nFAIL: %d plug(s) still driven into an overcurrent\n", simGetOverloadedCount());
+    return 1;
+  }
+  if (simGetEepromStallMicros() > 0) {
+    printf("\nFAIL: event log stalled the control loop on the EEPROM\n");
+    return 1;
+  }
+  if (simGetWorstTripMicros(true) > OVERCURRENT_TRIP_BOUND_US) {
+    printf("\nFAIL: overcurrent fast-trip slower than %lu us\n", OVERCURRENT_TRIP_BOUND_US);
+    return 1;
+  }
+  for (int i = 0; i < NUM_OUTPUTS; i++) {
+    if (simGetWorstDrivenGapMicros(i) > OVERCURRENT_TRIP_BOUND_US) {
+      printf("\nFAIL: plug %d went %lu us without a sample while driven, longer than the fast-trip bound\n",
+             i + 1, simGetWorstDrivenGapMicros(i));
+      return 1;
+    }
+  }
+
+#ifdef CAN_TELEMETRY
+  if (canOut && !simCanAckMissed() && simGetCanFrames() == 0) {
+    printf("\nFAIL: no CAN telemetry with the controller fitted\n");
+    return 1;
+  }
+  if (canOut && !simCanAckMissed() && getSkippedCanBatches() > 0) {
+    printf("\nFAIL: CAN telemetry skipped batches on an idle bus\n");
+    return 1;
+  }
+  if (canOut && currentState == STATE_LOW_POWER && !simIsCanControllerAsleep()) {
+    printf("\nFAIL: the CAN controller isn't asleep in low power\n");
+    return 1;
+  }
+#endif
+
+#ifdef TRACE_RECORD
+  if (!isTraceRecording()) {
+    printf("\nFAIL: trace recorder overflowed\n");
+    return 1;
+  }
+#endif
+
+  if (!sawLowPower) {
+    printf("\nFAIL: controller did not complete MEASURING -> FULL_POWER -> LOW_POWER\n");
+    return 1;
+  }
+  if ((ledCodes & faultedMask) != faultedMask) {
+    printf("\nFAIL: a faulted plug's blink code never showed on the LED\n");
+    return 1;
+  }
+  if (lowPowerAwakePercent > LOW_POWER_AWAKE_LIMIT_PERCENT) {
+    printf("\nFAIL: awake for more than %.1f%% of the time in low power\n", LOW_POWER_AWAKE_LIMIT_PERCENT);
+    return 1;
+  }
+  if (lowPowerPulses > simGetRestarts()) {
+    printf("\nFAIL: the wake input was pulled in low power but the controller didn't restart\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Static SRAM report for an AVR build of the controller
+#
+#   sram-report.sh <sketch.elf> [count]
+#
+# Prints the .data/.bss totals against the Uno's 2048 bytes and the largest RAM
+# symbols.  Whatever is left is shared by the stack and the heap.
+
+ELF=$1
+COUNT=${2:-15}
+AVR_SIZE=${AVR_SIZE:-avr-size}
+AVR_NM=${AVR_NM:-avr-nm}
+SRAM_BYTES=2048
+
+if [ -z "$ELF" ] || [ ! -f "$ELF" ]; then
+  echo "usage: $0 <sketch.elf> [count]" >&2
+  exit 2
+fi
+
+$AVR_SIZE -A "$ELF" | awk -v total=$SRAM_BYTES '
+  $1 == ".data" { data = $2 }
+  $1 == ".bss"  { bss = $2 }
+  END {
+    used = data + bss
+    printf "static SRAM: %d bytes (.data %d + .bss %d) of %d, %d left for stack\n",
+           used, data, bss, total, total - used
+  }'
+
+echo "largest RAM symbols:"
+# symbol types b/B and d/D are .bss and .data
+$AVR_NM --size-sort -r -S -C --radix=d "$ELF" | awk -v count=$COUNT '
+  $3 ~ /^[bBdD]$/ && shown < count {
+    size = $2 + 0
+    $1 = ""; $2 = ""; $3 = ""
+    sub(/^ +/, "")
+    printf "  %5d  %s\n", size, $0
+    shown++
+  }'
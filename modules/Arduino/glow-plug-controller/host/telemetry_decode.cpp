@@ -0,0 +1,170 @@
+// Decodes the glow plug controller's binary telemetry stream (telemetry.h) to CSV
+//
+//   telemetry-decode [capture.bin] > capture.csv
+//
+// Reads stdin if no file is given, e.g. straight from the serial port after
+// `stty -F /dev/ttyUSB0 115200 raw`.  Resynchronizes on the sync bytes, and
+// reports checksum failures and sequence gaps on stderr.  The channel count is
+// taken from the frame length, so it works with any board configuration.
+// Timing report frames (timing_report.h) in the same stream are printed on
+// stderr.
+
+#include "telemetry.h"
+#include "timing_report.h"
+#include "scheduler.h"
+#include "adc_sampler.h"
+
+#include <stdlib.h>
+
+static const char* stateNames[] = {"BOOT_DELAY", "MEASURING", "MEASURE_PAUSE", "FULL_POWER", "RAMP_DOWN", "IDLE", "LOW_POWER"};
+
+static uint16_t getWord(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+static void printTimingFrame(const uint8_t* p, int length) {
+  if (p[0] == TIMING_FRAME_LOOP && length == TIMING_LOOP_PAYLOAD_SIZE) {
+    unsigned long passes = getWord(p + 1) | ((unsigned long)getWord(p + 3) << 16);
+    fprintf(stderr, "timing: %lu loop passes, period min %u us, max %u us, mean %u us, histogram",
+            passes, getWord(p + 5), getWord(p + 7), getWord(p + 9));
+    for (int i = 0; i < LOOP_HISTOGRAM_BUCKETS; i++) {
+      if (i < LOOP_HISTOGRAM_BUCKETS - 1) {
+        fprintf(stderr, " <%ums:%u", LOOP_HISTOGRAM_LIMITS_MS[i], getWord(p + 11 + 2 * i));
+      } else {
+        fprintf(stderr, " more:%u", getWord(p + 11 + 2 * i));
+      }
+    }
+    fprintf(stderr, "\n");
+  } else if (p[0] == TIMING_FRAME_TASK && length >= TIMING_TASK_FIXED_PAYLOAD_SIZE) {
+    int nameLength = length - TIMING_TASK_FIXED_PAYLOAD_SIZE;
+    fprintf(stderr, "timing: task %u %-10.*s %u runs, %u deadline misses, max %u ms late, "
+            "run time min %u us, max %u us, mean %u us\n",
+            p[1], nameLength, (const char*)p + TIMING_TASK_FIXED_PAYLOAD_SIZE, getWord(p + 2),
+            getWord(p + 4), getWord(p + 6), getWord(p + 8), getWord(p + 10), getWord(p + 12));
+  } else if (p[0] == TIMING_FRAME_SAMPLING && length > TIMING_SAMPLING_HEADER_SIZE &&
+             (length - TIMING_SAMPLING_HEADER_SIZE) % TIMING_SAMPLING_INPUT_SIZE == 0) {
+    static const char* priorityNames[] = {"idle", "normal", "high"};
+    int inputs = (length - TIMING_SAMPLING_HEADER_SIZE) / TIMING_SAMPLING_INPUT_SIZE;
+    unsigned conversionUs = p[1];
+    fprintf(stderr, "timing: sampling");
+    for (int i = 0; i < inputs; i++) {
+      const uint8_t* input = p + TIMING_SAMPLING_HEADER_SIZE + TIMING_SAMPLING_INPUT_SIZE * i;
+      fprintf(stderr, "%s input %d %s %lu/s gap %u us", i ? "," : "", i + 1,
+              input[0] <= SAMPLING_HIGH ? priorityNames[input[0]] : "?",
+              input[1] * 1000000UL / (conversionUs * inputs), input[2] * conversionUs);
+    }
+    fprintf(stderr, "\n");
+  }
+}
+
+int main(int argc, char** argv) {
+  FILE* in = stdin;
+  if (argc > 1) {
+    in = fopen(argv[1], "rb");
+    if (!in) {
+      fprintf(stderr, "could not open %s\n", argv[1]);
+      return 2;
+    }
+  }
+
+  unsigned long frames = 0;
+  unsigned long badFrames = 0;
+  unsigned long timingFrames = 0;
+  unsigned long sequenceGaps = 0;
+  int lastSequence = -1;
+  int channels = -1;
+  uint16_t lastTime = 0;
+  unsigned long timeHigh = 0;
+
+  uint8_t frame[3 + 255 + 2];
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    if (c != TELEMETRY_SYNC1) continue;
+    if ((c = fgetc(in)) != TELEMETRY_SYNC2 && c != TIMING_SYNC2) {
+      if (c == EOF) break;
+      ungetc(c, in);
+      continue;
+    }
+    int sync2 = c;
+    int length = fgetc(in);
+    if (length == EOF) break;
+
+    if (sync2 == TIMING_SYNC2) {
+      frame[2] = length;
+      if (fread(frame + 3, 1, length + TELEMETRY_CHECKSUM_SIZE, in) != (size_t)(length + TELEMETRY_CHECKSUM_SIZE)) {
+        break;
+      }
+      if (length == 0 || getWord(frame + 3 + length) != telemetryChecksum(frame + 2, length + 1)) {
+        badFrames++;
+        continue;
+      }
+      printTimingFrame(frame + 3, length);
+      timingFrames++;
+      continue;
+    }
+    if (length < TELEMETRY_FIXED_PAYLOAD_SIZE ||
+        (length - TELEMETRY_FIXED_PAYLOAD_SIZE) % TELEMETRY_CHANNEL_SIZE != 0) {
+      badFrames++;
+      continue;
+    }
+
+    frame[0] = TELEMETRY_SYNC1;
+    frame[1] = TELEMETRY_SYNC2;
+    frame[2] = length;
+    if (fread(frame + 3, 1, length + TELEMETRY_CHECKSUM_SIZE, in) != (size_t)(length + TELEMETRY_CHECKSUM_SIZE)) {
+      break;
+    }
+    if (getWord(frame + 3 + length) != telemetryChecksum(frame + 2, length + 1)) {
+      badFrames++;
+      continue;
+    }
+
+    const uint8_t* p = frame + 3;
+    int frameChannels = (length - TELEMETRY_FIXED_PAYLOAD_SIZE) / TELEMETRY_CHANNEL_SIZE;
+    if (channels < 0) {
+      channels = frameChannels;
+      printf("seq,time_ms,state,dropped");
+      for (int i = 1; i <= channels; i++) {
+        printf(",ch%d_enabled,ch%d_fault,ch%d_duty,ch%d_ma,ch%d_temp_c", i, i, i, i, i);
+      }
+      printf("\n");
+    } else if (frameChannels != channels) {
+      badFrames++;
+      continue;
+    }
+
+    int sequence = p[0];
+    if (lastSequence >= 0 && sequence != ((lastSequence + 1) & 0xFF)) {
+      sequenceGaps++;
+    }
+    lastSequence = sequence;
+
+    // unwrap the 16 bit millisecond clock
+    uint16_t time = getWord(p + 1);
+    if (frames > 0 && time < lastTime) {
+      timeHigh += 0x10000;
+    }
+    lastTime = time;
+
+    int state = p[3];
+    uint8_t faulted = p[4];
+    uint8_t enabled = p[5];
+    printf("%d,%lu,%s,%u", sequence, timeHigh + time,
+           state < (int)(sizeof(stateNames) / sizeof(stateNames[0])) ? stateNames[state] : "?",
+           getWord(p + 6));
+
+    p += TELEMETRY_FIXED_PAYLOAD_SIZE;
+    for (int i = 0; i < channels; i++) {
+      printf(",%d,%d,%.1f,%u,%.1f", (enabled >> i) & 1, (faulted >> i) & 1,
+             p[0] * 100.0 / 255.0, getWord(p + 1), (int16_t)getWord(p + 3) / 16.0);
+      p += TELEMETRY_CHANNEL_SIZE;
+    }
+    printf("\n");
+    frames++;
+  }
+
+  fprintf(stderr, "%lu frames, %lu timing report frames, %lu bad, %lu sequence gaps\n",
+          frames, timingFrames, badFrames, sequenceGaps);
+  if (in != stdin) fclose(in);
+  return 0;
+}
@@ -0,0 +1,421 @@
+// Replays a recorded trace (trace_recorder.h) through the controller
+//
+//   trace-replay [options] trace.bin
+//
+// The trace comes from a board built with TRACE_RECORD, captured from its
+// serial port at 500000 baud (e.g. `stty -F /dev/ttyACM0 500000 raw && cat
+// /dev/ttyACM0 > trace.bin` before key on), or from the simulator built the
+// same way (build/trace/glow-sim --serial-out trace.bin).
+//
+// Runs the unmodified sketch (setup()/loop(), also built with TRACE_RECORD) on
+// the simulated board with every ADC conversion taking its code from the trace
+// instead of the plug model, so the controller sees the samples the recorded
+// one saw.  The sampler's schedule follows the channel states, which the
+// replay may change a conversion or two from where the recording did, so each
+// input is fed its own recorded samples in order: every channel sees exactly
+// what it saw on the board, within a few conversions of the same time.  The
+// replay ends when an input runs out of recorded samples.  The replay records a
+// trace of its own, and the decisions in the two are compared: the controller
+// state, and per plug the PWM duty, heating phase, and enabled, faulted and
+// tripped flags.  Each is a list of changes compared in order; a change has to
+// have the same value and land within --tolerance-ms of the recorded one,
+// since the board's loop timing isn't modelled exactly.  Changes within the
+// tolerance of the end of the trace aren't compared.
+//
+// The controller also decides from the EEPROM event log (plugs that failed
+// last run are skipped), so replay a board's trace with its EEPROM image as it
+// was before the run, e.g. read with avrdude as in eventlog_decode.cpp.
+//
+// Exits non-zero if any decision differs or the trace can't be read.
+
+#include "config.h"
+#include "trace_recorder.h"
+#include "telemetry.h"
+#include "low_power.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+void setup();
+void loop();
+
+const int STREAM_FIELDS = 5;   // per plug
+const int NUM_STREAMS = 1 + STREAM_FIELDS * NUM_OUTPUTS;
+static const char* const FIELD_NAMES[STREAM_FIELDS] = {"duty", "phase", "enabled", "fault", "trip"};
+
+struct TraceChange {
+  uint32_t time;   // conversions since the ADC started
+  int value;
+};
+
+struct TraceSample {
+  uint8_t input;
+  uint16_t value;
+};
+
+struct Trace {
+  std::vector<TraceSample> samples;
+  std::vector<TraceChange> streams[NUM_STREAMS];
+  bool overflowed;
+  int timingFrames;
+};
+
+static double conversionsToMillis(uint32_t conversions) {
+  return conversions * (double)HAL_ADC_CONVERSION_US / 1000.0;
+}
+
+static void addChange(Trace& trace, int stream, uint32_t time, int value) {
+  std::vector<TraceChange>& changes = trace.streams[stream];
+  if (changes.empty() || changes.back().value != value) {
+    changes.push_back({time, value});
+  }
+}
+
+// Returns false, with the reason on stderr, if the trace is unusable.  A
+// record cut off at the end is dropped.
+static bool readTrace(const char* name, const std::vector<uint8_t>& data, Trace& trace) {
+  trace.overflowed = false;
+  trace.timingFrames = 0;
+
+  // the port may have picked up something before the controller started
+  size_t at = 0;
+  while (at + TRACE_START_SIZE <= data.size() &&
+         !(data[at] == TRACE_MAGIC1 && data[at + 1] == TRACE_MAGIC2 && data[at + 2] == TRACE_VERSION)) {
+    at++;
+  }
+  if (at + TRACE_START_SIZE > data.size()) {
+    fprintf(stderr, "%s: no trace start record\n", name);
+    return false;
+  }
+  if (data[at + 3] != NUM_INPUTS || data[at + 4] != HAL_ADC_CONVERSION_US) {
+    fprintf(stderr, "%s: recorded with %d inputs at %d us a conversion, this build has %d at %lu us\n",
+            name, data[at + 3], data[at + 4], NUM_INPUTS, HAL_ADC_CONVERSION_US);
+    return false;
+  }
+  at += TRACE_START_SIZE;
+
+  while (at < data.size()) {
+    const uint8_t* p = &data[at];
+    size_t left = data.size() - at;
+    uint8_t type = p[0];
+    if (type == TRACE_RECORD_SAMPLES) {
+      if (left < (size_t)TRACE_SAMPLES_HEADER_SIZE) break;
+      uint8_t groups = p[1];
+      size_t size = TRACE_SAMPLES_HEADER_SIZE + groups * TRACE_GROUP_SIZE;
+      if (groups == 0 || groups > TRACE_MAX_GROUPS) {
+        fprintf(stderr, "%s: bad samples record at byte %zu\n", name, at);
+        return false;
+      }
+      if (left < size) break;
+      for (int g = 0; g < groups; g++) {
+        const uint8_t* group = p + TRACE_SAMPLES_HEADER_SIZE + g * TRACE_GROUP_SIZE;
+        uint16_t inputs = group[TRACE_GROUP_SAMPLES + 1] | (group[TRACE_GROUP_SAMPLES + 2] << 8);
+        for (int n = 0; n < TRACE_GROUP_SAMPLES; n++) {
+          uint8_t input = (inputs >> (4 * n)) & 0x0F;
+          if (input >= NUM_INPUTS) {
+            fprintf(stderr, "%s: bad input %d at byte %zu\n", name, input, at);
+            return false;
+          }
+          uint16_t value = group[n] | (((group[TRACE_GROUP_SAMPLES] >> (2 * n)) & 0x03) << 8);
+          trace.samples.push_back({input, value});
+        }
+      }
+      at += size;
+      continue;
+    }
+    if (type == TELEMETRY_SYNC1) {
+      // a timing report frame; telemetry-decode reads them
+      if (left < (size_t)TELEMETRY_HEADER_SIZE) break;
+      size_t size = TELEMETRY_HEADER_SIZE + p[2] + TELEMETRY_CHECKSUM_SIZE;
+      if (left < size) break;
+      trace.timingFrames++;
+      at += size;
+      continue;
+    }
+
+    size_t size = type == TRACE_RECORD_STATE ? TRACE_STATE_SIZE :
+                  type == TRACE_RECORD_OUTPUT ? TRACE_OUTPUT_SIZE :
+                  type == TRACE_RECORD_OVERFLOW ? TRACE_OVERFLOW_SIZE : 0;
+    if (size == 0) {
+      fprintf(stderr, "%s: unknown record type 0x%02x at byte %zu\n", name, type, at);
+      return false;
+    }
+    if (left < size) break;
+
+    // 16 bit times are never more than the ring's worth of samples from the
+    // samples already read
+    uint16_t time16 = p[1] | (p[2] << 8);
+    uint32_t base = trace.samples.size();
+    uint32_t time = base + (int16_t)(time16 - (uint16_t)base);
+
+    if (type == TRACE_RECORD_STATE) {
+      addChange(trace, 0, time, p[3]);
+    } else if (type == TRACE_RECORD_OUTPUT) {
+      if (p[3] >= NUM_OUTPUTS) {
+        fprintf(stderr, "%s: bad channel %d at byte %zu\n", name, p[3], at);
+        return false;
+      }
+      int stream = 1 + p[3] * STREAM_FIELDS;
+      uint8_t flags = p[5];
+      addChange(trace, stream, time, p[4]);
+      addChange(trace, stream + 1, time, flags & TRACE_OUTPUT_STATE_MASK);
+      addChange(trace, stream + 2, time, (flags & TRACE_OUTPUT_ENABLED) != 0);
+      addChange(trace, stream + 3, time, (flags & TRACE_OUTPUT_FAULTED) != 0);
+      addChange(trace, stream + 4, time, (flags & TRACE_OUTPUT_TRIPPED) != 0);
+    } else {
+      // the samples end at the first one the recorder missed
+      trace.samples.resize(time < trace.samples.size() ? time : trace.samples.size());
+      trace.overflowed = true;
+      break;
+    }
+    at += size;
+  }
+  return true;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(f);
+  return true;
+}
+
+static void streamName(int stream, char* name, size_t size) {
+  if (stream == 0) {
+    snprintf(name, size, "state");
+  } else {
+    snprintf(name, size, "plug %d %s", (stream - 1) / STREAM_FIELDS + 1, FIELD_NAMES[(stream - 1) % STREAM_FIELDS]);
+  }
+}
+
+static const char* const STATE_NAMES[] = {
+  "BOOT_DELAY", "MEASURING", "MEASURE_PAUSE", "FULL_POWER", "RAMP_DOWN", "IDLE", "LOW_POWER"
+};
+static const char* const PHASE_NAMES[] = {
+  "OFF", "MEASURING", "WAITING_TO_START", "FULL_POWER", "REDUCED_POWER", "FINISHED"
+};
+
+static void valueName(int stream, int value, char* name, size_t size) {
+  if (stream == 0 && value >= 0 && value <= STATE_LOW_POWER) {
+    snprintf(name, size, "%s", STATE_NAMES[value]);
+  } else if (stream > 0 && (stream - 1) % STREAM_FIELDS == 1 && value >= 0 && value <= OUTPUT_FINISHED) {
+    snprintf(name, size, "%s", PHASE_NAMES[value]);
+  } else {
+    snprintf(name, size, "%d", value);
+  }
+}
+
+// The replayed controller's ADC: each input's recorded samples, in order
+static std::vector<uint16_t> feed[NUM_INPUTS];
+static size_t nextSample[NUM_INPUTS];
+static unsigned long fedSamples = 0;
+static bool feedExhausted = false;
+
+static int traceSample(int pin) {
+  for (int input = 0; input < NUM_INPUTS; input++) {
+    if (InputPins::PINS[input] != pin) continue;
+    if (nextSample[input] >= feed[input].size()) {
+      feedExhausted = true;
+      return 0;
+    }
+    fedSamples++;
+    return feed[input][nextSample[input]++];
+  }
+  return 0;
+}
+
+// How many of an input's samples the two traces have in common, from the start
+static size_t matchingSamples(const Trace& a, const Trace& b, int input) {
+  size_t ia = 0;
+  size_t ib = 0;
+  size_t matching = 0;
+  for (;;) {
+    while (ia < a.samples.size() && a.samples[ia].input != input) ia++;
+    while (ib < b.samples.size() && b.samples[ib].input != input) ib++;
+    if (ia >= a.samples.size() || ib >= b.samples.size() || a.samples[ia].value != b.samples[ib].value) {
+      return matching;
+    }
+    matching++;
+    ia++;
+    ib++;
+  }
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+    "usage: %s [options] trace.bin\n"
+    "  --eeprom <file>        start from this EEPROM image (the board's, from before the run)\n"
+    "  --tolerance-ms <ms>    how far a replayed change may be from the recorded one (default 20)\n"
+    "  --out <file>           write the replay's own trace to a file\n"
+    "  --verbose              list every change compared, not just the differences\n",
+    name);
+}
+
+int main(int argc, char** argv) {
+  const char* tracePath = nullptr;
+  const char* eepromPath = nullptr;
+  const char* outPath = nullptr;
+  double toleranceMillis = 20;
+  bool verbose = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--eeprom") == 0 && i + 1 < argc) {
+      eepromPath = argv[++i];
+    } else if (strcmp(argv[i], "--tolerance-ms") == 0 && i + 1 < argc) {
+      toleranceMillis = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      outPath = argv[++i];
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else if (argv[i][0] != '-' && !tracePath) {
+      tracePath = argv[i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!tracePath) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> recordedData;
+  if (!readFile(tracePath, recordedData)) {
+    fprintf(stderr, "could not open %s\n", tracePath);
+    return 2;
+  }
+  static Trace recorded;
+  if (!readTrace(tracePath, recordedData, recorded)) {
+    return 2;
+  }
+  if (recorded.samples.empty()) {
+    fprintf(stderr, "%s has no samples to replay\n", tracePath);
+    return 2;
+  }
+
+  simReset(AMBIENT_TEMP);
+  if (eepromPath && !simLoadEeprom(eepromPath)) {
+    fprintf(stderr, "could not read %s\n", eepromPath);
+    return 2;
+  }
+  for (const TraceSample& sample : recorded.samples) {
+    feed[sample.input].push_back(sample.value);
+  }
+  simSetAdcSource(traceSample);
+
+  char* replayBuffer = nullptr;
+  size_t replaySize = 0;
+  FILE* replayOut = open_memstream(&replayBuffer, &replaySize);
+  Serial.setEcho(replayOut);
+
+  clock_t wallStart = clock();
+  setup();
+  // the recording ends where the controller went to sleep and the ADC stopped
+  while (!feedExhausted && !isReadyToSleep()) {
+    loop();
+  }
+  double wallSeconds = (double)(clock() - wallStart) / CLOCKS_PER_SEC;
+  double virtualSeconds = halMicros() / 1e6;
+  fclose(replayOut);
+
+  std::vector<uint8_t> replayData(replayBuffer, replayBuffer + replaySize);
+  free(replayBuffer);
+  if (outPath) {
+    FILE* f = fopen(outPath, "wb");
+    if (!f || fwrite(replayData.data(), 1, replayData.size(), f) != replayData.size()) {
+      fprintf(stderr, "could not write %s\n", outPath);
+      return 2;
+    }
+    fclose(f);
+  }
+  static Trace replayed;
+  if (!readTrace("replay", replayData, replayed)) {
+    return 2;
+  }
+
+  uint32_t endTime = recorded.samples.size();
+  printf("recorded:       %zu samples, %.3f s, %d timing report frames%s\n", recorded.samples.size(),
+         conversionsToMillis(endTime) / 1000, recorded.timingFrames,
+         recorded.overflowed ? ", cut short by a recorder overflow" : "");
+  printf("replay:         %.3f s virtual in %.3f s (%.0fx real time)\n", virtualSeconds, wallSeconds,
+         wallSeconds > 0 ? virtualSeconds / wallSeconds : 0.0);
+
+  // Compare each stream's changes in order, up to the tolerance short of the end
+  double toleranceConversions = toleranceMillis * 1000 / HAL_ADC_CONVERSION_US;
+  uint32_t compareUntil = endTime > toleranceConversions ? endTime - (uint32_t)toleranceConversions : 0;
+  int compared = 0;
+  int differing = 0;
+  double worstOffsetMillis = 0;
+  for (int stream = 0; stream < NUM_STREAMS; stream++) {
+    const std::vector<TraceChange>& want = recorded.streams[stream];
+    const std::vector<TraceChange>& got = replayed.streams[stream];
+    char name[32];
+    streamName(stream, name, sizeof(name));
+
+    for (size_t i = 0; ; i++) {
+      bool haveWant = i < want.size() && want[i].time <= compareUntil;
+      bool haveGot = i < got.size() && got[i].time <= compareUntil;
+      if (!haveWant && !haveGot) {
+        break;
+      }
+      char wantValue[24], gotValue[24];
+      if (haveWant) valueName(stream, want[i].value, wantValue, sizeof(wantValue));
+      if (haveGot) valueName(stream, got[i].value, gotValue, sizeof(gotValue));
+
+      if (!haveGot) {
+        printf("  %-14s recorded %s at %.1f ms, not in the replay\n", name, wantValue,
+               conversionsToMillis(want[i].time));
+      } else if (!haveWant) {
+        printf("  %-14s replayed %s at %.1f ms, not in the recording\n", name, gotValue,
+               conversionsToMillis(got[i].time));
+      } else {
+        double offsetMillis = conversionsToMillis(got[i].time) - conversionsToMillis(want[i].time);
+        bool same = want[i].value == got[i].value && fabs(offsetMillis) <= toleranceMillis;
+        if (same) {
+          compared++;
+          if (fabs(offsetMillis) > fabs(worstOffsetMillis)) worstOffsetMillis = offsetMillis;
+          if (verbose) {
+            printf("  %-14s %s at %.1f ms, %+.1f ms\n", name, wantValue, conversionsToMillis(want[i].time),
+                   offsetMillis);
+          }
+          continue;
+        }
+        printf("  %-14s recorded %s at %.1f ms, replayed %s at %.1f ms\n", name, wantValue,
+               conversionsToMillis(want[i].time), gotValue, conversionsToMillis(got[i].time));
+      }
+      // after the first difference the rest of the stream is out of step
+      differing++;
+      break;
+    }
+  }
+  printf("decisions:      %d changes matched, worst %+.1f ms apart (tolerance %.0f ms), %d streams differ\n",
+         compared, worstOffsetMillis, toleranceMillis, differing);
+
+  // The replay records what it was fed, so its own samples show whether each
+  // input got its recorded ones; only the last ring's worth may not have gone
+  // out.  Where the feed ran out shows how far the schedules drifted apart.
+  size_t fedMatching = 0;
+  for (int input = 0; input < NUM_INPUTS; input++) {
+    fedMatching += matchingSamples(recorded, replayed, input);
+  }
+  printf("samples:        %lu fed, %zu replayed as recorded, input feeds ran out %ld conversions "
+         "from the end\n", fedSamples, fedMatching, (long)recorded.samples.size() - (long)fedSamples);
+  if (fedMatching + TRACE_RING_SIZE < fedSamples) {
+    printf("\nFAIL: the replay's samples don't line up with the trace (%zu of %lu fed as recorded)\n",
+           fedMatching, fedSamples);
+    return 1;
+  }
+  if (differing > 0) {
+    printf("\nFAIL: the replayed controller decided differently in %d of %d streams\n", differing, NUM_STREAMS);
+    return 1;
+  }
+  return 0;
+}
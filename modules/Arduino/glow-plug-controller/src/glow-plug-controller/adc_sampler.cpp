@@ -0,0 +1,188 @@
+#include "adc_sampler.h"
+#include "overcurrent_trip.h"
+#include "current_filter.h"
+#include "trace_recorder.h"
+
+// Filled by the conversion complete interrupt
+static volatile uint16_t sampleBuffer[NUM_INPUTS][ADC_SAMPLE_BUFFER_SIZE];
+static volatile uint8_t sampleHead[NUM_INPUTS];
+static volatile uint16_t sampleCount[NUM_INPUTS];
+
+// Input sampled in each slot of the cycle, replaced as a whole by
+// setSamplingPriority()
+static volatile uint8_t schedule[NUM_INPUTS];
+static uint8_t priorities[NUM_INPUTS];
+
+// In free running mode the next conversion has already started by the time the
+// interrupt runs, so a mux change only affects the conversion after that one.
+// Track the input the delivered result belongs to, and the one in progress.
+// Only the interrupt touches these once the sampler is running.
+static Channel convertingInput = Channel::first();
+static Channel pendingInput = Channel::first();
+static uint8_t nextSlot = 1;   // slot 0 is the first conversion
+
+// Slot k goes to input k unless that is idle, when it goes to the borrower it
+// helps most: the one with the longest wait either side of k, from its last
+// slot and to its own
+static void buildSchedule(uint8_t* slots) {
+  bool anyDriven = false;
+  bool anyHigh = false;
+  for (int i = 0; i < NUM_INPUTS; i++) {
+    anyDriven |= priorities[i] != SAMPLING_IDLE;
+    anyHigh |= priorities[i] == SAMPLING_HIGH;
+  }
+  uint8_t borrower = anyHigh ? SAMPLING_HIGH : SAMPLING_NORMAL;
+
+  int8_t lastSlot[NUM_INPUTS];
+  for (int i = 0; i < NUM_INPUTS; i++) {
+    lastSlot[i] = i - NUM_INPUTS;   // its own slot in the cycle before
+  }
+  for (int k = 0; k < NUM_INPUTS; k++) {
+    int input = k;
+    if (anyDriven && priorities[k] == SAMPLING_IDLE) {
+      int bestWait = 0;
+      for (int i = 0; i < NUM_INPUTS; i++) {
+        if (priorities[i] != borrower) {
+          continue;
+        }
+        int sinceLast = k - lastSlot[i];
+        int untilOwn = (i > k ? i : i + NUM_INPUTS) - k;
+        int wait = sinceLast < untilOwn ? sinceLast : untilOwn;
+        if (wait > bestWait) {
+          bestWait = wait;
+          input = i;
+        }
+      }
+    }
+    slots[k] = input;
+    lastSlot[input] = k;
+  }
+}
+
+void initializeAdcSampler() {
+  for (Channel i : Channel::all()) {
+    sampleHead[i] = 0;
+    sampleCount[i] = 0;
+    for (int j = 0; j < ADC_SAMPLE_BUFFER_SIZE; j++) {
+      sampleBuffer[i][j] = 0;
+    }
+    priorities[i] = SAMPLING_IDLE;
+    schedule[i] = i;
+  }
+  convertingInput = Channel::first();
+  pendingInput = Channel::first();
+  nextSlot = 1;
+
+  halAdcStartFreeRunning(InputPins::pin(Channel::first()));
+
+  DEBUG_LOG("ADC sampler running - %lu samples/s per slot", ADC_CHANNEL_SAMPLE_RATE_HZ);
+}
+
+void halAdcConversionComplete(int value) {
+  Channel input = convertingInput;
+  uint8_t head = (sampleHead[input] + 1) & (ADC_SAMPLE_BUFFER_SIZE - 1);
+  sampleBuffer[input][head] = value;
+  sampleHead[input] = head;
+  sampleCount[input]++;
+  checkOvercurrentTrip(input, value);
+  filterAdcSample(input, value);
+#ifdef TRACE_RECORD
+  traceAdcSample(input, value);
+#endif
+
+  // the conversion now in progress was started with the pending selection
+  convertingInput = pendingInput;
+  Channel::fromInt(schedule[nextSlot], pendingInput);
+  nextSlot = nextSlot + 1 < NUM_INPUTS ? nextSlot + 1 : 0;
+  halAdcSelectPin(InputPins::pin(pendingInput));
+}
+
+#ifdef ARDUINO
+ISR(ADC_vect) {
+  halAdcConversionComplete(ADC);
+}
+#endif
+
+int getLatestAdcSample(Channel inputIndex) {
+  uint8_t sreg = halEnterCritical();
+  int value = sampleBuffer[inputIndex][sampleHead[inputIndex]];
+  halExitCritical(sreg);
+  return value;
+}
+
+int getAverageAdcSample(Channel inputIndex) {
+  unsigned int sum = 0;
+  uint8_t sreg = halEnterCritical();
+  for (int i = 0; i < ADC_SAMPLE_BUFFER_SIZE; i++) {
+    sum += sampleBuffer[inputIndex][i];
+  }
+  halExitCritical(sreg);
+  return sum / ADC_SAMPLE_BUFFER_SIZE;
+}
+
+unsigned int getAdcSampleCount(Channel inputIndex) {
+  uint8_t sreg = halEnterCritical();
+  unsigned int count = sampleCount[inputIndex];
+  halExitCritical(sreg);
+  return count;
+}
+
+void setSamplingPriority(Channel inputIndex, SamplingPriority priority) {
+  uint8_t previous = priorities[inputIndex];
+  if (priority == previous) {
+    return;
+  }
+  priorities[inputIndex] = priority;
+  if (priority == SAMPLING_IDLE || previous == SAMPLING_IDLE) {
+    resetCurrentFilter(inputIndex);
+  }
+
+  uint8_t slots[NUM_INPUTS];
+  buildSchedule(slots);
+  uint8_t sreg = halEnterCritical();
+  for (int k = 0; k < NUM_INPUTS; k++) {
+    schedule[k] = slots[k];
+  }
+  // The conversion after the one in progress was picked from the old schedule.
+  // If that was an input's own slot, lent out while it was idle, hand it back
+  // now or its first sample is a whole cycle late, past the trip bound.  Once
+  // the conversion in progress has finished it is too late, but then the one
+  // running is the lent slot and the input's next own slot is still in time.
+  uint8_t latchedSlot = nextSlot > 0 ? nextSlot - 1 : NUM_INPUTS - 1;
+  if (previous == SAMPLING_IDLE && latchedSlot == inputIndex && pendingInput != inputIndex &&
+      !halAdcResultPending()) {
+    pendingInput = inputIndex;
+    halAdcSelectPin(InputPins::pin(inputIndex));
+  }
+  halExitCritical(sreg);
+
+  DEBUG_LOG("Input %d sampling priority %d, %lu samples/s", inputIndex, priority, samplingRateHz(getChannelSampling(inputIndex).slots));
+}
+
+SamplingPriority getSamplingPriority(Channel inputIndex) {
+  return (SamplingPriority)priorities[inputIndex];
+}
+
+// Only the loop changes the schedule, so it can be read without a lock
+ChannelSampling getChannelSampling(Channel inputIndex) {
+  ChannelSampling sampling = {priorities[inputIndex], 0, 0};
+  int first = -1;
+  int last = 0;
+  for (int k = 0; k < NUM_INPUTS; k++) {
+    if (schedule[k] != inputIndex) {
+      continue;
+    }
+    if (first < 0) {
+      first = k;
+    } else if (k - last > sampling.worstGap) {
+      sampling.worstGap = k - last;
+    }
+    last = k;
+    sampling.slots++;
+  }
+  // and round to the first slot of the next cycle
+  if (first >= 0 && first + NUM_INPUTS - last > sampling.worstGap) {
+    sampling.worstGap = first + NUM_INPUTS - last;
+  }
+  return sampling;
+}
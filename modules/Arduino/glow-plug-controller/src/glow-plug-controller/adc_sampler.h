@@ -0,0 +1,59 @@
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+
+#include "config.h"
+
+// Background acquisition of the current-sense inputs
+// The ADC runs free and the conversion complete interrupt steps through a
+// schedule of InputPins, putting each result into a small ring buffer per
+// channel, so the control code never waits on a conversion.
+//
+// The schedule is a cycle of NUM_INPUTS slots, slot k belonging to input k.
+// A channel that isn't being driven (SAMPLING_IDLE) has nothing to measure,
+// so its slot is lent out: to the SAMPLING_HIGH channels - just switched on,
+// measuring, or close to the trip limit - or to the SAMPLING_NORMAL ones if
+// none is high.  A driven channel always keeps its own slot, so it never waits
+// longer for a sample than it did going round the inputs in turn (the bound in
+// overcurrent_trip.h holds), and the ADC does exactly the conversions it did
+// before; only the idle channels' share moves to where a fault is likeliest.
+// With nothing driven it is a plain round robin.
+//
+// A channel that stops being idle takes its slot back at once, even when the
+// next conversion was already selected for a borrower.
+//
+// The current monitor sets the priorities from the channel states.  A
+// channel's filter starts over when it goes idle or stops being idle, since
+// an idle one gets no off-time samples to reset it.
+
+const int ADC_SAMPLE_BUFFER_SIZE = 4;  // per channel, must be a power of 2
+
+// Each conversion takes HAL_ADC_CONVERSION_US, one slot of the cycle
+const unsigned long ADC_CHANNEL_SAMPLE_RATE_HZ = 1000000UL / (HAL_ADC_CONVERSION_US * NUM_INPUTS);
+
+enum SamplingPriority : uint8_t {
+  SAMPLING_IDLE = 0,
+  SAMPLING_NORMAL = 1,
+  SAMPLING_HIGH = 2
+};
+
+// A channel's share of the current schedule
+struct ChannelSampling {
+  uint8_t priority;   // SamplingPriority
+  uint8_t slots;      // samples per cycle of NUM_INPUTS conversions
+  uint8_t worstGap;   // most conversions from one sample to the next, 0 if none
+};
+
+constexpr unsigned long samplingRateHz(uint8_t slots) {
+  return slots * 1000000UL / (HAL_ADC_CONVERSION_US * NUM_INPUTS);
+}
+
+// Function declarations
+void initializeAdcSampler();
+int getLatestAdcSample(Channel inputIndex);
+int getAverageAdcSample(Channel inputIndex);
+unsigned int getAdcSampleCount(Channel inputIndex);
+void setSamplingPriority(Channel inputIndex, SamplingPriority priority);
+SamplingPriority getSamplingPriority(Channel inputIndex);
+ChannelSampling getChannelSampling(Channel inputIndex);
+
+#endif
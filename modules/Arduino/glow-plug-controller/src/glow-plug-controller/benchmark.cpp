@@ -0,0 +1,130 @@
+#include "benchmark.h"
+#include "output_control.h"
+#include "current_monitor.h"
+#include "current_filter.h"
+#include "adc_sampler.h"
+#include "overcurrent_trip.h"
+#include "state_machine.h"
+#include "fault_indication.h"
+
+// volatile in and out, so the compiler can't fold or drop the float math
+static volatile float benchVoltage = 1.2;
+static volatile float benchCurrent = 12.0;
+static volatile float benchResult;
+
+static void benchEmpty() {
+}
+
+static void benchReadVoltage() {
+  benchResult = readVoltageFromADC(Channel::first());
+}
+
+static void benchVoltageToCurrent() {
+  benchResult = convertVoltageToCurrent(benchVoltage);
+}
+
+static void benchEstimateTemperature() {
+  benchResult = estimateGlowPlugTemperature(benchCurrent);
+}
+
+// Every plug heating, none due to change phase: the per-pass cost while the
+// engine is being started
+static void prepareHeating() {
+  currentState = STATE_FULL_POWER;
+  for (Channel i : Channel::all()) {
+    GlowChannel& channel = glowChannels[i];
+    channel.enabled = true;
+    channel.faulted = false;
+    channel.state = OUTPUT_FULL_POWER;
+    channel.phaseStartMs = heatingMillis();
+    channel.totalDurationMs = COLD_ENGINE_TOTAL_MS;
+  }
+  firstFaultedOutput = -1;
+}
+
+// Blink codes for the last two plugs over the heating indication: one step of
+// the sequencer, the most the LED timer interrupt does in a tick
+static void prepareFaultBlink() {
+  setOutputFault(Channel::at<NUM_OUTPUTS - 2>(), true);
+  setOutputFault(Channel::at<NUM_OUTPUTS - 1>(), true);
+  setActiveIndication(true);
+}
+
+static void benchFaultStep() {
+  advanceFaultIndication(1);
+}
+
+static const Benchmark benchmarks[] = {
+  {"readVoltageFromADC",          nullptr,           benchReadVoltage,         2000, 50},
+  {"convertVoltageToCurrent",     nullptr,           benchVoltageToCurrent,    1200, 40},
+  {"estimateGlowPlugTemperature", nullptr,           benchEstimateTemperature, 2000, 50},
+  {"updateIndividualOutputs",     prepareHeating,    updateIndividualOutputs,  6000, 2000},
+  {"advanceFaultIndication",      prepareFaultBlink, benchFaultStep,           500,  60},
+};
+const int NUM_BENCHMARKS = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+static uint32_t timeBest(void (*run)()) {
+  uint32_t best = 0xFFFFFFFF;
+  for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+    uint8_t sreg = halEnterCritical();
+    halBenchStart();
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      run();
+    }
+    uint32_t elapsed = halBenchElapsed();
+    halExitCritical(sreg);
+    if (elapsed < best) best = elapsed;
+  }
+  return best;
+}
+
+// Sets up enough of the controller for the benchmarks, with every output off
+void initializeBenchmarks() {
+  initializeOutputs();
+  for (Channel i : Channel::all()) {
+    halPinMode(InputPins::pin(i), INPUT);
+  }
+  initializeOvercurrentTrip();
+  initializeCurrentFilter();
+  initializeAdcSampler();
+  halPinMode(LED_BUILTIN, OUTPUT);
+  initializeCurrentMonitoring();
+  initializeFaultIndication();
+  stopFaultIndicationTimer();   // the LED shows the result instead
+}
+
+int runBenchmarks() {
+  uint32_t overhead = timeBest(benchEmpty);
+  int overBudget = 0;
+
+  Serial.print("benchmark, ");
+  Serial.print(HAL_BENCH_TICK_UNIT);
+  Serial.println(" per call, budget");
+  for (int b = 0; b < NUM_BENCHMARKS; b++) {
+    const Benchmark& benchmark = benchmarks[b];
+    if (benchmark.prepare) {
+      benchmark.prepare();
+    }
+    uint32_t best = timeBest(benchmark.run);
+    uint32_t ticks = best > overhead ? best - overhead : 0;
+#ifdef ARDUINO
+    uint32_t budget = benchmark.boardBudget;
+#else
+    uint32_t budget = benchmark.hostBudget;
+#endif
+    // tenths, so a few ns per call on the host still shows
+    uint32_t perCallTenths = ticks * 10 / BENCH_BATCH;
+    bool ok = perCallTenths <= budget * 10;
+    if (!ok) overBudget++;
+
+    Serial.print(benchmark.name);
+    Serial.print(", ");
+    Serial.print(perCallTenths / 10);
+    Serial.print(".");
+    Serial.print(perCallTenths % 10);
+    Serial.print(", ");
+    Serial.print(budget);
+    Serial.println(ok ? "" : ", OVER BUDGET");
+  }
+  return overBudget;
+}
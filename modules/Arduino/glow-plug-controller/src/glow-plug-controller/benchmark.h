@@ -0,0 +1,40 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "config.h"
+
+// Microbenchmarks for the hot paths
+// Each benchmark times one function with the HAL benchmark timer: CPU cycles
+// from Timer1 on the board, nanoseconds on the host.  The best of
+// BENCH_REPEATS runs is taken, less the cost of timing an empty function, and
+// checked against that function's budget for the platform.
+//
+// On the board, build with BENCHMARK defined (see the README) and the sketch
+// runs these and prints the results instead of controlling the plugs.  Each
+// call is timed on its own with interrupts off, so the counts are exact.  On
+// the host, `make bench` runs them, timing batches of BENCH_BATCH calls.
+//
+// Board budgets are worst-case cycle counts with some headroom.  Host budgets
+// are deliberately loose (about 10x what a desktop takes) so they only catch
+// a real change in cost, not a busy machine.
+
+struct Benchmark {
+  const char* name;
+  void (*prepare)();     // put the controller in the state to time, may be null
+  void (*run)();
+  uint32_t boardBudget;  // cycles
+  uint32_t hostBudget;   // ns
+};
+
+#ifdef ARDUINO
+const int BENCH_BATCH = 1;  // the timer wraps after 4ms
+#else
+const int BENCH_BATCH = 10000;
+#endif
+const int BENCH_REPEATS = 8;
+
+// Function declarations
+void initializeBenchmarks();
+int runBenchmarks();  // prints the results, returns the number over budget
+
+#endif
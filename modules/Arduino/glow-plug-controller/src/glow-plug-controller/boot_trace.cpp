@@ -0,0 +1,69 @@
+#include "boot_trace.h"
+
+static BootTraceEntry trace[BOOT_TRACE_SIZE];
+static uint8_t traceLength = 0;
+
+void traceBootEvent(BootTraceEvent event, int channel) {
+  // a restart from low power begins a new trace
+  if (event == BOOT_TRACE_SETUP) {
+    traceLength = 0;
+  }
+  // once full, later events are dropped - the start is what matters
+  if (traceLength >= BOOT_TRACE_SIZE) {
+    return;
+  }
+  BootTraceEntry& entry = trace[traceLength++];
+  entry.micros = halMicros();
+  entry.event = event;
+  entry.channel = channel;
+}
+
+int getBootTraceLength() {
+  return traceLength;
+}
+
+const BootTraceEntry* getBootTraceEntry(int index) {
+  if (index < 0 || index >= traceLength) {
+    return nullptr;
+  }
+  return &trace[index];
+}
+
+const char* bootTraceEventName(uint8_t event) {
+  switch (event) {
+    case BOOT_TRACE_SETUP:         return "setup";
+    case BOOT_TRACE_ADC_RUNNING:   return "adc running";
+    case BOOT_TRACE_MEASURE_START: return "measure start";
+    case BOOT_TRACE_READING_VALID: return "reading valid";
+    case BOOT_TRACE_HEAT_START:    return "heat start";
+  }
+  return "?";
+}
+
+// One log site per event, as the frames can't carry the names
+static void printBootTraceEntry(const BootTraceEntry& entry) {
+  switch (entry.event) {
+    case BOOT_TRACE_SETUP:
+      DEBUG_LOG("  %lu setup", entry.micros);
+      break;
+    case BOOT_TRACE_ADC_RUNNING:
+      DEBUG_LOG("  %lu adc running", entry.micros);
+      break;
+    case BOOT_TRACE_MEASURE_START:
+      DEBUG_LOG("  %lu measure start", entry.micros);
+      break;
+    case BOOT_TRACE_READING_VALID:
+      DEBUG_LOG("  %lu reading valid output %d", entry.micros, entry.channel);
+      break;
+    case BOOT_TRACE_HEAT_START:
+      DEBUG_LOG("  %lu heat start output %d", entry.micros, entry.channel);
+      break;
+  }
+}
+
+void printBootTrace() {
+  DEBUG_LOG("Boot trace (us since key on):");
+  for (int i = 0; i < traceLength; i++) {
+    printBootTraceEntry(trace[i]);
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef BOOT_TRACE_H
+#define BOOT_TRACE_H
+
+#include "config.h"
+
+// Power-on timing trace
+// Records when each step of the start sequence happened, in microseconds since
+// the board started running (key on, less the bootloader), so the time from
+// key on to the first plug heating can be measured on the bench.  Printed at
+// the end of the cycle when DEBUG is on; the simulator prints it too.
+
+enum BootTraceEvent {
+  BOOT_TRACE_SETUP,          // setup() entered
+  BOOT_TRACE_ADC_RUNNING,    // background sampling started
+  BOOT_TRACE_MEASURE_START,  // measurement pulse on all plugs
+  BOOT_TRACE_READING_VALID,  // a plug's reading settled and it was classified
+  BOOT_TRACE_HEAT_START      // a plug's first full power PWM edge
+};
+
+struct BootTraceEntry {
+  uint32_t micros;
+  uint8_t event;
+  int8_t channel;    // -1 for events that aren't per plug
+};
+
+const int BOOT_TRACE_SIZE = 3 + 2 * NUM_OUTPUTS;
+
+// Function declarations
+void traceBootEvent(BootTraceEvent event, int channel = -1);
+int getBootTraceLength();
+const BootTraceEntry* getBootTraceEntry(int index);
+const char* bootTraceEventName(uint8_t event);
+void printBootTrace();
+
+#endif
@@ -0,0 +1,123 @@
+#include "can_bus.h"
+
+// SPI instructions
+const uint8_t MCP_RESET = 0xC0;
+const uint8_t MCP_WRITE = 0x02;
+const uint8_t MCP_READ = 0x03;
+const uint8_t MCP_BIT_MODIFY = 0x05;
+const uint8_t MCP_READ_STATUS = 0xA0;
+const uint8_t MCP_LOAD_TX0 = 0x40;      // from TXB0SIDH
+const uint8_t MCP_RTS_TX0 = 0x81;
+const uint8_t MCP_STATUS_TX0REQ = 0x04;
+
+// Registers
+const uint8_t MCP_CANSTAT = 0x0E;
+const uint8_t MCP_CANCTRL = 0x0F;
+const uint8_t MCP_CNF3 = 0x28;          // CNF3, CNF2, CNF1 in that order
+const uint8_t MCP_TXB0CTRL = 0x30;
+const uint8_t MCP_TXREQ = 0x08;         // TXBnCTRL transmit request bit
+const uint8_t MCP_MODE_MASK = 0xE0;
+const uint8_t MCP_MODE_NORMAL = 0x00;
+const uint8_t MCP_MODE_CONFIG = 0x80;
+const uint8_t MCP_MODE_SLEEP = 0x20;
+
+// Bit timing: 8 time quanta a bit - sync, propagation 1, phase 1 of 3 and
+// phase 2 of 3, sampled at 62.5%.  The prescaler sets the quantum.
+const long CAN_PRESCALER = CAN_OSC_HZ / (2L * 8 * CAN_BITRATE);
+static_assert(CAN_PRESCALER >= 1 && CAN_PRESCALER <= 64 && CAN_PRESCALER * 2L * 8 * CAN_BITRATE == CAN_OSC_HZ,
+              "CAN_BITRATE can't be made from CAN_OSC_HZ with 8 quanta a bit");
+const uint8_t MCP_BIT_TIMING[] = {
+  0x02,                                 // CNF3: phase 2 = 3
+  0x90,                                 // CNF2: phase 2 set in CNF3, phase 1 = 3, propagation = 1
+  (uint8_t)(CAN_PRESCALER - 1)          // CNF1: jump width 1
+};
+
+static uint8_t readRegister(uint8_t address) {
+  halSpiSelect(true);
+  halSpiTransfer(MCP_READ);
+  halSpiTransfer(address);
+  uint8_t value = halSpiTransfer(0);
+  halSpiSelect(false);
+  return value;
+}
+
+static void writeRegisters(uint8_t address, const uint8_t* values, uint8_t count) {
+  halSpiSelect(true);
+  halSpiTransfer(MCP_WRITE);
+  halSpiTransfer(address);
+  for (uint8_t i = 0; i < count; i++) {
+    halSpiTransfer(values[i]);
+  }
+  halSpiSelect(false);
+}
+
+bool initializeCanBus() {
+  halSpiBegin();
+
+  // Comes out of reset in configuration mode.  The oscillator start-up timer
+  // (128 cycles, 16us) has run out before the next instruction is clocked in.
+  halSpiSelect(true);
+  halSpiTransfer(MCP_RESET);
+  halSpiSelect(false);
+  if ((readRegister(MCP_CANSTAT) & MCP_MODE_MASK) != MCP_MODE_CONFIG) {
+    DEBUG_LOG("No CAN controller");
+    return false;
+  }
+
+  writeRegisters(MCP_CNF3, MCP_BIT_TIMING, sizeof(MCP_BIT_TIMING));
+  writeRegisters(MCP_CANCTRL, &MCP_MODE_NORMAL, 1);  // CLKOUT off too
+  if ((readRegister(MCP_CANSTAT) & MCP_MODE_MASK) != MCP_MODE_NORMAL) {
+    DEBUG_LOG("CAN controller did not enter normal mode");
+    return false;
+  }
+
+  DEBUG_LOG("CAN bus running at %ld kbit/s", CAN_BITRATE / 1000);
+  return true;
+}
+
+bool canTransmitPending() {
+  halSpiSelect(true);
+  halSpiTransfer(MCP_READ_STATUS);
+  uint8_t status = halSpiTransfer(0);
+  halSpiSelect(false);
+  return (status & MCP_STATUS_TX0REQ) != 0;
+}
+
+bool canSendFrame(const CanFrame& frame) {
+  if (canTransmitPending()) {
+    return false;
+  }
+
+  halSpiSelect(true);
+  halSpiTransfer(MCP_LOAD_TX0);
+  halSpiTransfer(frame.id >> 3);            // SIDH
+  halSpiTransfer((frame.id & 0x07) << 5);   // SIDL, standard id
+  halSpiTransfer(0);                        // EID8
+  halSpiTransfer(0);                        // EID0
+  halSpiTransfer(frame.length);             // DLC, data frame
+  for (uint8_t i = 0; i < frame.length; i++) {
+    halSpiTransfer(frame.data[i]);
+  }
+  halSpiSelect(false);
+
+  halSpiSelect(true);
+  halSpiTransfer(MCP_RTS_TX0);
+  halSpiSelect(false);
+  return true;
+}
+
+// Clearing TXREQ aborts the frame, or lets one already on the wire finish
+void abortCanTransmit() {
+  halSpiSelect(true);
+  halSpiTransfer(MCP_BIT_MODIFY);
+  halSpiTransfer(MCP_TXB0CTRL);
+  halSpiTransfer(MCP_TXREQ);
+  halSpiTransfer(0);
+  halSpiSelect(false);
+}
+
+// Goes to sleep once the bus is idle; initializeCanBus() wakes it with a reset
+void sleepCanBus() {
+  abortCanTransmit();
+  writeRegisters(MCP_CANCTRL, &MCP_MODE_SLEEP, 1);
+}
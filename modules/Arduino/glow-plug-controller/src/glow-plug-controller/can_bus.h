@@ -0,0 +1,36 @@
+#ifndef CAN_BUS_H
+#define CAN_BUS_H
+
+#include "config.h"
+
+// MCP2515 CAN controller on the software SPI in hal.h
+// Only what telemetry needs: normal mode at CAN_BITRATE, standard data frames
+// out, nothing in.  Frames go out one at a time through transmit buffer 0, so
+// they reach the bus in the order they were sent.  canSendFrame() never
+// waits: if the last frame is still pending (bus busy, or nothing on the bus to
+// acknowledge it - the controller keeps retrying on its own) it returns false.
+// A frame nobody acknowledges stays pending until it is aborted, and the
+// controller won't change mode while one is, so sleepCanBus() aborts it first.
+
+const long CAN_OSC_HZ = 8000000;   // crystal on the common MCP2515/TJA1050 modules
+const long CAN_BITRATE = 500000;
+
+// Standard frame: 11-bit id, up to 8 data bytes
+struct CanFrame {
+  uint16_t id;
+  uint8_t length;
+  uint8_t data[8];
+};
+
+static_assert(!OutputPins::contains(HAL_SPI_CS_PIN) && !OutputPins::contains(HAL_SPI_SCK_PIN) &&
+              !OutputPins::contains(HAL_SPI_MOSI_PIN) && !OutputPins::contains(HAL_SPI_MISO_PIN),
+              "the CAN controller's SPI pins are used by an output");
+
+// Function declarations
+bool initializeCanBus();  // false if no controller answers
+bool canSendFrame(const CanFrame& frame);
+bool canTransmitPending();  // the last frame sent hasn't reached the bus yet
+void abortCanTransmit();  // drops the pending frame, if it hasn't gone yet
+void sleepCanBus();  // about 1uA until the next initializeCanBus()
+
+#endif
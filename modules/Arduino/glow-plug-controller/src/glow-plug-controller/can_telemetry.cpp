@@ -0,0 +1,107 @@
+#include "can_telemetry.h"
+#include "overcurrent_trip.h"
+
+static bool running = false;
+static CanFrame batch[CAN_TELEMETRY_FRAMES];
+static uint8_t nextFrame = CAN_TELEMETRY_FRAMES;  // all sent
+static uint8_t sequence = 0;
+static uint16_t skippedBatches = 0;
+static unsigned long lastSendMs = 0;
+
+void initializeCanTelemetry() {
+  nextFrame = CAN_TELEMETRY_FRAMES;
+  sequence = 0;
+  skippedBatches = 0;
+  running = initializeCanBus();
+}
+
+int packCanTelemetry(CanFrame* frames) {
+  CanFrame& status = frames[0];
+  status.id = CAN_TELEMETRY_BASE_ID;
+  status.length = 8;
+  uint8_t faulted = 0;
+  uint8_t enabled = 0;
+  for (Channel i : Channel::all()) {
+    if (glowChannels[i].faulted) faulted |= 1 << i;
+    if (glowChannels[i].enabled) enabled |= 1 << i;
+  }
+  uint16_t time = (uint16_t)halMillis();
+  status.data[0] = (uint8_t)currentState;
+  status.data[1] = faulted;
+  status.data[2] = enabled;
+  status.data[3] = getTrippedOutputs();
+  status.data[4] = sequence++;
+  status.data[5] = (uint8_t)skippedBatches;
+  status.data[6] = time & 0xFF;
+  status.data[7] = time >> 8;
+
+  for (int f = 1; f < CAN_TELEMETRY_FRAMES; f++) {
+    frames[f].id = CAN_TELEMETRY_BASE_ID + f;
+    frames[f].length = 0;
+  }
+  for (Channel i : Channel::all()) {
+    CanFrame& frame = frames[1 + i / CAN_TELEMETRY_CHANNELS_PER_FRAME];
+    uint8_t* p = frame.data + frame.length;
+    frame.length += CAN_TELEMETRY_CHANNEL_SIZE;
+
+    CurrentReading reading = readGlowPlugCurrent(i);
+    uint16_t tenths = (reading.milliamps + 50UL) / 100;
+    uint16_t tempC = (uint16_t)((reading.estimatedTempQ4 + TEMP_Q4_ONE / 2) >> 4) & 0x0FFF;
+    uint16_t tempAndState = tempC | (uint16_t)glowChannels[i].state << 12;
+    p[0] = tenths > 255 ? 255 : tenths;
+    p[1] = glowChannels[i].duty;
+    p[2] = tempAndState & 0xFF;
+    p[3] = tempAndState >> 8;
+  }
+  return CAN_TELEMETRY_FRAMES;
+}
+
+void queueCanTelemetry() {
+  if (!running) {
+    return;
+  }
+  if (nextFrame < CAN_TELEMETRY_FRAMES) {
+    skippedBatches++;
+    return;
+  }
+  packCanTelemetry(batch);
+  nextFrame = 0;
+}
+
+// At most one frame a run: about 170us of SPI for a full frame
+void sendCanTelemetry() {
+  if (!running || nextFrame >= CAN_TELEMETRY_FRAMES) {
+    return;
+  }
+  if (canSendFrame(batch[nextFrame])) {
+    nextFrame++;
+    lastSendMs = halMillis();
+  }
+}
+
+// Once the last batch is out: the controller sleeps and telemetry stays off
+void stopCanTelemetry() {
+  if (running) {
+    sleepCanBus();
+    running = false;
+  }
+}
+
+bool isCanTelemetryBatchPending() {
+  if (!running) {
+    return false;
+  }
+  if (canTransmitPending()) {
+    // stopCanTelemetry() aborts a frame nobody acknowledges
+    return halMillis() - lastSendMs < CAN_ACK_TIMEOUT_MS;
+  }
+  return nextFrame < CAN_TELEMETRY_FRAMES;
+}
+
+bool isCanTelemetryRunning() {
+  return running;
+}
+
+unsigned int getSkippedCanBatches() {
+  return skippedBatches;
+}
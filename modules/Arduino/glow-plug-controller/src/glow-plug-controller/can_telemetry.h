@@ -0,0 +1,59 @@
+#ifndef CAN_TELEMETRY_H
+#define CAN_TELEMETRY_H
+
+#include "config.h"
+#include "can_bus.h"
+#include "current_monitor.h"
+
+// CAN telemetry
+// A fixed set of standard frames, packed together every CAN_TELEMETRY_PERIOD_MS
+// so they all describe the same moment, then handed to the CAN controller one
+// per run of a CAN_SEND_PERIOD_MS task.  Both tasks sit right behind the
+// current monitor in the task table, at no more than its rate, so they run in
+// the slack after it and never push it back; neither waits on the SPI or the
+// bus.  A batch that comes due while the last one is still going out is
+// skipped and counted.  If no controller answers at start up, CAN telemetry
+// stays off.  Decode a candump log with host/can-decode.
+//
+// Frames, multi-byte fields little endian:
+//   CAN_TELEMETRY_BASE_ID             status, 8 bytes
+//     0   controller state
+//     1   faulted outputs, bit n = output n
+//     2   enabled outputs
+//     3   tripped outputs (overcurrent fast-trip)
+//     4   batch sequence number
+//     5   skipped batch count (wraps)
+//     6   time, ms (low 16 bits)
+//   CAN_TELEMETRY_BASE_ID + 1 + n/2   outputs n and n+1, 4 bytes each
+//     0   current, 0.1A (saturates at 25.5A)
+//     1   duty (0-255)
+//     2   temperature, whole C, 12 bit signed; bits 12-14 the OutputState
+
+const uint16_t CAN_TELEMETRY_BASE_ID = 0x620;
+const int CAN_TELEMETRY_CHANNEL_SIZE = 4;
+const int CAN_TELEMETRY_CHANNELS_PER_FRAME = 2;
+const int CAN_TELEMETRY_FRAMES = 1 + (NUM_OUTPUTS + CAN_TELEMETRY_CHANNELS_PER_FRAME - 1) / CAN_TELEMETRY_CHANNELS_PER_FRAME;
+
+const int CAN_TELEMETRY_PERIOD_MS = 100;
+const int CAN_SEND_PERIOD_MS = CURRENT_MONITOR_PERIOD_MS;
+// A frame still pending this long after it was sent has nothing on the bus to
+// acknowledge it (one takes a quarter of a millisecond), so low power doesn't
+// wait for it
+const int CAN_ACK_TIMEOUT_MS = 20;
+
+static_assert(NUM_OUTPUTS <= 8, "fault/enable bitmasks are 8 bits");
+static_assert(CAN_SEND_PERIOD_MS >= CURRENT_MONITOR_PERIOD_MS, "CAN tasks must not run more often than the current monitor");
+static_assert(CAN_TELEMETRY_FRAMES * CAN_SEND_PERIOD_MS < CAN_TELEMETRY_PERIOD_MS,
+              "a batch has to go out before the next one is due");
+
+// Function declarations
+void initializeCanTelemetry();
+void queueCanTelemetry();
+void sendCanTelemetry();
+int packCanTelemetry(CanFrame* frames);  // CAN_TELEMETRY_FRAMES frames
+void stopCanTelemetry();
+bool isCanTelemetryBatchPending();  // the last batch is still going out (see CAN_ACK_TIMEOUT_MS)
+bool isCanTelemetryRunning();
+unsigned int getSkippedCanBatches();
+
+#endif
@@ -1,36 +1,55 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-#include <Arduino.h>
+#include "hal.h"
+#include <NeotericCore.h>
 
 // Configuration constants
-const int START_WAIT_SECONDS = 1;  // Reduced from 3 seconds
+// The temperature measurement pulse starts at power on and runs during the
+// boot delay (START_WAIT_MS); each plug starts heating as soon as its own
+// reading is in and the delay is over.
 
 // uncomment these for 1-channel test board
-//const int OUTPUT_PINS[] = {11};    // pwm outputs
-//const int INPUT_PINS[] = {A5}; // voltage sense inputs
+//typedef neoteric::ChannelSet<11> OutputPins;    // pwm outputs
+//typedef neoteric::ChannelSet<A5> InputPins;     // voltage sense inputs
 
-const int OUTPUT_PINS[] = {3,5,6,9,10,11};    // pwm outputs
-const int INPUT_PINS[] = {A0,A1,A2,A3,A4,A5}; // voltage sense inputs
-const int NUM_OUTPUTS = sizeof(OUTPUT_PINS) / sizeof(OUTPUT_PINS[0]);
-const int NUM_INPUTS = sizeof(INPUT_PINS) / sizeof(INPUT_PINS[0]);
+typedef neoteric::ChannelSet<3,5,6,9,10,11> OutputPins;    // pwm outputs
+typedef neoteric::ChannelSet<A0,A1,A2,A3,A4,A5> InputPins; // voltage sense inputs
+const int NUM_OUTPUTS = OutputPins::COUNT;
+const int NUM_INPUTS = InputPins::COUNT;
+static_assert(NUM_INPUTS == NUM_OUTPUTS, "each output needs the input that senses it");
+
+// Wake input: a switch to ground, such as the key through an opto or a restart
+// button, that brings the controller back out of low power (low_power.h)
+const uint8_t WAKE_PIN = 2;
+static_assert(!OutputPins::contains(WAKE_PIN), "the wake input is used by an output");
+
+// One plug: an output and the input that senses it share the index.  Made
+// only by Channel::all(), Channel::at<N>() or Channel::fromInt(), so it is
+// always in range and nothing that takes one checks it.
+typedef OutputPins::Index Channel;
+const int START_WAIT_MS = 1000;               // no plug heats before this long after power on
 const int FULL_POWER_DURATION_MS = 5000;      // 5 seconds at 100% for all plugs
 const int COLD_ENGINE_TOTAL_MS = 15000;       // 15 seconds total for cold engine
 const int HOT_ENGINE_TOTAL_MS = 10000;        // 10 seconds total for hot engine
-const int STAGGER_DELAY_MS = 500;             // 0.5 seconds between starting each plug
-const float HOT_PLUG_TEMP_THRESHOLD = 200.0;  // Temperature threshold for "hot" plug
-const float REDUCED_DUTY_CYCLE = 0.6;         // 60% duty cycle for second phase
+const int ADMISSION_MAX_WAIT_MS = 500;        // longest wait between starting plugs
+constexpr float SUPPLY_CURRENT_BUDGET = 40.0; // Amps the supply may draw while plugs are starting
+constexpr float HOT_PLUG_TEMP_THRESHOLD = 200.0;  // Temperature threshold for "hot" plug
+constexpr float REDUCED_DUTY_CYCLE = 0.6;         // Starting guess for the duty that holds temperature
+constexpr float TARGET_PLUG_TEMP = 850.0;         // Closed loop temperature target (temperature_control.h)
 
 // Current monitoring constants
-const float VOLTAGE_DIVIDER_R1 = 4700.0;    // 4.7k to Arduino input
-const float VOLTAGE_DIVIDER_R2 = 1500.0;    // 1.5k to ground
-const float ARDUINO_VREF = 5.0;             // Arduino reference voltage
-const float ADC_RESOLUTION = 1024.0;        // 10-bit ADC
-const float BTS50010_SENSE_RATIO = 10000.0; // 10000:1 current sense ratio (typical)
+typedef neoteric::Divider<4700, 1500> SenseDivider;  // 4.7k to Arduino input, 1.5k to ground
+typedef neoteric::Adc<10, 5000> BoardAdc;            // 10-bit, 5V reference
+constexpr float BTS50010_SENSE_RATIO = 10000.0; // 10000:1 current sense ratio (typical)
+constexpr float SENSE_RESISTOR = 1.0;           // Assuming 1 ohm sense resistor
+// Empirical calibration: reported 9.67A when actual was 16A
+// Correction factor: 16A / 9.67A = 1.65
+constexpr float CURRENT_CALIBRATION_FACTOR = 1.65;
 
 // Current limits (in Amperes)
-const float MIN_CURRENT_THRESHOLD = 1.0;    // Minimum expected current
-const float MAX_CURRENT_THRESHOLD = 20.0;   // Maximum safe current
+constexpr float MIN_CURRENT_THRESHOLD = 1.0;    // Minimum expected current
+constexpr float MAX_CURRENT_THRESHOLD = 20.0;   // Maximum safe current
 const bool DISABLE_CURRENT_LIMITS = false;  // Set to true to disable current limit checking
 
 // Temperature estimation constants (simplified model)
@@ -46,25 +65,59 @@ const bool DISABLE_CURRENT_LIMITS = false;  // Set to true to disable current li
 // Example 1: Bosch Duraterm glow plugs typically have ~0.6Ω cold resistance, TC ~0.0055/°C
 // Example 2: NGK ceramic glow plugs typically have ~1.2Ω cold resistance, TC ~0.004/°C
 // Example 3: ACDelco 6.6 Duramax ceramic glow plugs typically have ~0.4Ω cold resistance, TC ~0.0008/°C
-const float GLOW_PLUG_RESISTANCE_COLD = 0.8;  // Cold resistance in ohms
-const float TEMP_COEFFICIENT = 0.006;         // Temperature coefficient per °C
-const float AMBIENT_TEMP = 25.0;              // Ambient temperature in °C
+constexpr float GLOW_PLUG_RESISTANCE_COLD = 0.8;  // Cold resistance in ohms
+constexpr float TEMP_COEFFICIENT = 0.006;         // Temperature coefficient per °C
+constexpr float AMBIENT_TEMP = 25.0;              // Ambient temperature in °C
+constexpr float MAX_ESTIMATED_TEMP = 1000.0;      // Estimates are clamped to this
+constexpr float SUPPLY_VOLTAGE = 13.8;            // Vehicle supply voltage assumed for resistance
 
-// Debug macros
+// Serial output
+// TELEMETRY, the default, sends one compact binary frame per loop that never
+// blocks (see telemetry.h; decode with host/telemetry-decode).  DEBUG sends the
+// tokenized debug log instead (see debug_log.h; expand with host/log-expand),
+// which drops what doesn't fit in the same way.  TRACE_RECORD sends a trace of
+// every ADC sample and every decision, for host/trace-replay (see
+// trace_recorder.h).  They share the port: DEBUG and TRACE_RECORD each take it
+// over from TELEMETRY, and can't be used together.
 // Uncomment this line to enable debug output
-#define DEBUG
+//#define DEBUG
+// Uncomment this line (or pass -DTRACE_RECORD) to record a trace
+//#define TRACE_RECORD
+#if !defined(TRACE_RECORD) && !defined(DEBUG)
+  #define TELEMETRY
+#endif
+
+#if defined(DEBUG) && defined(TRACE_RECORD)
+  #error "DEBUG and TRACE_RECORD both use the serial port - enable only one"
+#endif
+
+// Uncomment this line (or pass -DCAN_TELEMETRY) to also send telemetry frames
+// on a CAN bus through an MCP2515 module wired to the SPI pins in hal.h (see
+// can_telemetry.h).  It doesn't use the serial port, so it works alongside
+// either of the above.
+//#define CAN_TELEMETRY
 
-#ifdef DEBUG
-  #define DEBUG_PRINT(x) Serial.print(x)
-  #define DEBUG_PRINTLN(x) Serial.println(x)
+// Uncomment this line (or pass -DBENCHMARK) to build the benchmarks in
+// benchmark.h instead of the controller.  The outputs stay off.
+//#define BENCHMARK
+
+#if defined(TRACE_RECORD)
+  const unsigned long SERIAL_BAUD = 500000;   // exact on a 16MHz part
+#elif defined(TELEMETRY) || defined(DEBUG)
+  const unsigned long SERIAL_BAUD = 115200;
 #else
-  #define DEBUG_PRINT(x)
-  #define DEBUG_PRINTLN(x)
+  const unsigned long SERIAL_BAUD = 9600;
 #endif
 
+#include "debug_log.h"
+
 // State machine
+// BOOT_DELAY and MEASURE_PAUSE are no longer entered (the boot delay overlaps
+// MEASURING); they keep their values so telemetry state codes don't change.
 enum ControllerState {
   STATE_BOOT_DELAY,
+  STATE_MEASURING,       // measurement pulse and boot delay, no plug heating yet
+  STATE_MEASURE_PAUSE,
   STATE_FULL_POWER,
   STATE_RAMP_DOWN,
   STATE_IDLE,
@@ -73,23 +126,55 @@ enum ControllerState {
 
 enum OutputState {
   OUTPUT_OFF,
+  OUTPUT_MEASURING,      // measurement pulse, until the reading settles
   OUTPUT_WAITING_TO_START,
-  OUTPUT_FULL_POWER,
-  OUTPUT_REDUCED_POWER,
+  OUTPUT_FULL_POWER,     // heating up to TARGET_PLUG_TEMP
+  OUTPUT_REDUCED_POWER,  // holding at TARGET_PLUG_TEMP
   OUTPUT_FINISHED
 };
 
+// Temperatures are carried in 1/16 degree C steps (see fixed_point.h)
+typedef neoteric::Fixed<int16_t, 4> TempQ4;
+typedef TempQ4::Raw tempq4_t;
+const int TEMP_Q4_ONE = TempQ4::ONE;
+
+// PWM duty is stored as the 0-255 analogWrite value.  dutyFromFraction()
+// truncates rather than rounding like DutyPwm::fromFraction(), so the duties the
+// heating sequence was tuned with stay put (MEASURE_DUTY_CYCLE is 25, not 26).
+typedef neoteric::Pwm<255> DutyPwm;
+constexpr uint8_t dutyFromFraction(float fraction) { return (uint8_t)(fraction * DutyPwm::TOP); }
+const uint8_t DUTY_OFF = 0;
+const uint8_t DUTY_FULL = DutyPwm::TOP;
+constexpr uint8_t DUTY_REDUCED = dutyFromFraction(REDUCED_DUTY_CYCLE);
+
+// Per-channel state, one packed record per output (8 bytes on the AVR).
+// Times are 16 bit milliseconds since heatingStartTime, which is plenty for the
+// longest heating sequence.
+struct GlowChannel {
+  uint8_t duty;              // current PWM duty, 0-255
+  uint8_t state : 3;         // OutputState
+  uint8_t enabled : 1;
+  uint8_t faulted : 1;
+  uint16_t phaseStartMs;     // when measuring, or heating (both phases), started
+  uint16_t totalDurationMs;  // full + reduced power time
+  tempq4_t initialTempQ4;    // estimated during the measurement pulse
+};
+static_assert(sizeof(GlowChannel) <= 8, "GlowChannel should stay packed");
+
+static_assert(START_WAIT_MS + (NUM_OUTPUTS - 1) * ADMISSION_MAX_WAIT_MS + COLD_ENGINE_TOTAL_MS < 65535,
+              "heating sequence must fit the 16 bit channel timestamps");
+
 // Global variables
 extern ControllerState currentState;
 extern unsigned long stateStartTime;
-extern bool outputEnabled[NUM_OUTPUTS];
-extern float currentDutyCycle[NUM_OUTPUTS];
-extern OutputState outputStates[NUM_OUTPUTS];
-extern unsigned long outputStartTimes[NUM_OUTPUTS];
-extern unsigned long outputStaggerStartTime[NUM_OUTPUTS];
-extern int outputTotalDuration[NUM_OUTPUTS];
-extern float initialTemperatures[NUM_OUTPUTS];
-extern bool outputFaulted[NUM_OUTPUTS];
-extern int firstFaultedOutput;
-
-#endif
\ No newline at end of file
+extern unsigned long heatingStartTime;
+extern GlowChannel glowChannels[NUM_OUTPUTS];
+extern int8_t firstFaultedOutput;
+
+// Milliseconds since heatingStartTime, saturating at the 16 bit limit
+inline uint16_t heatingMillis() {
+  unsigned long elapsed = halMillis() - heatingStartTime;
+  return elapsed > 0xFFFF ? 0xFFFF : (uint16_t)elapsed;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include "conversion_tables.h"
+
+// Compile-time versions of convertVoltageToCurrent() and
+// estimateGlowPlugTemperature().  C++11 constexpr functions are single
+// expressions, hence the nesting.
+
+constexpr float tableAmps(int adcCode) {
+  return adcCode * MILLIAMPS_PER_ADC_CODE / 1000.0;
+}
+
+constexpr float clampTemperature(float temperature) {
+  return temperature < AMBIENT_TEMP ? AMBIENT_TEMP
+       : temperature > MAX_ESTIMATED_TEMP ? MAX_ESTIMATED_TEMP
+       : temperature;
+}
+
+constexpr float tableTemperature(float amps) {
+  return amps <= 0.1 ? AMBIENT_TEMP
+       : clampTemperature(AMBIENT_TEMP + (SUPPLY_VOLTAGE / amps - GLOW_PLUG_RESISTANCE_COLD)
+                                         / (GLOW_PLUG_RESISTANCE_COLD * TEMP_COEFFICIENT));
+}
+
+constexpr uint16_t tableMilliamps(int adcCode) {
+  return (uint16_t)(tableAmps(adcCode) * 1000.0 + 0.5);
+}
+
+constexpr tempq4_t tableTemperatureQ4(int adcCode) {
+  return (tempq4_t)(tableTemperature(tableAmps(adcCode)) * TEMP_Q4_ONE + 0.5);
+}
+
+#define CONVERSION_ENTRY(n) { tableMilliamps(n), tableTemperatureQ4(n) }
+
+#define REPEAT_4(f, n)    f(n), f((n) + 1), f((n) + 2), f((n) + 3)
+#define REPEAT_16(f, n)   REPEAT_4(f, n), REPEAT_4(f, (n) + 4), REPEAT_4(f, (n) + 8), REPEAT_4(f, (n) + 12)
+#define REPEAT_64(f, n)   REPEAT_16(f, n), REPEAT_16(f, (n) + 16), REPEAT_16(f, (n) + 32), REPEAT_16(f, (n) + 48)
+#define REPEAT_256(f, n)  REPEAT_64(f, n), REPEAT_64(f, (n) + 64), REPEAT_64(f, (n) + 128), REPEAT_64(f, (n) + 192)
+#define REPEAT_1024(f, n) REPEAT_256(f, n), REPEAT_256(f, (n) + 256), REPEAT_256(f, (n) + 512), REPEAT_256(f, (n) + 768)
+
+static_assert(ADC_CODE_COUNT == 1024, "table generator is written for a 10 bit ADC");
+
+const AdcConversion ADC_CONVERSION_TABLE[ADC_CODE_COUNT] PROGMEM = {
+  REPEAT_1024(CONVERSION_ENTRY, 0)
+};
@@ -0,0 +1,29 @@
+#ifndef CONVERSION_TABLES_H
+#define CONVERSION_TABLES_H
+
+#include "config.h"
+#include "fixed_point.h"
+
+// ADC code -> load current and estimated temperature lookup table
+// Generated at compile time from the config.h constants using the same model as
+// the float reference in current_monitor.cpp, and stored in flash (4KB).
+// Changing the glow plug constants only needs a rebuild.
+
+const int ADC_CODE_COUNT = 1024;
+
+struct AdcConversion {
+  uint16_t milliamps;
+  tempq4_t temperatureQ4;
+};
+
+extern const AdcConversion ADC_CONVERSION_TABLE[ADC_CODE_COUNT] PROGMEM;
+
+inline uint16_t lookupMilliamps(uint16_t adcCode) {
+  return pgm_read_word(&ADC_CONVERSION_TABLE[adcCode & (ADC_CODE_COUNT - 1)].milliamps);
+}
+
+inline tempq4_t lookupTemperatureQ4(uint16_t adcCode) {
+  return (tempq4_t)pgm_read_word(&ADC_CONVERSION_TABLE[adcCode & (ADC_CODE_COUNT - 1)].temperatureQ4);
+}
+
+#endif
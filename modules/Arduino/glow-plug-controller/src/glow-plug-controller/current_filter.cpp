@@ -0,0 +1,90 @@
+#include "current_filter.h"
+
+struct ChannelFilter {
+  uint16_t sum;         // on-time samples waiting to be decimated
+  uint8_t summed;
+  uint8_t offRun;       // off-time samples in a row
+  uint16_t outputQ4;    // IIR output
+  uint16_t samples;
+  uint8_t stableRun;    // decimated samples in a row within tolerance
+};
+
+static volatile ChannelFilter filters[NUM_INPUTS];
+
+static void clearFilter(volatile ChannelFilter& f) {
+  f.sum = 0;
+  f.summed = 0;
+  f.offRun = 0;
+  f.outputQ4 = 0;
+  f.samples = 0;
+  f.stableRun = 0;
+}
+
+void initializeCurrentFilter() {
+  for (Channel i : Channel::all()) {
+    clearFilter(filters[i]);
+  }
+  DEBUG_LOG("Current filter: %dx oversampling, IIR 1/%d", FILTER_OVERSAMPLE, 1 << FILTER_IIR_SHIFT);
+}
+
+void filterAdcSample(Channel inputIndex, uint16_t adcValue) {
+  volatile ChannelFilter& f = filters[inputIndex];
+
+  if (adcValue < FILTER_ON_CODE) {
+    // PWM off time.  A long run of it means the output really is off, and the
+    // next on time should start from scratch.
+    if (f.offRun < FILTER_OFF_RESET_SAMPLES) {
+      f.offRun++;
+    } else if (f.samples != 0) {
+      clearFilter(f);
+    }
+    return;
+  }
+
+  f.offRun = 0;
+  f.sum += adcValue;
+  if (f.samples != 0xFFFF) {
+    f.samples++;
+  }
+  if (++f.summed < FILTER_OVERSAMPLE) {
+    return;
+  }
+
+  // decimated sample in 1/16 code steps
+  uint16_t inputQ4 = f.sum << (4 - FILTER_OVERSAMPLE_SHIFT);
+  f.sum = 0;
+  f.summed = 0;
+
+  if (f.samples == FILTER_OVERSAMPLE) {
+    // first decimated sample primes the filter
+    f.outputQ4 = inputQ4;
+    return;
+  }
+
+  int16_t error = (int16_t)(inputQ4 - f.outputQ4);
+  f.outputQ4 += error >> FILTER_IIR_SHIFT;
+
+  uint16_t distance = error < 0 ? -error : error;
+  if (distance > (f.outputQ4 >> FILTER_SETTLE_SHIFT)) {
+    f.stableRun = 0;
+  } else if (f.stableRun < FILTER_SETTLE_COUNT) {
+    f.stableRun++;
+  }
+}
+
+FilteredCurrent getFilteredCurrent(Channel inputIndex) {
+  FilteredCurrent result = {0, 0, false};
+  uint8_t sreg = halEnterCritical();
+  volatile ChannelFilter& f = filters[inputIndex];
+  result.samples = f.samples;
+  result.codeQ4 = f.samples >= FILTER_OVERSAMPLE ? f.outputQ4 : 0;
+  result.isSettled = f.stableRun >= FILTER_SETTLE_COUNT;
+  halExitCritical(sreg);
+  return result;
+}
+
+void resetCurrentFilter(Channel inputIndex) {
+  uint8_t sreg = halEnterCritical();
+  clearFilter(filters[inputIndex]);
+  halExitCritical(sreg);
+}
@@ -0,0 +1,42 @@
+#ifndef CURRENT_FILTER_H
+#define CURRENT_FILTER_H
+
+#include "config.h"
+#include "fixed_point.h"
+
+// Current-sense filter stage
+// Sits between the ADC interrupt and CurrentReading.  The BTS50010 sense output
+// only carries current while the PWM output is on, so samples below
+// FILTER_ON_CODE are treated as off time and skipped.  On-time samples are
+// averaged FILTER_OVERSAMPLE at a time (decimation), then run through a
+// first order IIR low pass.  The filter counts as settled once enough
+// consecutive decimated samples land within 1/2^FILTER_SETTLE_SHIFT of its
+// output, which is what lets the measurement pulse end early.
+//
+// The filter runs in the ADC interrupt, a handful of 16 bit operations per
+// sample, so it sees every conversion no matter how busy the loop is.
+
+const uint8_t FILTER_OVERSAMPLE_SHIFT = 1;     // 2 on-time samples per decimated sample
+const uint8_t FILTER_IIR_SHIFT = 2;            // y += (x - y) / 4
+const uint8_t FILTER_SETTLE_SHIFT = 5;         // settled within 1/32 (~3%) of the output
+const uint8_t FILTER_SETTLE_COUNT = 3;         // consecutive decimated samples in tolerance
+const uint8_t FILTER_OFF_RESET_SAMPLES = 32;   // off-time samples in a row before the output counts as off
+
+const uint8_t FILTER_OVERSAMPLE = 1 << FILTER_OVERSAMPLE_SHIFT;
+
+// Below this the sense line is reading off time (or no load at all)
+constexpr uint16_t FILTER_ON_CODE = (uint16_t)(MIN_ESTIMATE_MA / MILLIAMPS_PER_ADC_CODE) + 1;
+
+struct FilteredCurrent {
+  uint16_t codeQ4;     // filtered ADC code, 1/16 code steps
+  uint16_t samples;    // on-time samples since the filter last reset (saturates)
+  bool isSettled;
+};
+
+// Function declarations
+void initializeCurrentFilter();
+void filterAdcSample(Channel inputIndex, uint16_t adcValue);  // interrupt context
+FilteredCurrent getFilteredCurrent(Channel inputIndex);
+void resetCurrentFilter(Channel inputIndex);
+
+#endif
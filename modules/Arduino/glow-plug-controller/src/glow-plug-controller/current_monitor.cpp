@@ -1,49 +1,44 @@
 #include "current_monitor.h"
 #include "output_control.h"
 #include "fault_indication.h"
+#include "adc_sampler.h"
+#include "overcurrent_trip.h"
+#include "current_filter.h"
+#include "conversion_tables.h"
+#include "event_log.h"
 
 void initializeCurrentMonitoring() {
-  DEBUG_PRINTLN("Current monitoring initialized");
-  DEBUG_PRINT("Voltage divider ratio: ");
-  DEBUG_PRINTLN(VOLTAGE_DIVIDER_R2 / (VOLTAGE_DIVIDER_R1 + VOLTAGE_DIVIDER_R2));
-  DEBUG_PRINT("Current limits: ");
-  DEBUG_PRINT(MIN_CURRENT_THRESHOLD);
-  DEBUG_PRINT("A to ");
-  DEBUG_PRINT(MAX_CURRENT_THRESHOLD);
-  DEBUG_PRINTLN("A");
+  DEBUG_LOG("Current monitoring initialized");
+  DEBUG_LOG("Voltage divider ratio: %.2f", SenseDivider::RATIO);
+  DEBUG_LOG("Current limits: %.2fA to %.2fA", MIN_CURRENT_THRESHOLD, MAX_CURRENT_THRESHOLD);
 }
 
-float readVoltageFromADC(int inputPin) {
-  int adcValue = analogRead(inputPin);
-  float arduinoVoltage = (adcValue / ADC_RESOLUTION) * ARDUINO_VREF;
+// Float reference chain.  The control path uses the lookup table in
+// conversion_tables.h; these are kept for diagnostics and accuracy comparison.
+
+float convertAdcToVoltage(int adcValue) {
+  float arduinoVoltage = BoardAdc::volts(adcValue);
   
   // Convert back to original voltage before voltage divider
-  float originalVoltage = arduinoVoltage * (VOLTAGE_DIVIDER_R1 + VOLTAGE_DIVIDER_R2) / VOLTAGE_DIVIDER_R2;
-  
-  // ALWAYS show detailed debug during current issues
-  DEBUG_PRINT("[DEBUG] Pin A");
-  DEBUG_PRINT(inputPin - A0);
-  DEBUG_PRINT(" - ADC raw: ");
-  DEBUG_PRINT(adcValue);
-  DEBUG_PRINT("/1024, Arduino input: ");
-  DEBUG_PRINT(arduinoVoltage);
-  DEBUG_PRINT("V, Reconstructed IS voltage: ");
-  DEBUG_PRINT(originalVoltage);
-  DEBUG_PRINTLN("V");
+  return SenseDivider::inputVolts(arduinoVoltage);
+}
+
+float readVoltageFromADC(Channel inputIndex) {
+  // latest sample from the background sampler - no waiting on the ADC
+  int adcValue = getLatestAdcSample(inputIndex);
+  float originalVoltage = convertAdcToVoltage(adcValue);
+  
+  DEBUG_LOG("[DEBUG] Pin A%d - ADC raw: %d/1024, Reconstructed IS voltage: %.2fV", InputPins::pin(inputIndex) - A0, adcValue, originalVoltage);
   
   return originalVoltage;
 }
 
 float convertVoltageToCurrent(float senseVoltage) {
   // BTS50010 provides a current sense output
-  // Empirical calibration: reported 9.67A when actual was 16A
-  // Correction factor: 16A / 9.67A = 1.65
-  
-  const float SENSE_RESISTOR = 1.0; // Assuming 1 ohm sense resistor  
-  const float CALIBRATION_FACTOR = 1.65; // Empirical correction based on actual measurements
+  // CURRENT_CALIBRATION_FACTOR is an empirical correction (see config.h)
   
   float senseCurrent = senseVoltage / SENSE_RESISTOR;
-  float loadCurrent = senseCurrent * (BTS50010_SENSE_RATIO / 10000.0) * CALIBRATION_FACTOR;
+  float loadCurrent = senseCurrent * (BTS50010_SENSE_RATIO / 10000.0) * CURRENT_CALIBRATION_FACTOR;
   
   return loadCurrent;
 }
@@ -57,9 +52,7 @@ float estimateGlowPlugTemperature(float current) {
   // Real glow plugs have complex temperature/current relationships
   // This is a basic linear approximation
   
-  // Assume 12V supply for resistance calculation
-  float voltage = 13.8; // Vehicle supply voltage
-  float resistance = voltage / current;
+  float resistance = SUPPLY_VOLTAGE / current;
   
   // Temperature calculation based on resistance change
   // R(T) = R0 * (1 + α * ΔT)
@@ -70,49 +63,49 @@ float estimateGlowPlugTemperature(float current) {
   float temperature = AMBIENT_TEMP + deltaT;
   
   // Clamp to reasonable range
-  temperature = constrain(temperature, AMBIENT_TEMP, 1000.0);
+  temperature = constrain(temperature, AMBIENT_TEMP, MAX_ESTIMATED_TEMP);
   
   return temperature;
 }
 
-CurrentReading readGlowPlugCurrent(int outputIndex) {
+CurrentReading readGlowPlugCurrent(Channel outputIndex) {
   CurrentReading reading;
   reading.isValid = false;
-  reading.current = 0.0;
-  reading.estimatedTemp = AMBIENT_TEMP;
+  reading.milliamps = 0;
+  reading.estimatedTempQ4 = AMBIENT_TEMP_Q4;
+  reading.sampleCount = 0;
+  reading.isSettled = false;
   reading.isOvercurrent = false;
   reading.isUndercurrent = false;
   
-  // Check if output index is valid
-  if (outputIndex < 0 || outputIndex >= NUM_INPUTS) {
-    return reading;
-  }
-  
   // Check if output is enabled - no current if disabled
   if (!isOutputEnabled(outputIndex)) {
     reading.isValid = true;
     return reading;
   }
   
-  // Read voltage from corresponding input pin
-  float senseVoltage = readVoltageFromADC(INPUT_PINS[outputIndex]);
+  // Filtered on-time current from the corresponding input pin
+  FilteredCurrent filtered = getFilteredCurrent(outputIndex);
+  reading.sampleCount = filtered.samples;
+  reading.isSettled = filtered.isSettled;
   
-  // Convert voltage to current
-  reading.current = convertVoltageToCurrent(senseVoltage);
+  // Current keeps the filter's fractional codes; temperature only needs the
+  // nearest whole code, so it still comes from the flash table
+  reading.milliamps = adcCodeQ4ToMilliamps(filtered.codeQ4);
+  reading.estimatedTempQ4 = lookupTemperatureQ4((filtered.codeQ4 + 8) >> 4);
   
-  // Estimate temperature
-  reading.estimatedTemp = estimateGlowPlugTemperature(reading.current);
+  DEBUG_LOG("[DEBUG] Pin A%d - filtered ADC: %.2f (%u samples), load current: %umA", InputPins::pin(outputIndex) - A0, filtered.codeQ4 / 16.0, filtered.samples, reading.milliamps);
   
   // Check current limits
-  reading.isOvercurrent = (reading.current > MAX_CURRENT_THRESHOLD);
-  reading.isUndercurrent = (reading.current < MIN_CURRENT_THRESHOLD && reading.current > 0.5); // Only flag if some current
+  reading.isOvercurrent = (reading.milliamps > MAX_CURRENT_MA);
+  reading.isUndercurrent = (reading.milliamps < MIN_CURRENT_MA && reading.milliamps > UNDERCURRENT_FLOOR_MA); // Only flag if some current
   
   reading.isValid = true;
   
   return reading;
 }
 
-void checkCurrentLimitsAndDisable(int outputIndex, CurrentReading reading) {
+void checkCurrentLimitsAndDisable(Channel outputIndex, CurrentReading reading) {
   if (!reading.isValid) {
     return;
   }
@@ -121,128 +114,141 @@ void checkCurrentLimitsAndDisable(int outputIndex, CurrentReading reading) {
   bool hasFault = false;
   
   if (reading.isOvercurrent) {
-    DEBUG_PRINT("OVERCURRENT detected on output ");
-    DEBUG_PRINT(outputIndex);
-    DEBUG_PRINT(": ");
-    DEBUG_PRINT(reading.current);
-    DEBUG_PRINTLN("A");
+    DEBUG_LOG("OVERCURRENT detected on output %d: %umA", outputIndex, reading.milliamps);
     shouldDisable = true;
     hasFault = true;
   }
   
   if (reading.isUndercurrent) {
-    DEBUG_PRINT("UNDERCURRENT detected on output ");
-    DEBUG_PRINT(outputIndex);
-    DEBUG_PRINT(": ");
-    DEBUG_PRINT(reading.current);
-    DEBUG_PRINTLN("A");
+    DEBUG_LOG("UNDERCURRENT detected on output %d: %umA", outputIndex, reading.milliamps);
     shouldDisable = true;
     hasFault = true;
   }
   
-  // Set fault flag for LED indication
-  setOutputFault(outputIndex, hasFault);
+  // Set fault flag for LED indication.  A disabled output stays a fault until
+  // it is re-enabled, even though it reads no current.
+  setOutputFault(outputIndex, hasFault || !isOutputEnabled(outputIndex) || isOutputTripped(outputIndex));
   
   if (shouldDisable && isOutputEnabled(outputIndex)) {
+    logFaultEvent(outputIndex, reading.isOvercurrent ? FAULT_REASON_OVERCURRENT : FAULT_REASON_UNDERCURRENT,
+                  reading.milliamps);
     enableOutput(outputIndex, false);
-    DEBUG_PRINT("Output ");
-    DEBUG_PRINT(outputIndex);
-    DEBUG_PRINTLN(" disabled due to current fault - LED will indicate fault");
+    DEBUG_LOG("Output %d disabled due to current fault - LED will indicate fault", outputIndex);
   }
   
   // Optional: Log temperature for monitoring
-  if (reading.current > 1.0) { // Only log when significant current
+  if (reading.milliamps > 1000) { // Only log when significant current
     static unsigned long lastTempLog = 0;
-    if (millis() - lastTempLog > 1000) { // Log every second
-      DEBUG_PRINT("Output ");
-      DEBUG_PRINT(outputIndex);
-      DEBUG_PRINT(" - Current: ");
-      DEBUG_PRINT(reading.current);
-      DEBUG_PRINT("A, Est. Temp: ");
-      DEBUG_PRINT(reading.estimatedTemp);
-      DEBUG_PRINTLN("°C");
-      lastTempLog = millis();
+    if (halMillis() - lastTempLog > 1000) { // Log every second
+      DEBUG_LOG("Output %d - Current: %umA, Est. Temp: %d°C", outputIndex, reading.milliamps, reading.estimatedTempQ4 / TEMP_Q4_ONE);
+      lastTempLog = halMillis();
     }
   }
 }
 
-void measureInitialTemperatures() {
-  DEBUG_PRINTLN("Measuring initial glow plug temperatures...");
+// The measurement is split in two so the control loop keeps running (and
+// monitoring current) while the plugs settle.  The state machine finishes each
+// plug on its own, as soon as its filtered reading has settled or
+// MEASURE_SETTLE_MS after starting at the latest.
+void startInitialTemperatureMeasurement() {
+  DEBUG_LOG("Measuring initial glow plug temperatures...");
   
   // Turn on all outputs simultaneously at low power for faster measurement
-  for (int i = 0; i < NUM_OUTPUTS; i++) {
-    if (outputEnabled[i]) {
-      setOutput(i, 0.1); // Apply low duty cycle (10%) to all plugs
+  for (Channel i : Channel::all()) {
+    if (glowChannels[i].enabled) {
+      glowChannels[i].state = OUTPUT_MEASURING;
+      glowChannels[i].phaseStartMs = heatingMillis();
+      resetCurrentFilter(i);
+      setOutput(i, MEASURE_DUTY);
     }
   }
-  
-  delay(200); // Wait for current to stabilize - reduced from 500ms per plug
-  
-  // Read all temperatures
-  for (int i = 0; i < NUM_OUTPUTS; i++) {
-    if (!outputEnabled[i]) continue;
+}
+
+void finishInitialTemperatureMeasurement(Channel outputIndex) {
+  CurrentReading reading = readGlowPlugCurrent(outputIndex);
+  if (reading.isValid) {
+    glowChannels[outputIndex].initialTempQ4 = reading.estimatedTempQ4;
+    setOutputTimingBasedOnTemperature(outputIndex, (float)reading.estimatedTempQ4 / TEMP_Q4_ONE);
     
-    CurrentReading reading = readGlowPlugCurrent(i);
-    if (reading.isValid) {
-      initialTemperatures[i] = reading.estimatedTemp;
-      setOutputTimingBasedOnTemperature(i, reading.estimatedTemp);
-      
-      DEBUG_PRINT("Output ");
-      DEBUG_PRINT(i);
-      DEBUG_PRINT(" initial temp: ");
-      DEBUG_PRINT(reading.estimatedTemp);
-      DEBUG_PRINT("°C, total duration: ");
-      DEBUG_PRINT(outputTotalDuration[i] / 1000);
-      DEBUG_PRINTLN("s");
+    // A cold plug's resistance is the one to track for ageing
+    if (reading.estimatedTempQ4 < HOT_PLUG_TEMP_THRESHOLD * TEMP_Q4_ONE && reading.milliamps >= MIN_ESTIMATE_MA) {
+      logColdResistance(outputIndex, milliampsToResistance(reading.milliamps) >> RESISTANCE_SHIFT,
+                        reading.estimatedTempQ4);
     }
+    
+    DEBUG_LOG("Output %d initial temp: %d°C from %u samples, total duration: %us", outputIndex, reading.estimatedTempQ4 / TEMP_Q4_ONE, reading.sampleCount, glowChannels[outputIndex].totalDurationMs / 1000);
   }
   
-  // Turn all outputs off
-  for (int i = 0; i < NUM_OUTPUTS; i++) {
-    setOutput(i, 0.0);
-  }
-  
-  delay(50); // Brief pause before starting main sequence - reduced from 100ms
+  // Off until the plug is admitted to start heating
+  setOutput(outputIndex, DUTY_OFF);
 }
 
-void setOutputTimingBasedOnTemperature(int outputIndex, float temperature) {
-  if (outputIndex < 0 || outputIndex >= NUM_OUTPUTS) {
-    return;
-  }
+void setOutputTimingBasedOnTemperature(Channel outputIndex, float temperature) {
   
   if (temperature >= HOT_PLUG_TEMP_THRESHOLD) {
-    outputTotalDuration[outputIndex] = HOT_ENGINE_TOTAL_MS;
-    DEBUG_PRINT("Output ");
-    DEBUG_PRINT(outputIndex);
-    DEBUG_PRINT(" classified as HOT engine - ");
-    DEBUG_PRINT(HOT_ENGINE_TOTAL_MS / 1000);
-    DEBUG_PRINT(" second total (");
-    DEBUG_PRINT(FULL_POWER_DURATION_MS / 1000);
-    DEBUG_PRINT("s@100% + ");
-    DEBUG_PRINT((HOT_ENGINE_TOTAL_MS - FULL_POWER_DURATION_MS) / 1000);
-    DEBUG_PRINT("s@");
-    DEBUG_PRINT(REDUCED_DUTY_CYCLE * 100);
-    DEBUG_PRINTLN("%)");
+    glowChannels[outputIndex].totalDurationMs = HOT_ENGINE_TOTAL_MS;
+    DEBUG_LOG("Output %d classified as HOT engine - %d second total (%ds@100%% + %ds@%.2f%%)", outputIndex, HOT_ENGINE_TOTAL_MS / 1000, FULL_POWER_DURATION_MS / 1000, (HOT_ENGINE_TOTAL_MS - FULL_POWER_DURATION_MS) / 1000, REDUCED_DUTY_CYCLE * 100);
   } else {
-    outputTotalDuration[outputIndex] = COLD_ENGINE_TOTAL_MS;
-    DEBUG_PRINT("Output ");
-    DEBUG_PRINT(outputIndex);
-    DEBUG_PRINT(" classified as COLD engine - ");
-    DEBUG_PRINT(COLD_ENGINE_TOTAL_MS / 1000);
-    DEBUG_PRINT(" second total (");
-    DEBUG_PRINT(FULL_POWER_DURATION_MS / 1000);
-    DEBUG_PRINT("s@100% + ");
-    DEBUG_PRINT((COLD_ENGINE_TOTAL_MS - FULL_POWER_DURATION_MS) / 1000);
-    DEBUG_PRINT("s@");
-    DEBUG_PRINT(REDUCED_DUTY_CYCLE * 100);
-    DEBUG_PRINTLN("%)");
+    glowChannels[outputIndex].totalDurationMs = COLD_ENGINE_TOTAL_MS;
+    DEBUG_LOG("Output %d classified as COLD engine - %d second total (%ds@100%% + %ds@%.2f%%)", outputIndex, COLD_ENGINE_TOTAL_MS / 1000, FULL_POWER_DURATION_MS / 1000, (COLD_ENGINE_TOTAL_MS - FULL_POWER_DURATION_MS) / 1000, REDUCED_DUTY_CYCLE * 100);
   }
 }
 
+// Supply current across all plugs: each plug's on-time current scaled by its
+// duty.  A plug that was just switched on and has no reading yet counts at the
+// cold plug inrush current.
+uint32_t getTotalLoadMilliamps() {
+  uint32_t total = 0;
+  for (Channel i : Channel::all()) {
+    uint8_t duty = glowChannels[i].duty;
+    if (!isOutputEnabled(i) || duty == DUTY_OFF) {
+      continue;
+    }
+    CurrentReading reading = readGlowPlugCurrent(i);
+    uint16_t milliamps = reading.sampleCount < FILTER_OVERSAMPLE ? PLUG_INRUSH_MA : reading.milliamps;
+    total += (uint32_t)milliamps * duty / DUTY_FULL;
+  }
+  return total;
+}
+
+static SamplingPriority drivenSamplingPriority(Channel outputIndex) {
+  const GlowChannel& channel = glowChannels[outputIndex];
+  if (channel.state == OUTPUT_MEASURING) {
+    return SAMPLING_HIGH;
+  }
+  if (channel.state == OUTPUT_FULL_POWER && (uint16_t)(heatingMillis() - channel.phaseStartMs) < SAMPLING_INRUSH_MS) {
+    return SAMPLING_HIGH;
+  }
+  const uint16_t nearTripCodeQ4 = (uint32_t)OVERCURRENT_TRIP_CODE * SAMPLING_NEAR_TRIP_PERCENT * 16 / 100;
+  if (getFilteredCurrent(outputIndex).codeQ4 >= nearTripCodeQ4) {
+    return SAMPLING_HIGH;
+  }
+  return SAMPLING_NORMAL;
+}
+
 void monitorAllCurrents() {
+  // The ADC interrupt has already cut any output over the limit; record it
+  uint8_t tripped = getTrippedOutputs();
+  for (Channel i : Channel::all()) {
+    if ((tripped & (1 << i)) && isOutputEnabled(i)) {
+      DEBUG_LOG("OVERCURRENT fast-trip on output %d", i);
+      setOutputFault(i, true);
+      logFaultEvent(i, FAULT_REASON_FAST_TRIP, readGlowPlugCurrent(i).milliamps);
+      enableOutput(i, false);
+    }
+  }
+  
+  // Share the ADC out by what each driven plug is doing; setOutput() has
+  // already taken the undriven ones out of the schedule
+  for (Channel i : Channel::all()) {
+    if (getSamplingPriority(i) != SAMPLING_IDLE) {
+      setSamplingPriority(i, drivenSamplingPriority(i));
+    }
+  }
+  
   // Only monitor when outputs are actually running
-  if (currentState == STATE_FULL_POWER) {
-    for (int i = 0; i < NUM_OUTPUTS; i++) {
+  if (currentState == STATE_FULL_POWER || currentState == STATE_MEASURING) {
+    for (Channel i : Channel::all()) {
       CurrentReading reading = readGlowPlugCurrent(i);
       if (!DISABLE_CURRENT_LIMITS) {
         checkCurrentLimitsAndDisable(i, reading);
@@ -2,10 +2,26 @@
 #define CURRENT_MONITOR_H
 
 #include "config.h"
+#include "fixed_point.h"
+
+// Initial temperature measurement pulse
+constexpr float MEASURE_DUTY_CYCLE = 0.1;  // 10% on all plugs at once
+constexpr uint8_t MEASURE_DUTY = dutyFromFraction(MEASURE_DUTY_CYCLE);
+const int MEASURE_SETTLE_MS = 200;         // longest wait for the current to stabilize
+
+const int CURRENT_MONITOR_PERIOD_MS = 2;
+
+// Adaptive sampling (adc_sampler.h): a driven plug gets the idle plugs' share
+// of the ADC while it measures, for SAMPLING_INRUSH_MS after it starts full
+// power, and while its current is within a quarter of the fast-trip limit
+const uint16_t SAMPLING_INRUSH_MS = 300;
+const uint8_t SAMPLING_NEAR_TRIP_PERCENT = 75;
 
 struct CurrentReading {
-  float current;
-  float estimatedTemp;
+  uint16_t milliamps;
+  tempq4_t estimatedTempQ4;
+  uint16_t sampleCount;  // ADC samples behind the filtered value
+  bool isSettled;        // filter output has stopped moving
   bool isValid;
   bool isOvercurrent;
   bool isUndercurrent;
@@ -13,13 +29,16 @@ struct CurrentReading {
 
 // Function declarations
 void initializeCurrentMonitoring();
-float readVoltageFromADC(int inputPin);
+float convertAdcToVoltage(int adcValue);
+float readVoltageFromADC(Channel inputIndex);
 float convertVoltageToCurrent(float senseVoltage);
 float estimateGlowPlugTemperature(float current);
-CurrentReading readGlowPlugCurrent(int outputIndex);
-void checkCurrentLimitsAndDisable(int outputIndex, CurrentReading reading);
+CurrentReading readGlowPlugCurrent(Channel outputIndex);
+void checkCurrentLimitsAndDisable(Channel outputIndex, CurrentReading reading);
 void monitorAllCurrents();
-void measureInitialTemperatures();
-void setOutputTimingBasedOnTemperature(int outputIndex, float temperature);
+uint32_t getTotalLoadMilliamps();
+void startInitialTemperatureMeasurement();
+void finishInitialTemperatureMeasurement(Channel outputIndex);
+void setOutputTimingBasedOnTemperature(Channel outputIndex, float temperature);
 
 #endif
\ No newline at end of file
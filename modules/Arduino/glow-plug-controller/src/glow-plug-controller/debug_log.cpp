@@ -0,0 +1,44 @@
+#include "debug_log.h"
+#include "telemetry.h"
+
+static unsigned int droppedLogs = 0;
+
+// Queues one frame if it fits in the TX buffer
+static bool sendDebugLogFrame(const DebugLogPayload& payload) {
+  uint8_t frame[TELEMETRY_HEADER_SIZE + DEBUG_LOG_MAX_PAYLOAD + TELEMETRY_CHECKSUM_SIZE];
+  uint8_t length = payload.size();
+  int frameSize = TELEMETRY_HEADER_SIZE + length + TELEMETRY_CHECKSUM_SIZE;
+  if (Serial.availableForWrite() < frameSize) {
+    return false;
+  }
+
+  frame[0] = TELEMETRY_SYNC1;
+  frame[1] = DEBUG_LOG_SYNC2;
+  frame[2] = length;
+  memcpy(frame + TELEMETRY_HEADER_SIZE, payload.data(), length);
+
+  // checksum covers the length byte and payload
+  uint16_t checksum = telemetryChecksum(frame + 2, length + 1);
+  frame[TELEMETRY_HEADER_SIZE + length] = checksum & 0xFF;
+  frame[TELEMETRY_HEADER_SIZE + length + 1] = checksum >> 8;
+
+  Serial.write(frame, frameSize);
+  return true;
+}
+
+void writeDebugLog(const DebugLogPayload& payload) {
+  // The count of messages lost goes out first, so it lands where the gap is
+  if (droppedLogs > 0) {
+    DEBUG_LOG_ENTRY("(%u log messages dropped)", droppedLogs)
+    DebugLogPayload notice(debugLogToken("(%u log messages dropped)"));
+    notice.add(droppedLogs);
+    if (!sendDebugLogFrame(notice)) {
+      droppedLogs++;
+      return;
+    }
+    droppedLogs = 0;
+  }
+  if (!sendDebugLogFrame(payload)) {
+    droppedLogs++;
+  }
+}
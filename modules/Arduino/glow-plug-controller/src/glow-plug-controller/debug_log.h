@@ -0,0 +1,162 @@
+#ifndef DEBUG_LOG_H
+#define DEBUG_LOG_H
+
+#include "hal.h"
+#include <string.h>
+
+// Tokenized debug log
+// With DEBUG the controller logs to the serial port in binary.  Each log site's
+// format string is hashed at compile time to a 16 bit token, and a log frame
+// carries only the token and the arguments, so the strings are never in the
+// sketch at all - neither flash nor SRAM - and a message is a few bytes on
+// the wire instead of a line of text.
+//
+//   DEBUG_LOG("Output %d holding temperature after %u ms", i, outputElapsed);
+//
+// The host build (DEBUG is set in host/Makefile's debug build) keeps every
+// site's token, format, argument types and file:line in a `debug_log` section.
+// host/log-dictionary lists them as the dictionary, checking each format
+// against its arguments and that no two formats share a token, and
+// host/log-expand turns a capture back into text with it.  Sites the host
+// build doesn't compile (#ifdef ARDUINO) can't be expanded, so there are none.
+//
+// Formats take %d, %i, %u, %x, %X and %c for integers (with or without l or h)
+// and %f, %e and %g, with any flags, width and precision, for floats; %% is a
+// percent sign.  Every integer is sent as a zigzag varint of its value as a
+// 32 bit signed number, whatever its type, so %u of an unsigned long comes out
+// right.  Floats (and doubles, which are floats on the AVR) are sent as 4 byte
+// IEEE floats.
+//
+// Frame layout, multi-byte fields little endian:
+//   0      0xA5 0x5C sync (first byte is TELEMETRY_SYNC1)
+//   2      payload length
+//   3      token (16 bits)
+//   5      arguments, in order
+//   3+len  Fletcher-16 over the length byte and payload, as in telemetry.h
+//
+// A frame is only queued if it fits in the serial TX buffer, as telemetry
+// frames are, so logging never stalls the loop.  Messages that don't fit are
+// dropped and counted, and the count goes out as a message of its own ahead of
+// the next one that fits.
+
+const uint8_t DEBUG_LOG_SYNC2 = 0x5C;
+const int DEBUG_LOG_MAX_ARGS = 6;
+const int DEBUG_LOG_VARINT_SIZE = 5;   // most bytes of a 32 bit varint
+const int DEBUG_LOG_MAX_PAYLOAD = 2 + DEBUG_LOG_MAX_ARGS * DEBUG_LOG_VARINT_SIZE;
+
+// FNV-1a, folded to 16 bits
+constexpr uint32_t debugLogHash(const char* text, uint32_t hash = 2166136261UL) {
+  return *text ? debugLogHash(text + 1, (hash ^ (uint8_t)*text) * 16777619UL) : hash;
+}
+
+constexpr uint16_t debugLogToken(const char* format) {
+  return (uint16_t)(debugLogHash(format) ^ (debugLogHash(format) >> 16));
+}
+
+// Payload of one log frame
+class DebugLogPayload {
+public:
+  explicit DebugLogPayload(uint16_t token) : length(0) {
+    put(token & 0xFF);
+    put(token >> 8);
+  }
+
+  void add(long value) {
+    int32_t value32 = (int32_t)value;
+    uint32_t zigzag = ((uint32_t)value32 << 1) ^ (uint32_t)(value32 >> 31);
+    while (zigzag >= 0x80) {
+      put((zigzag & 0x7F) | 0x80);
+      zigzag >>= 7;
+    }
+    put(zigzag);
+  }
+  void add(unsigned long value) { add((long)value); }
+  void add(int value) { add((long)value); }
+  void add(unsigned int value) { add((long)value); }
+  void add(char value) { add((long)value); }
+  void add(signed char value) { add((long)value); }
+  void add(unsigned char value) { add((long)value); }
+  void add(bool value) { add((long)value); }
+  void add(float value) {
+    uint8_t bytes[4];
+    memcpy(bytes, &value, 4);
+    for (int i = 0; i < 4; i++) {
+      put(bytes[i]);
+    }
+  }
+  void add(double value) { add((float)value); }
+  void add(const char* text) = delete;   // the strings stay on the host
+
+  const uint8_t* data() const { return bytes; }
+  uint8_t size() const { return length; }
+
+private:
+  void put(uint8_t byte) { bytes[length++] = byte; }
+
+  uint8_t bytes[DEBUG_LOG_MAX_PAYLOAD];
+  uint8_t length;
+};
+
+inline void addDebugLogArgs(DebugLogPayload&) {}
+
+template <typename T, typename... Rest>
+inline void addDebugLogArgs(DebugLogPayload& payload, T value, Rest... rest) {
+  payload.add(value);
+  addDebugLogArgs(payload, rest...);
+}
+
+void writeDebugLog(const DebugLogPayload& payload);
+
+template <typename... Args>
+void debugLog(uint16_t token, Args... args) {
+  static_assert(sizeof...(Args) <= DEBUG_LOG_MAX_ARGS, "too many arguments for one log frame");
+  DebugLogPayload payload(token);
+  addDebugLogArgs(payload, args...);
+  writeDebugLog(payload);
+}
+
+// Dictionary entries, host build only.  The argument types are worked out from
+// the expressions without evaluating them: 'i' for an integer, 'f' for a float.
+#ifndef ARDUINO
+struct DebugLogEntry {
+  uint16_t token;
+  const char* format;
+  const char* signature;
+  const char* file;
+  int line;
+};
+
+template <typename T> struct DebugLogArgType { static constexpr char code = 'i'; };
+template <> struct DebugLogArgType<float> { static constexpr char code = 'f'; };
+template <> struct DebugLogArgType<double> { static constexpr char code = 'f'; };
+
+template <typename... Args>
+struct DebugLogSignature {
+  static constexpr char value[sizeof...(Args) + 1] = {DebugLogArgType<Args>::code..., '\0'};
+};
+template <typename... Args> constexpr char DebugLogSignature<Args...>::value[];
+
+template <typename... Args> DebugLogSignature<Args...> debugLogSignatureOf(Args...);
+
+// The explicit alignment stops the compiler padding the entries apart, so the
+// section is an array of them
+#define DEBUG_LOG_ENTRY(format, ...) \
+  static const DebugLogEntry debugLogEntry \
+    __attribute__((section("debug_log"), used, aligned(alignof(DebugLogEntry)))) = { \
+    debugLogToken(format), format, decltype(debugLogSignatureOf(__VA_ARGS__))::value, __FILE__, __LINE__ \
+  };
+#else
+#define DEBUG_LOG_ENTRY(format, ...)
+#endif
+
+#ifdef DEBUG
+  #define DEBUG_LOG(format, ...) do { \
+      DEBUG_LOG_ENTRY(format, ##__VA_ARGS__) \
+      constexpr uint16_t debugLogSiteToken = debugLogToken(format); \
+      debugLog(debugLogSiteToken, ##__VA_ARGS__); \
+    } while (0)
+#else
+  #define DEBUG_LOG(format, ...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+#include "event_log.h"
+
+// Records waiting for the EEPROM, already encoded
+static uint8_t queue[EVENT_LOG_QUEUE_SIZE][EVENT_LOG_RECORD_SIZE];
+static uint8_t queueHead = 0;      // record being written
+static uint8_t queueLength = 0;
+static uint8_t bytesWritten = 0;   // of the record at queueHead
+static uint16_t droppedRecords = 0;
+
+static uint8_t nextSlot = 0;
+static uint16_t nextSequence = 0;
+
+// Warm start cache
+static uint16_t lastKnownResistance[NUM_OUTPUTS];
+static uint8_t knownDeadOutputs = 0;
+static uint8_t skippedStarts = 0;
+
+static_assert(EVENT_LOG_SLOTS <= 256, "slot index is 8 bits");
+
+uint8_t eventLogCrc(const uint8_t* data, int length) {
+  // CRC-8, polynomial 0x07.  A record is only 7 bytes, so bitwise is fine.
+  uint8_t crc = 0;
+  for (int i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+bool decodeEventLogRecord(const uint8_t* bytes, EventLogRecord& record) {
+  // Erased EEPROM reads 0xFF, which is never a valid type
+  if (bytes[2] < EVENT_LOG_FAULT || bytes[2] > EVENT_LOG_RUN_SUMMARY) {
+    return false;
+  }
+  if (eventLogCrc(bytes, EVENT_LOG_RECORD_SIZE - 1) != bytes[EVENT_LOG_RECORD_SIZE - 1]) {
+    return false;
+  }
+  record.sequence = bytes[0] | (bytes[1] << 8);
+  record.type = bytes[2];
+  record.channel = bytes[3];
+  record.value = bytes[4] | (bytes[5] << 8);
+  record.detail = bytes[6];
+  return true;
+}
+
+static bool readSlot(int slot, EventLogRecord& record) {
+  uint8_t bytes[EVENT_LOG_RECORD_SIZE];
+  int address = EVENT_LOG_BASE + slot * EVENT_LOG_RECORD_SIZE;
+  for (int i = 0; i < EVENT_LOG_RECORD_SIZE; i++) {
+    bytes[i] = halEepromRead(address + i);
+  }
+  return decodeEventLogRecord(bytes, record);
+}
+
+void initializeEventLog() {
+  queueHead = 0;
+  queueLength = 0;
+  bytesWritten = 0;
+  droppedRecords = 0;
+  knownDeadOutputs = 0;
+  skippedStarts = 0;
+  for (Channel i : Channel::all()) {
+    lastKnownResistance[i] = 0;
+  }
+
+  // The newest record has the highest sequence number (modulo wrap)
+  int newestSlot = -1;
+  EventLogRecord record;
+  uint16_t newestSequence = 0;
+  for (int slot = 0; slot < EVENT_LOG_SLOTS; slot++) {
+    if (readSlot(slot, record) &&
+        (newestSlot < 0 || (int16_t)(record.sequence - newestSequence) > 0)) {
+      newestSlot = slot;
+      newestSequence = record.sequence;
+    }
+  }
+  if (newestSlot < 0) {
+    nextSlot = 0;
+    nextSequence = 0;
+    DEBUG_LOG("Event log empty");
+    return;
+  }
+  nextSlot = (newestSlot + 1) % EVENT_LOG_SLOTS;
+  nextSequence = newestSequence + 1;
+
+  // Walk back from the newest record for the warm start cache.  Plugs that
+  // faulted since the last run summary count as dead too, in case the power
+  // went off before the summary was written.
+  uint8_t resistancesFound = 0;
+  bool summaryFound = false;
+  int slot = newestSlot;
+  uint16_t expectedSequence = newestSequence;
+  for (int n = 0; n < EVENT_LOG_SLOTS; n++) {
+    if (!readSlot(slot, record) || record.sequence != expectedSequence) {
+      break;
+    }
+    if (record.channel < NUM_OUTPUTS || record.type == EVENT_LOG_RUN_SUMMARY) {
+      switch (record.type) {
+        case EVENT_LOG_FAULT:
+          if (!summaryFound) {
+            knownDeadOutputs |= 1 << record.channel;
+          }
+          break;
+        case EVENT_LOG_COLD_RESISTANCE:
+          if (!(resistancesFound & (1 << record.channel))) {
+            resistancesFound |= 1 << record.channel;
+            lastKnownResistance[record.channel] = record.value;
+          }
+          break;
+        case EVENT_LOG_RUN_SUMMARY:
+          if (!summaryFound) {
+            summaryFound = true;
+            knownDeadOutputs |= record.channel & ((1 << NUM_OUTPUTS) - 1);
+            skippedStarts = record.detail;
+          }
+          break;
+      }
+    }
+    slot = (slot + EVENT_LOG_SLOTS - 1) % EVENT_LOG_SLOTS;
+    expectedSequence--;
+  }
+
+  // Give dead plugs another chance now and then
+  if (knownDeadOutputs) {
+    if (skippedStarts + 1 >= KNOWN_DEAD_REPROBE_STARTS) {
+      knownDeadOutputs = 0;
+      skippedStarts = 0;
+    } else {
+      skippedStarts++;
+    }
+  } else {
+    skippedStarts = 0;
+  }
+
+  DEBUG_LOG("Event log: next sequence %u, known dead outputs 0x%x", nextSequence, knownDeadOutputs);
+}
+
+static void queueRecord(EventLogType type, uint8_t channel, uint16_t value, uint8_t detail) {
+  if (queueLength >= EVENT_LOG_QUEUE_SIZE) {
+    droppedRecords++;
+    return;
+  }
+  uint8_t* bytes = queue[(queueHead + queueLength) % EVENT_LOG_QUEUE_SIZE];
+  bytes[0] = nextSequence & 0xFF;
+  bytes[1] = nextSequence >> 8;
+  bytes[2] = type;
+  bytes[3] = channel;
+  bytes[4] = value & 0xFF;
+  bytes[5] = value >> 8;
+  bytes[6] = detail;
+  bytes[7] = eventLogCrc(bytes, EVENT_LOG_RECORD_SIZE - 1);
+  nextSequence++;
+  queueLength++;
+}
+
+void updateEventLog() {
+  if (queueLength == 0 || !halEepromReady()) {
+    return;
+  }
+
+  // Bytes that already hold the right value are skipped, which saves wear and
+  // time.  The CRC goes last, so a record cut short never checks out.
+  const uint8_t* bytes = queue[queueHead];
+  int address = EVENT_LOG_BASE + nextSlot * EVENT_LOG_RECORD_SIZE;
+  while (bytesWritten < EVENT_LOG_RECORD_SIZE) {
+    uint8_t value = bytes[bytesWritten];
+    int byteAddress = address + bytesWritten;
+    bytesWritten++;
+    if (halEepromRead(byteAddress) != value) {
+      halEepromWrite(byteAddress, value);
+      break;
+    }
+  }
+
+  if (bytesWritten == EVENT_LOG_RECORD_SIZE) {
+    bytesWritten = 0;
+    nextSlot = (nextSlot + 1) % EVENT_LOG_SLOTS;
+    queueHead = (queueHead + 1) % EVENT_LOG_QUEUE_SIZE;
+    queueLength--;
+  }
+}
+
+void logFaultEvent(Channel outputIndex, EventLogFaultReason reason, uint16_t milliamps) {
+  queueRecord(EVENT_LOG_FAULT, outputIndex, milliamps, reason);
+}
+
+void logColdResistance(Channel outputIndex, uint16_t milliohms, tempq4_t tempQ4) {
+  // Only worth a record (and the wear) if it has moved noticeably
+  uint16_t last = lastKnownResistance[outputIndex];
+  uint16_t change = milliohms > last ? milliohms - last : last - milliohms;
+  if (last != 0 && change < (last >> RESISTANCE_LOG_CHANGE_SHIFT)) {
+    return;
+  }
+  lastKnownResistance[outputIndex] = milliohms;
+
+  int temperature = tempQ4 / TEMP_Q4_ONE;
+  queueRecord(EVENT_LOG_COLD_RESISTANCE, outputIndex, milliohms, constrain(temperature, 0, 255));
+}
+
+void logRunSummary() {
+  uint8_t faulted = 0;
+  for (Channel i : Channel::all()) {
+    if (glowChannels[i].faulted) faulted |= 1 << i;
+  }
+  queueRecord(EVENT_LOG_RUN_SUMMARY, faulted, heatingMillis(), (faulted & knownDeadOutputs) ? skippedStarts : 0);
+}
+
+uint8_t getKnownDeadOutputs() {
+  return knownDeadOutputs;
+}
+
+uint16_t getLastKnownResistance(Channel outputIndex) {
+  return lastKnownResistance[outputIndex];
+}
+
+int getPendingEventLogRecords() {
+  return queueLength;
+}
+
+unsigned int getDroppedEventLogRecords() {
+  return droppedRecords;
+}
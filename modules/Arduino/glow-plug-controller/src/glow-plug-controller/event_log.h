@@ -0,0 +1,82 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include "config.h"
+
+// Persistent event log
+// Fault events, plug cold resistances and a summary of every heating cycle are
+// kept in EEPROM as fixed size records.  The records go round the whole EEPROM
+// as a ring, so wear is spread over every slot instead of one cell being
+// rewritten each start.  Each record carries a sequence number, used to find
+// the newest one at boot, and a CRC, so a record torn by the power going off
+// mid-write is just skipped.
+//
+// Records are queued in RAM and written a byte at a time from the event log
+// task, and only when the EEPROM has finished the previous byte.  The control
+// loop never waits on the ~3.4ms EEPROM write.  If the queue is full, the
+// record is counted and dropped.
+//
+// At boot the log is scanned once for the warm start cache: the last known
+// cold resistance of each plug, and the plugs that failed on the last run.
+// Those are left off without being probed again, until
+// KNOWN_DEAD_REPROBE_STARTS starts have gone by (so a replaced plug is picked
+// up again).
+//
+// Record layout, multi-byte fields little endian:
+//   0      sequence number (16 bits)
+//   2      record type (EventLogType)
+//   3      output, or for a run summary the faulted outputs, bit n = output n
+//   4      value (16 bits): fault - filtered current, mA
+//                           cold resistance - milliohms
+//                           run summary - heating time, ms (saturates)
+//   6      detail: fault - EventLogFaultReason
+//                  cold resistance - measured temperature, C (clamped 0-255)
+//                  run summary - starts the known-dead plugs have been skipped
+//   7      CRC-8 over bytes 0-6
+
+enum EventLogType {
+  EVENT_LOG_FAULT = 1,
+  EVENT_LOG_COLD_RESISTANCE = 2,
+  EVENT_LOG_RUN_SUMMARY = 3
+};
+
+enum EventLogFaultReason {
+  FAULT_REASON_OVERCURRENT = 1,
+  FAULT_REASON_UNDERCURRENT = 2,
+  FAULT_REASON_FAST_TRIP = 3
+};
+
+struct EventLogRecord {
+  uint16_t sequence;
+  uint8_t type;
+  uint8_t channel;
+  uint16_t value;
+  uint8_t detail;
+};
+
+const int EVENT_LOG_RECORD_SIZE = 8;
+const int EVENT_LOG_BASE = 0;              // ring runs from here to the end of the EEPROM
+const int EVENT_LOG_SLOTS = (HAL_EEPROM_SIZE - EVENT_LOG_BASE) / EVENT_LOG_RECORD_SIZE;
+const int EVENT_LOG_QUEUE_SIZE = 6;        // records waiting to be written
+const int EVENT_LOG_PERIOD_MS = 4;         // a byte takes ~3.4ms to write
+
+const uint8_t KNOWN_DEAD_REPROBE_STARTS = 8;
+const int RESISTANCE_LOG_CHANGE_SHIFT = 4;  // only log a resistance that moved by 1/16 or more
+
+static_assert(NUM_OUTPUTS <= 8, "run summary fault mask is 8 bits");
+static_assert(EVENT_LOG_SLOTS >= 2 * EVENT_LOG_QUEUE_SIZE, "EEPROM too small for the event log");
+
+// Function declarations
+void initializeEventLog();
+void updateEventLog();
+void logFaultEvent(Channel outputIndex, EventLogFaultReason reason, uint16_t milliamps);
+void logColdResistance(Channel outputIndex, uint16_t milliohms, tempq4_t tempQ4);
+void logRunSummary();
+uint8_t getKnownDeadOutputs();
+uint16_t getLastKnownResistance(Channel outputIndex);
+int getPendingEventLogRecords();
+unsigned int getDroppedEventLogRecords();
+uint8_t eventLogCrc(const uint8_t* data, int length);
+bool decodeEventLogRecord(const uint8_t* bytes, EventLogRecord& record);
+
+#endif
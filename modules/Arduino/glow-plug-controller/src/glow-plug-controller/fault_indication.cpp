@@ -1,39 +1,49 @@
 #include "fault_indication.h"
 
-// Local state variables for LED blinking
-static unsigned long lastBlinkTime = 0;
-static int currentBlink = 0;
-static bool ledState = false;
-static bool inSequencePause = false;
-static unsigned long sequencePauseStart = 0;
-static int faultOutputToIndicate = -1;
+static const uint64_t FAULT_PATTERNS[] PROGMEM = {
+  faultPattern(1), faultPattern(2), faultPattern(3), faultPattern(4),
+  faultPattern(5), faultPattern(6), faultPattern(7), faultPattern(8)
+};
+
+// Written by the loop, read by the sequencer
+static volatile uint8_t faultMask = 0;
+static volatile bool activeIndication = false;
+
+// Sequencer state, owned by the timer interrupt while it is running
+static int8_t showing = -1;      // plug whose code is playing, -1 for none
+static uint8_t position = 0;     // step within its code
+static uint8_t ticks = 0;
+static bool lit = false;
 
 void initializeFaultIndication() {
-  DEBUG_PRINTLN("Fault indication system initialized");
-  lastBlinkTime = 0;
-  currentBlink = 0;
-  ledState = false;
-  inSequencePause = false;
-  faultOutputToIndicate = -1;
+  DEBUG_LOG("Fault indication system initialized");
+  faultMask = 0;
+  activeIndication = false;
+  showing = -1;
+  position = 0;
+  ticks = 0;
+  lit = false;
+  halDigitalWrite(LED_BUILTIN, LOW);
+  halLedTimerStart();
 }
 
-void setOutputFault(int outputIndex, bool faulted) {
-  if (outputIndex < 0 || outputIndex >= NUM_OUTPUTS) {
-    return;
-  }
+void setOutputFault(Channel outputIndex, bool faulted) {
   
-  bool wasFaulted = outputFaulted[outputIndex];
-  outputFaulted[outputIndex] = faulted;
+  bool wasFaulted = glowChannels[outputIndex].faulted;
+  glowChannels[outputIndex].faulted = faulted;
+  if (faulted) {
+    faultMask |= 1 << outputIndex;
+  } else {
+    faultMask &= ~(1 << outputIndex);
+  }
   
   if (faulted && !wasFaulted) {
-    DEBUG_PRINT("FAULT detected on output ");
-    DEBUG_PRINTLN(outputIndex);
+    DEBUG_LOG("FAULT detected on output %d", outputIndex);
     
     // Update first faulted output if this is the first or lower index
     if (firstFaultedOutput == -1 || outputIndex < firstFaultedOutput) {
       firstFaultedOutput = outputIndex;
-      DEBUG_PRINT("First faulted output updated to: ");
-      DEBUG_PRINTLN(firstFaultedOutput);
+      DEBUG_LOG("First faulted output updated to: %d", firstFaultedOutput);
     }
   }
   
@@ -41,18 +51,17 @@ void setOutputFault(int outputIndex, bool faulted) {
   // find the next lowest faulted output
   if (!faulted && wasFaulted && outputIndex == firstFaultedOutput) {
     firstFaultedOutput = -1;
-    for (int i = 0; i < NUM_OUTPUTS; i++) {
-      if (outputFaulted[i]) {
+    for (Channel i : Channel::all()) {
+      if (glowChannels[i].faulted) {
         firstFaultedOutput = i;
         break;
       }
     }
     
     if (firstFaultedOutput == -1) {
-      DEBUG_PRINTLN("All faults cleared");
+      DEBUG_LOG("All faults cleared");
     } else {
-      DEBUG_PRINT("First faulted output updated to: ");
-      DEBUG_PRINTLN(firstFaultedOutput);
+      DEBUG_LOG("First faulted output updated to: %d", firstFaultedOutput);
     }
   }
 }
@@ -65,69 +74,79 @@ int getFirstFaultedOutput() {
   return firstFaultedOutput;
 }
 
-void updateFaultIndication() {
-  unsigned long currentTime = millis();
-  
-  // If no faults, ensure LED is off and reset state
-  if (!hasAnyFaults()) {
-    if (currentState != STATE_FULL_POWER) { // Don't interfere with normal operation LED
-      digitalWrite(LED_BUILTIN, LOW);
+// The next faulted plug after this one, wrapping round to it last
+static int8_t nextFaultedOutput(int8_t after) {
+  uint8_t mask = faultMask;
+  for (int8_t n = 1; n <= NUM_OUTPUTS; n++) {
+    int8_t i = (after + n) % NUM_OUTPUTS;
+    if (mask & (1 << i)) {
+      return i;
     }
-    currentBlink = 0;
-    inSequencePause = false;
-    faultOutputToIndicate = -1;
-    return;
   }
-  
-  // Don't interfere with LED during normal glow plug operation
-  if (currentState == STATE_FULL_POWER) {
-    return;
+  return -1;
+}
+
+static bool patternBit(int8_t plug, uint8_t step) {
+  const uint8_t* pattern = (const uint8_t*)&FAULT_PATTERNS[plug];   // little endian
+  return (pgm_read_byte(pattern + step / 8) >> (step % 8)) & 1;
+}
+
+static void showStep() {
+  bool on = (showing >= 0 && patternBit(showing, position)) != activeIndication;
+  if (on != lit) {
+    lit = on;
+    halDigitalWrite(LED_BUILTIN, on ? HIGH : LOW);
   }
-  
-  // Get the fault to indicate (1-based for user display)
-  int faultToShow = firstFaultedOutput + 1; // Convert to 1-based
-  
-  // Check if we need to start a new sequence
-  if (faultOutputToIndicate != firstFaultedOutput) {
-    faultOutputToIndicate = firstFaultedOutput;
-    currentBlink = 0;
-    inSequencePause = false;
-    lastBlinkTime = currentTime;
-    ledState = false;
-    digitalWrite(LED_BUILTIN, LOW);
+}
+
+// A code plays to the end once started, even if its fault clears part way
+static void step() {
+  if (showing < 0 || ++position >= faultPatternSteps(showing + 1)) {
+    showing = nextFaultedOutput(showing);
+    position = 0;
   }
-  
-  // Handle sequence pause between repetitions
-  if (inSequencePause) {
-    if (currentTime - sequencePauseStart >= SEQUENCE_PAUSE_MS) {
-      inSequencePause = false;
-      currentBlink = 0;
-      lastBlinkTime = currentTime;
-      ledState = false;
-      digitalWrite(LED_BUILTIN, LOW);
-    }
-    return;
+  showStep();
+}
+
+void halLedTimerTick() {
+  if (++ticks >= FAULT_PATTERN_STEP_TICKS) {
+    ticks = 0;
+    step();
   }
-  
-  // Check if it's time to change LED state
-  unsigned long timeSinceLastChange = currentTime - lastBlinkTime;
-  
-  if (!ledState && timeSinceLastChange >= BLINK_OFF_TIME_MS) {
-    // Time to turn LED on for next blink
-    if (currentBlink < faultToShow) {
-      digitalWrite(LED_BUILTIN, HIGH);
-      ledState = true;
-      lastBlinkTime = currentTime;
-    } else {
-      // Finished all blinks, start sequence pause
-      inSequencePause = true;
-      sequencePauseStart = currentTime;
-    }
-  } else if (ledState && timeSinceLastChange >= BLINK_ON_TIME_MS) {
-    // Time to turn LED off
-    digitalWrite(LED_BUILTIN, LOW);
-    ledState = false;
-    lastBlinkTime = currentTime;
-    currentBlink++;
+}
+
+#ifdef ARDUINO
+ISR(TIMER2_OVF_vect) {
+  halLedTimerTick();
+}
+#endif
+
+void setActiveIndication(bool active) {
+  uint8_t sreg = halEnterCritical();
+  activeIndication = active;
+  showStep();
+  halExitCritical(sreg);
+}
+
+void stopFaultIndicationTimer() {
+  halLedTimerStop();
+}
+
+uint8_t getFaultIndicationHoldSteps() {
+  if (showing < 0) {
+    return 1;
+  }
+  uint8_t steps = faultPatternSteps(showing + 1);
+  bool on = patternBit(showing, position);
+  uint8_t hold = 1;
+  while (position + hold < steps && patternBit(showing, position + hold) == on) {
+    hold++;
   }
-}
\ No newline at end of file
+  return hold;
+}
+
+void advanceFaultIndication(uint8_t steps) {
+  while (steps--) {
+    step();
+  }
+}
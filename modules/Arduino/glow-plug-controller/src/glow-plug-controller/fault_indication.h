@@ -3,17 +3,46 @@
 
 #include "config.h"
 
-// LED fault indication constants
-const int BLINK_ON_TIME_MS = 300;       // LED on duration for each blink
-const int BLINK_OFF_TIME_MS = 200;      // LED off duration between blinks
-const int SEQUENCE_PAUSE_MS = 1500;     // Pause between blink sequences
-const int FAULT_CHECK_INTERVAL_MS = 100; // How often to update fault indication
+// LED fault indication
+// A pattern sequencer on the LED timer interrupt (hal.h) plays the blink code
+// of every faulted plug in turn: n blinks for plug n, a pause, then the next
+// faulted plug's code.  The codes are bit patterns built by the compiler, one
+// bit per FAULT_PATTERN_STEP_MS step, and read from flash a bit a step, so
+// the main loop does nothing for them.
+//
+// While any plug is heating the LED is on (the "active" indication) and the
+// codes play over it inverted, as dark blinks.  In low power the timer stops
+// with the CPU; low_power.cpp sleeps until the LED next changes and moves the
+// sequencer on by the steps it slept.
+
+const int FAULT_PATTERN_STEP_MS = 128;   // one 128ms watchdog sleep in low power
+const int BLINK_ON_STEPS = 2;            // LED on for each blink
+const int BLINK_OFF_STEPS = 2;           // LED off between blinks
+const int SEQUENCE_PAUSE_STEPS = 12;     // after the last blink's off time
+const unsigned int FAULT_PATTERN_STEP_TICKS =
+  (FAULT_PATTERN_STEP_MS * 1000UL + HAL_LED_TIMER_TICK_US / 2) / HAL_LED_TIMER_TICK_US;
+
+// Blink code for plug n (n blinks): bit s is the LED during step s
+constexpr uint64_t faultPattern(int blinks) {
+  return blinks == 0 ? 0 :
+    faultPattern(blinks - 1) | ((1ULL << BLINK_ON_STEPS) - 1) << ((blinks - 1) * (BLINK_ON_STEPS + BLINK_OFF_STEPS));
+}
+
+constexpr int faultPatternSteps(int blinks) {
+  return blinks * (BLINK_ON_STEPS + BLINK_OFF_STEPS) + SEQUENCE_PAUSE_STEPS;
+}
+
+static_assert(NUM_OUTPUTS <= 8, "fault mask is 8 bits");
+static_assert(faultPatternSteps(NUM_OUTPUTS) <= 64, "blink codes are 64 step patterns");
 
 // Function declarations
 void initializeFaultIndication();
-void updateFaultIndication();
-void setOutputFault(int outputIndex, bool faulted);
+void setOutputFault(Channel outputIndex, bool faulted);
 bool hasAnyFaults();
 int getFirstFaultedOutput();
+void setActiveIndication(bool active);       // LED on behind the codes
+void stopFaultIndicationTimer();             // low power steps it instead
+uint8_t getFaultIndicationHoldSteps();       // steps until the LED next changes
+void advanceFaultIndication(uint8_t steps);
 
-#endif
\ No newline at end of file
+#endif
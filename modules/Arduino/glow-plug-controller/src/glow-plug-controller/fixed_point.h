@@ -0,0 +1,106 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include "config.h"
+
+// Integer current and temperature conversion chain
+// The float versions in current_monitor.cpp are the reference.  Every scale
+// factor here is folded from the config.h constants at compile time, so per
+// sample the AVR only does a 16x16 multiply, one divide and one 32 bit multiply.
+// Per-sample conversion on the control path is a table read (conversion_tables.h);
+// this chain is for values that don't come from a single ADC code, such as
+// filtered or averaged readings.
+//
+//   ADC code  -> mA     mA = code * MA_PER_CODE_Q8 >> 8
+//   mA        -> R      R  = RESISTANCE_NUMERATOR / mA              (1/2^RESISTANCE_SHIFT mohm)
+//   R         -> temp   T  = AMBIENT + (R - R0) * TEMP_Q4_PER_RES_Q16 >> 16
+
+constexpr float MILLIAMPS_PER_ADC_CODE =
+  SenseDivider::inputVolts(BoardAdc::VOLTS_PER_CODE)               // sense volts per code
+  / SENSE_RESISTOR * (BTS50010_SENSE_RATIO / 10000.0)              // sense volts -> amps
+  * CURRENT_CALIBRATION_FACTOR
+  * 1000.0;
+
+constexpr uint16_t MA_PER_CODE_Q8 = neoteric::Fixed<uint16_t, 8>::fromFloat(MILLIAMPS_PER_ADC_CODE);
+static_assert(MILLIAMPS_PER_ADC_CODE * 256.0 < 65535.0, "mA per ADC code must fit a 16 bit Q8");
+static_assert(1023.0 * MILLIAMPS_PER_ADC_CODE < 65535.0, "full scale current must fit 16 bits of mA");
+
+constexpr tempq4_t AMBIENT_TEMP_Q4 = TempQ4::fromFloat(AMBIENT_TEMP);
+constexpr tempq4_t MAX_ESTIMATED_TEMP_Q4 = TempQ4::fromFloat(MAX_ESTIMATED_TEMP);
+
+// Resistance is carried in 1/2^RESISTANCE_SHIFT milliohm steps.  The shift is
+// the largest that still fits the clamp range in 16 bits, so low resistance,
+// low coefficient plugs (the ceramic ones) keep enough resolution.
+constexpr float TEMP_Q4_PER_MOHM = TEMP_Q4_ONE / (GLOW_PLUG_RESISTANCE_COLD * 1000.0 * TEMP_COEFFICIENT);
+constexpr float MAX_RESISTANCE_MOHM =
+  GLOW_PLUG_RESISTANCE_COLD * 1000.0 + (MAX_ESTIMATED_TEMP_Q4 - AMBIENT_TEMP_Q4) / TEMP_Q4_PER_MOHM;
+
+constexpr int pickResistanceShift(int shift) {
+  return (shift < 8 && MAX_RESISTANCE_MOHM * (2 << shift) < 65000.0) ? pickResistanceShift(shift + 1) : shift;
+}
+constexpr int RESISTANCE_SHIFT = pickResistanceShift(0);
+static_assert(MAX_RESISTANCE_MOHM < 65000.0, "resistance range must fit 16 bits of milliohms");
+
+typedef uint16_t resq_t;
+
+constexpr uint32_t RESISTANCE_NUMERATOR = (uint32_t)(SUPPLY_VOLTAGE * 1000000.0 * (1 << RESISTANCE_SHIFT) + 0.5);
+constexpr resq_t COLD_RESISTANCE_Q = (resq_t)(GLOW_PLUG_RESISTANCE_COLD * 1000.0 * (1 << RESISTANCE_SHIFT) + 0.5);
+constexpr uint32_t TEMP_Q4_PER_RES_Q16 = neoteric::Fixed<uint32_t, 16>::fromFloat(TEMP_Q4_PER_MOHM / (1 << RESISTANCE_SHIFT));
+static_assert(SUPPLY_VOLTAGE * 1000000.0 * (1 << RESISTANCE_SHIFT) < 4294967295.0, "supply scale must fit 32 bits");
+static_assert(TEMP_Q4_PER_MOHM < 65535.0, "temperature slope must fit a 32 bit Q16");
+
+// Past this much resistance rise the estimate is clamped, which also keeps the
+// 32 bit product below from overflowing
+constexpr resq_t MAX_DELTA_RES_Q =
+  (resq_t)((MAX_ESTIMATED_TEMP_Q4 - AMBIENT_TEMP_Q4) / TEMP_Q4_PER_MOHM * (1 << RESISTANCE_SHIFT) + 1.0);
+
+// Current thresholds
+constexpr uint16_t MIN_ESTIMATE_MA = 100;        // below this, assume ambient
+constexpr uint16_t UNDERCURRENT_FLOOR_MA = 500; // only flag undercurrent if some current flows
+constexpr uint16_t MIN_CURRENT_MA = (uint16_t)(MIN_CURRENT_THRESHOLD * 1000.0);
+constexpr uint16_t MAX_CURRENT_MA = (uint16_t)(MAX_CURRENT_THRESHOLD * 1000.0);
+
+// Plug admission (state_machine.cpp)
+constexpr uint32_t SUPPLY_CURRENT_BUDGET_MA = (uint32_t)(SUPPLY_CURRENT_BUDGET * 1000.0);
+constexpr uint16_t PLUG_INRUSH_MA = (uint16_t)(SUPPLY_VOLTAGE / GLOW_PLUG_RESISTANCE_COLD * 1000.0); // cold plug
+static_assert(PLUG_INRUSH_MA <= SUPPLY_CURRENT_BUDGET_MA, "supply budget must cover at least one cold plug");
+
+inline uint16_t adcCodeToMilliamps(uint16_t adcCode) {
+  return ((uint32_t)adcCode * MA_PER_CODE_Q8) >> 8;
+}
+
+// Same for a filtered code in 1/16 code steps (current_filter.h)
+inline uint16_t adcCodeQ4ToMilliamps(uint16_t adcCodeQ4) {
+  return ((uint32_t)adcCodeQ4 * MA_PER_CODE_Q8) >> 12;
+}
+
+inline resq_t milliampsToResistance(uint16_t milliamps) {
+  if (milliamps == 0) {
+    return 0xFFFF;
+  }
+  uint32_t resistance = RESISTANCE_NUMERATOR / milliamps;
+  return resistance > 0xFFFF ? 0xFFFF : (resq_t)resistance;
+}
+
+inline tempq4_t resistanceToTemperatureQ4(resq_t resistance) {
+  if (resistance <= COLD_RESISTANCE_Q) {
+    return AMBIENT_TEMP_Q4;
+  }
+
+  resq_t deltaR = resistance - COLD_RESISTANCE_Q;
+  if (deltaR >= MAX_DELTA_RES_Q) {
+    return MAX_ESTIMATED_TEMP_Q4;
+  }
+
+  tempq4_t temperature = AMBIENT_TEMP_Q4 + (tempq4_t)(((uint32_t)deltaR * TEMP_Q4_PER_RES_Q16) >> 16);
+  return temperature > MAX_ESTIMATED_TEMP_Q4 ? MAX_ESTIMATED_TEMP_Q4 : temperature;
+}
+
+inline tempq4_t estimateGlowPlugTemperatureQ4(uint16_t milliamps) {
+  if (milliamps <= MIN_ESTIMATE_MA) {
+    return AMBIENT_TEMP_Q4; // No current, assume ambient temperature
+  }
+  return resistanceToTemperatureQ4(milliampsToResistance(milliamps));
+}
+
+#endif
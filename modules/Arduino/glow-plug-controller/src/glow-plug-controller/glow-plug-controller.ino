@@ -20,49 +20,123 @@
 #include "state_machine.h"
 #include "current_monitor.h"
 #include "fault_indication.h"
+#include "adc_sampler.h"
+#include "overcurrent_trip.h"
+#include "current_filter.h"
+#include "telemetry.h"
+#include "can_telemetry.h"
+#include "scheduler.h"
+#include "temperature_control.h"
+#include "boot_trace.h"
+#include "event_log.h"
+#include "benchmark.h"
+#include "timing_report.h"
+#include "trace_recorder.h"
+#include "low_power.h"
 
 // Global variable definitions
 ControllerState currentState;
 unsigned long stateStartTime;
-bool outputEnabled[NUM_OUTPUTS];
-float currentDutyCycle[NUM_OUTPUTS];
-OutputState outputStates[NUM_OUTPUTS];
-unsigned long outputStartTimes[NUM_OUTPUTS];
-unsigned long outputStaggerStartTime[NUM_OUTPUTS];
-int outputTotalDuration[NUM_OUTPUTS];
-float initialTemperatures[NUM_OUTPUTS];
-bool outputFaulted[NUM_OUTPUTS];
-int firstFaultedOutput;
+unsigned long heatingStartTime;
+GlowChannel glowChannels[NUM_OUTPUTS];
+int8_t firstFaultedOutput;
 
+// Control tasks, each at its own rate
+ScheduledTask tasks[] = {
+  {"state",   updateStateMachine,    STATE_MACHINE_PERIOD_MS},
+  {"current", monitorAllCurrents,    CURRENT_MONITOR_PERIOD_MS},
+#ifdef CAN_TELEMETRY
+  // straight after the current monitor, so they only use the time it leaves
+  {"canqueue", queueCanTelemetry,    CAN_TELEMETRY_PERIOD_MS},
+  {"cansend", sendCanTelemetry,      CAN_SEND_PERIOD_MS},
+#endif
+  {"control", updateTemperatureControl, TEMPERATURE_CONTROL_PERIOD_MS},
+  {"eventlog", updateEventLog,       EVENT_LOG_PERIOD_MS},
+  {"query",   serviceTimingQuery,    TIMING_QUERY_PERIOD_MS},
+#ifdef TRACE_RECORD
+  // last, so it sees everything the other tasks did in the same pass
+  {"trace",   updateTraceRecorder,   TRACE_PERIOD_MS},
+#endif
+#ifdef TELEMETRY
+  {"telemetry", sendTelemetry,       TELEMETRY_PERIOD_MS},
+#endif
+};
+const int NUM_TASKS = sizeof(tasks) / sizeof(tasks[0]);
+
+#ifdef BENCHMARK
+
+// Benchmark build: time the hot paths, print the results and light the LED if
+// any of them is over budget
 void setup() {
-  Serial.begin(9600);
-  DEBUG_PRINTLN("Glow Plug Controller Initializing");
+  Serial.begin(SERIAL_BAUD);
+  initializeBenchmarks();
+  int overBudget = runBenchmarks();
+  Serial.println(overBudget ? "FAIL" : "PASS");
+  halDigitalWrite(LED_BUILTIN, overBudget ? HIGH : LOW);
+}
+
+void loop() {
+}
+
+#else
+
+void setup() {
+  traceBootEvent(BOOT_TRACE_SETUP);
+  Serial.begin(SERIAL_BAUD);
+  initializeLowPower();
+  DEBUG_LOG("Glow Plug Controller Initializing");
 
   // Initialize outputs
   initializeOutputs();
 
   // Initialize inputs
-  for(int i = 0 ; i < NUM_INPUTS ; i++) {
-    pinMode(INPUT_PINS[i], INPUT);
+  for (Channel i : Channel::all()) {
+    halPinMode(InputPins::pin(i), INPUT);
   }
-  DEBUG_PRINTLN("All inputs initialized");
+  DEBUG_LOG("All inputs initialized");
+
+  // Start background sampling of the current-sense inputs, with the
+  // overcurrent fast-trip and the filter stage seeing every sample
+  initializeOvercurrentTrip();
+  initializeCurrentFilter();
+#ifdef TRACE_RECORD
+  initializeTraceRecorder();   // before the first sample
+#endif
+  initializeAdcSampler();
+  traceBootEvent(BOOT_TRACE_ADC_RUNNING);
 
-  pinMode(LED_BUILTIN, OUTPUT);
-  digitalWrite(LED_BUILTIN, LOW);
+  halPinMode(LED_BUILTIN, OUTPUT);
+  halDigitalWrite(LED_BUILTIN, LOW);
 
   // Initialize current monitoring
   initializeCurrentMonitoring();
 
-  // Initialize fault indication
+  // Start the fault code sequencer on the LED timer
   initializeFaultIndication();
 
+  // Load the warm start cache from the event log
+  initializeEventLog();
+
   // Initialize state machine
   initializeStateMachine();
+
+#ifdef TELEMETRY
+  initializeTelemetry();
+#endif
+#ifdef CAN_TELEMETRY
+  initializeCanTelemetry();
+#endif
+  initializeTimingReport();
+
+  initializeScheduler(tasks, NUM_TASKS);
 }
 
 void loop() {
-  updateStateMachine();
-  monitorAllCurrents();
-  updateFaultIndication();
-  delay(10);
+  if (isReadyToSleep()) {
+    sleepUntilNextWake();
+  } else {
+    runScheduler();
+  }
 }
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef HAL_H
+#define HAL_H
+
+// Thin hardware abstraction layer
+// All of the controller modules go through these calls instead of touching the
+// Arduino core directly.  On the board they are straight inline pass-throughs,
+// so there is no cost.  The host build (see ../../host) provides a simulated
+// board with a virtual clock and scripted ADC inputs instead.
+
+#include <stdint.h>
+
+// ADC conversion complete handler, supplied by the application (adc_sampler.cpp).
+// Called from the ADC interrupt on the board and from the simulated ADC on the host.
+void halAdcConversionComplete(int value);
+
+// Wake input handler, supplied by the application (low_power.cpp).  Called from
+// the pin change interrupt on the board, and from the simulated pin on the host.
+void halWakePinChanged();
+
+// LED pattern timer tick handler, supplied by the application
+// (fault_indication.cpp).  Called from the timer interrupt on the board and
+// from the simulated timer on the host, every HAL_LED_TIMER_TICK_US.
+void halLedTimerTick();
+
+// Power-down sleep is timed by the watchdog, in HAL_WATCHDOG_TICK_MS << period
+// for periods 0 (16ms) to HAL_WATCHDOG_PERIODS - 1 (8s)
+const unsigned int HAL_WATCHDOG_TICK_MS = 16;
+const uint8_t HAL_WATCHDOG_PERIODS = 10;
+
+// SPI to the CAN controller (can_bus.h): mode 0, MSB first, chip select low.
+// The hardware SPI pins 10 and 11 are PWM outputs on this board, so it is
+// clocked in software on spare pins, about 10us a byte.
+const uint8_t HAL_SPI_CS_PIN = 4;
+const uint8_t HAL_SPI_SCK_PIN = 7;
+const uint8_t HAL_SPI_MOSI_PIN = 8;
+const uint8_t HAL_SPI_MISO_PIN = 12;
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <avr/eeprom.h>
+#include <avr/power.h>
+#include <avr/wdt.h>
+
+// Timer0 stops in power-down, so millis() misses the time asleep.
+// halPowerDown() counts it here and the clock below adds it back.
+inline unsigned long& halSleptMillis() {
+  static unsigned long slept = 0;
+  return slept;
+}
+
+inline unsigned long halMillis() { return millis() + halSleptMillis(); }
+inline unsigned long halMicros() { return micros() + halSleptMillis() * 1000UL; }
+inline void halDelay(unsigned long ms) { delay(ms); }
+inline void halPinMode(int pin, int mode) { pinMode(pin, mode); }
+inline void halDigitalWrite(int pin, int value) { digitalWrite(pin, value); }
+inline int halDigitalRead(int pin) { return digitalRead(pin); }
+inline int halAnalogRead(int pin) { return analogRead(pin); }
+inline void halAnalogWrite(int pin, int value) { analogWrite(pin, value); }
+
+// Idle until the next interrupt - the 1ms timer tick at the latest.  Timers, the
+// ADC and the UART keep running.  wakeMillis is only used by the simulator.
+inline void halIdleUntil(unsigned long wakeMillis) {
+  (void)wakeMillis;
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_mode();
+}
+
+// Power down until the watchdog fires after HAL_WATCHDOG_TICK_MS << period, or
+// until an enabled pin change comes first.  The ADC, the brown-out detector and
+// every peripheral clock are off while asleep and put back as they were after.
+// Waking restarts the crystal oscillator: 16K cycles, 1ms, on the Uno's fuses.
+// The period is added to halMillis() in full, even if a pin change cut it
+// short, and is only as good as the watchdog's own oscillator (about 10%).
+inline void halPowerDown(uint8_t period) {
+  uint8_t adcsra = ADCSRA;
+  ADCSRA = 0;                // the ADC has to be off before its clock is gated
+  uint8_t prr = PRR;
+  power_all_disable();
+
+  uint8_t prescaler = (period & 0x07) | ((period & 0x08) ? _BV(WDP3) : 0);
+  cli();
+  wdt_reset();
+  WDTCSR = _BV(WDCE) | _BV(WDE);
+  WDTCSR = _BV(WDIE) | prescaler;   // interrupt only, no reset
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sleep_bod_disable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+  wdt_disable();
+
+  PRR = prr;
+  ADCSRA = adcsra;
+  halSleptMillis() += (unsigned long)HAL_WATCHDOG_TICK_MS << period;
+}
+
+// Restart as if the power had been cycled, with a watchdog reset.  Optiboot
+// (the Uno's bootloader) turns the watchdog off and starts the sketch at once.
+inline void halRestart() {
+  wdt_enable(WDTO_15MS);
+  for (;;) {
+  }
+}
+
+// After a watchdog reset the watchdog stays on until this clears it
+inline void halWatchdogOff() {
+  MCUSR &= ~_BV(WDRF);
+  wdt_disable();
+}
+
+// Wake input: a switch to ground on the internal pull-up, with a pin change
+// interrupt that the application's handler for the pin's port passes on to
+// halWakePinChanged()
+inline void halWakePinBegin(uint8_t pin) {
+  pinMode(pin, INPUT_PULLUP);
+}
+
+inline void halWakePinInterrupt(uint8_t pin, bool enabled) {
+  if (enabled) {
+    *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+    PCIFR = _BV(digitalPinToPCICRbit(pin));   // forget edges from before
+    PCICR |= _BV(digitalPinToPCICRbit(pin));
+  } else {
+    *digitalPinToPCMSK(pin) &= ~_BV(digitalPinToPCMSKbit(pin));
+  }
+}
+
+inline uint8_t halEnterCritical() { uint8_t sreg = SREG; cli(); return sreg; }
+inline void halExitCritical(uint8_t sreg) { SREG = sreg; }
+
+// Free running ADC: AVcc reference, /128 prescaler (125kHz ADC clock, 104us per
+// conversion at 16MHz), conversion complete interrupt enabled.
+// analogRead() must not be used while this is running.
+const unsigned long HAL_ADC_CONVERSION_US = 13UL * 128UL * 1000000UL / F_CPU;
+
+inline void halAdcSelectPin(int pin) {
+  ADMUX = (ADMUX & 0xF0) | ((pin - A0) & 0x07);
+}
+
+// A conversion has finished and its interrupt hasn't run yet, so the next one
+// has already started with the input selected before.  Only meaningful with
+// interrupts off.
+inline bool halAdcResultPending() {
+  return ADCSRA & _BV(ADIF);
+}
+
+inline void halAdcStartFreeRunning(int firstPin) {
+  ADMUX = _BV(REFS0) | ((firstPin - A0) & 0x07);
+  ADCSRB = 0;  // auto trigger source: free running
+  ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+inline void halAdcStop() {
+  ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
+}
+
+// LED pattern timer: Timer2's overflow interrupt.  The core already runs Timer2
+// for analogWrite() on D3 and D11 (phase correct, /64), so this only turns its
+// interrupt on: one tick a PWM period, whatever the duty.  The application
+// supplies the ISR.  Stops in power-down.
+const unsigned long HAL_LED_TIMER_TICK_US = 64UL * 510UL * 1000000UL / F_CPU;
+
+inline void halLedTimerStart() { TIMSK2 |= _BV(TOIE2); }
+inline void halLedTimerStop() { TIMSK2 &= ~_BV(TOIE2); }
+
+// Uno digital pins 0-7 are port D and 8-13 port B.  With a constant pin these
+// come down to single sbi/cbi/sbic instructions, which can't race the
+// fast-trip's digitalWrite() on the same port.
+inline volatile uint8_t& halPinPort(uint8_t pin) { return pin < 8 ? PORTD : PORTB; }
+inline volatile uint8_t& halPinInput(uint8_t pin) { return pin < 8 ? PIND : PINB; }
+inline uint8_t halPinMask(uint8_t pin) { return 1 << (pin & 7); }
+
+static_assert(HAL_SPI_CS_PIN >= 2 && HAL_SPI_CS_PIN <= 13 && HAL_SPI_SCK_PIN >= 2 && HAL_SPI_SCK_PIN <= 13 &&
+              HAL_SPI_MOSI_PIN >= 2 && HAL_SPI_MOSI_PIN <= 13 && HAL_SPI_MISO_PIN >= 2 && HAL_SPI_MISO_PIN <= 13,
+              "SPI pins must be digital pins 2-13");
+
+inline void halSpiBegin() {
+  digitalWrite(HAL_SPI_CS_PIN, HIGH);
+  pinMode(HAL_SPI_CS_PIN, OUTPUT);
+  digitalWrite(HAL_SPI_SCK_PIN, LOW);
+  pinMode(HAL_SPI_SCK_PIN, OUTPUT);
+  pinMode(HAL_SPI_MOSI_PIN, OUTPUT);
+  pinMode(HAL_SPI_MISO_PIN, INPUT_PULLUP);  // reads 0xFF with nothing fitted
+}
+
+inline void halSpiSelect(bool selected) {
+  if (selected) {
+    halPinPort(HAL_SPI_CS_PIN) &= ~halPinMask(HAL_SPI_CS_PIN);
+  } else {
+    halPinPort(HAL_SPI_CS_PIN) |= halPinMask(HAL_SPI_CS_PIN);
+  }
+}
+
+inline uint8_t halSpiTransfer(uint8_t value) {
+  uint8_t received = 0;
+  for (uint8_t bit = 0x80; bit; bit >>= 1) {
+    if (value & bit) {
+      halPinPort(HAL_SPI_MOSI_PIN) |= halPinMask(HAL_SPI_MOSI_PIN);
+    } else {
+      halPinPort(HAL_SPI_MOSI_PIN) &= ~halPinMask(HAL_SPI_MOSI_PIN);
+    }
+    halPinPort(HAL_SPI_SCK_PIN) |= halPinMask(HAL_SPI_SCK_PIN);
+    if (halPinInput(HAL_SPI_MISO_PIN) & halPinMask(HAL_SPI_MISO_PIN)) {
+      received |= bit;
+    }
+    halPinPort(HAL_SPI_SCK_PIN) &= ~halPinMask(HAL_SPI_SCK_PIN);
+  }
+  return received;
+}
+
+// EEPROM: 1KB on the Uno.  A byte write takes ~3.4ms and runs in the
+// background; halEepromWrite() only starts it, so check halEepromReady() first
+// or it will wait for the previous write to finish.
+const int HAL_EEPROM_SIZE = E2END + 1;
+
+inline uint8_t halEepromRead(int address) { return eeprom_read_byte((const uint8_t*)address); }
+inline bool halEepromReady() { return eeprom_is_ready(); }
+inline void halEepromWrite(int address, uint8_t value) { eeprom_write_byte((uint8_t*)address, value); }
+
+// Benchmark timer (benchmark.h): Timer1 at the full CPU clock, so one tick per
+// cycle.  Only for the benchmark build - it takes Timer1 away from the PWM on
+// pins 9 and 10.  Wraps after 65535 cycles (4ms); a read after that saturates.
+const char* const HAL_BENCH_TICK_UNIT = "cycles";
+
+inline void halBenchStart() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+}
+
+inline uint32_t halBenchElapsed() {
+  uint16_t ticks = TCNT1;
+  return (TIFR1 & _BV(TOV1)) ? 0xFFFF : ticks;
+}
+
+#else
+
+#include "sim_board.h"
+
+#endif
+
+#endif
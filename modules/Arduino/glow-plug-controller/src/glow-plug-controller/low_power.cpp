@@ -0,0 +1,93 @@
+#include "low_power.h"
+#include "adc_sampler.h"
+#include "fault_indication.h"
+#include "event_log.h"
+#include "can_telemetry.h"
+
+static volatile bool restartRequested = false;
+static bool asleep = false;
+static unsigned long wakeups = 0;
+
+void initializeLowPower() {
+  halWatchdogOff();   // still on if this start was a restart from low power
+  halWakePinBegin(WAKE_PIN);
+  restartRequested = false;
+  asleep = false;
+  wakeups = 0;
+}
+
+// Interrupt context.  Only a falling input counts; letting go of the button
+// wakes the CPU too, but it goes straight back to sleep.
+void halWakePinChanged() {
+  if (halDigitalRead(WAKE_PIN) == LOW) {
+    restartRequested = true;
+  }
+}
+
+#ifdef ARDUINO
+ISR(PCINT2_vect) {
+  halWakePinChanged();
+}
+
+// Only there to wake the CPU
+EMPTY_INTERRUPT(WDT_vect);
+#endif
+
+bool isReadyToSleep() {
+  if (currentState != STATE_LOW_POWER) {
+    return false;
+  }
+  if (asleep) {
+    return true;
+  }
+  if (getPendingEventLogRecords() > 0 || !halEepromReady()) {
+    return false;
+  }
+#ifdef CAN_TELEMETRY
+  if (isCanTelemetryBatchPending()) {
+    return false;
+  }
+#endif
+  return true;
+}
+
+static void fallAsleep() {
+  halAdcStop();
+  stopFaultIndicationTimer();
+#ifdef CAN_TELEMETRY
+  stopCanTelemetry();
+#endif
+  Serial.flush();   // the UART's clock is about to stop
+  halWakePinInterrupt(WAKE_PIN, true);
+  asleep = true;
+}
+
+void sleepUntilNextWake() {
+  if (!asleep) {
+    fallAsleep();
+  }
+  if (restartRequested) {
+    halWakePinInterrupt(WAKE_PIN, false);
+    halRestart();
+    return;
+  }
+
+  if (hasAnyFaults()) {
+    // The longest sleep, in whole pattern steps, that doesn't pass the LED's
+    // next change.  Longer holds are made of several sleeps.
+    uint8_t hold = getFaultIndicationHoldSteps();
+    uint8_t shift = 0;
+    while (FAULT_PATTERN_WATCHDOG_PERIOD + shift + 1 < HAL_WATCHDOG_PERIODS && (2 << shift) <= hold) {
+      shift++;
+    }
+    halPowerDown(FAULT_PATTERN_WATCHDOG_PERIOD + shift);
+    advanceFaultIndication(1 << shift);
+  } else {
+    halPowerDown(LOW_POWER_IDLE_PERIOD);
+  }
+  wakeups++;
+}
+
+unsigned long getLowPowerWakeups() {
+  return wakeups;
+}
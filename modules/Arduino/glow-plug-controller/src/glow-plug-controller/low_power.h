@@ -0,0 +1,38 @@
+#ifndef LOW_POWER_H
+#define LOW_POWER_H
+
+#include "config.h"
+#include "fault_indication.h"
+
+// Low power
+// Once the state machine reaches STATE_LOW_POWER and everything still going
+// out has gone (event log records, the serial TX buffer, the last CAN batch),
+// the loop stops running the scheduler and sleeps instead: the ADC stops, the
+// CAN controller goes to sleep and the CPU powers down with every peripheral
+// clock gated.  A CAN frame that nothing on the bus acknowledges is only
+// waited for CAN_ACK_TIMEOUT_MS, then aborted.  Only two things wake it:
+//   - the watchdog, timed to the next change of the fault LED's blink code
+//     (whole FAULT_PATTERN_STEP_MS steps), or every LOW_POWER_IDLE_PERIOD if
+//     there is no fault to show
+//   - a change on WAKE_PIN.  Pulled low (key cycled, restart pressed) it
+//     restarts the controller through a watchdog reset, which runs the whole
+//     start up again, warm start cache and all.
+// Awake time after each watchdog tick is the oscillator start-up plus moving the
+// blink code on; the host simulator reports it as a share of the time spent
+// in low power.  Serial input, and so the timing query, is off while asleep.
+
+const uint8_t LOW_POWER_IDLE_PERIOD = HAL_WATCHDOG_PERIODS - 1;   // 8s
+const uint8_t FAULT_PATTERN_WATCHDOG_PERIOD = 3;                 // one pattern step
+
+static_assert((HAL_WATCHDOG_TICK_MS << FAULT_PATTERN_WATCHDOG_PERIOD) == FAULT_PATTERN_STEP_MS,
+              "a blink code step has to be a watchdog period");
+
+static_assert(WAKE_PIN < 8, "the wake input's pin change interrupt is PCINT2 (port D)");
+
+// Function declarations
+void initializeLowPower();
+bool isReadyToSleep();
+void sleepUntilNextWake();
+unsigned long getLowPowerWakeups();
+
+#endif
@@ -1,69 +1,78 @@
 #include "output_control.h"
+#include "overcurrent_trip.h"
+#include "adc_sampler.h"
 
 void initializeOutputs() {
   // Initialize all outputs to OFF and enable all outputs by default
-  for(int i = 0 ; i < NUM_OUTPUTS ; i++) {
-    pinMode(OUTPUT_PINS[i], OUTPUT);
-    digitalWrite(OUTPUT_PINS[i], LOW);
-    analogWrite(OUTPUT_PINS[i], 0);
-    outputEnabled[i] = true;
-    currentDutyCycle[i] = 0.0;
-    outputStates[i] = OUTPUT_OFF;
-    outputStartTimes[i] = 0;
-    outputStaggerStartTime[i] = 0;
-    outputTotalDuration[i] = COLD_ENGINE_TOTAL_MS; // Default to cold
-    initialTemperatures[i] = 0; // first read will estimate this
-    outputFaulted[i] = false;
+  for (Channel i : Channel::all()) {
+    halPinMode(OutputPins::pin(i), OUTPUT);
+    halDigitalWrite(OutputPins::pin(i), LOW);
+    halAnalogWrite(OutputPins::pin(i), 0);
+    GlowChannel& channel = glowChannels[i];
+    channel.duty = DUTY_OFF;
+    channel.state = OUTPUT_OFF;
+    channel.enabled = true;
+    channel.faulted = false;
+    channel.phaseStartMs = 0;
+    channel.totalDurationMs = COLD_ENGINE_TOTAL_MS; // Default to cold
+    channel.initialTempQ4 = 0; // first read will estimate this
   }
   firstFaultedOutput = -1; // No faults initially
-  DEBUG_PRINTLN("All outputs initialized to OFF and enabled");
+  DEBUG_LOG("All outputs initialized to OFF and enabled");
 }
 
-void setOutput(int outputIndex, float dutyCycle) {
-  if (outputIndex < 0 || outputIndex >= NUM_OUTPUTS) {
-    return;
-  }
+void setOutput(Channel outputIndex, uint8_t duty) {
+  
+  glowChannels[outputIndex].duty = duty;
   
-  dutyCycle = constrain(dutyCycle, 0.0, 1.0);
-  currentDutyCycle[outputIndex] = dutyCycle;
+  // A plug just switched on gets the most samples until the current monitor
+  // has seen it, and one switched off none.  The plug keeps its slot for as
+  // long as it is driven: it is taken away after the write, never before.
+  bool driven = duty != DUTY_OFF && glowChannels[outputIndex].enabled && !isOutputTripped(outputIndex);
+  if (driven && getSamplingPriority(outputIndex) == SAMPLING_IDLE) {
+    setSamplingPriority(outputIndex, SAMPLING_HIGH);
+  }
   
-  if (outputEnabled[outputIndex]) {
-    int pwmValue = (int)(dutyCycle * 255);
-    analogWrite(OUTPUT_PINS[outputIndex], pwmValue);
+  // The ADC interrupt may trip the output at any time, so check and write
+  // together or a trip could be undone straight away
+  uint8_t sreg = halEnterCritical();
+  if (glowChannels[outputIndex].enabled && !isOutputTripped(outputIndex)) {
+    halAnalogWrite(OutputPins::pin(outputIndex), duty);
   } else {
-    analogWrite(OUTPUT_PINS[outputIndex], 0);
+    halAnalogWrite(OutputPins::pin(outputIndex), 0);
+  }
+  halExitCritical(sreg);
+  
+  if (!driven) {
+    setSamplingPriority(outputIndex, SAMPLING_IDLE);
   }
 }
 
-void setAllOutputs(float dutyCycle) {
-  for(int i = 0; i < NUM_OUTPUTS; i++) {
-    setOutput(i, dutyCycle);
+void setAllOutputs(uint8_t duty) {
+  for (Channel i : Channel::all()) {
+    setOutput(i, duty);
   }
 }
 
-void enableOutput(int outputIndex, bool enabled) {
-  if (outputIndex < 0 || outputIndex >= NUM_OUTPUTS) {
-    return;
-  }
+void enableOutput(Channel outputIndex, bool enabled) {
   
-  outputEnabled[outputIndex] = enabled;
+  glowChannels[outputIndex].enabled = enabled;
   
   if (!enabled) {
-    analogWrite(OUTPUT_PINS[outputIndex], 0);
-    DEBUG_PRINT("Output ");
-    DEBUG_PRINT(outputIndex);
-    DEBUG_PRINTLN(" disabled");
+    // The ADC interrupt's trip write changes the same timer and port
+    // registers, so keep it out as setOutput() does
+    uint8_t sreg = halEnterCritical();
+    halAnalogWrite(OutputPins::pin(outputIndex), 0);
+    halExitCritical(sreg);
+    setSamplingPriority(outputIndex, SAMPLING_IDLE);
+    DEBUG_LOG("Output %d disabled", outputIndex);
   } else {
-    setOutput(outputIndex, currentDutyCycle[outputIndex]);
-    DEBUG_PRINT("Output ");
-    DEBUG_PRINT(outputIndex);
-    DEBUG_PRINTLN(" enabled");
+    clearOvercurrentTrip(outputIndex);
+    setOutput(outputIndex, glowChannels[outputIndex].duty);
+    DEBUG_LOG("Output %d enabled", outputIndex);
   }
 }
 
-bool isOutputEnabled(int outputIndex) {
-  if (outputIndex < 0 || outputIndex >= NUM_OUTPUTS) {
-    return false;
-  }
-  return outputEnabled[outputIndex];
+bool isOutputEnabled(Channel outputIndex) {
+  return glowChannels[outputIndex].enabled;
 }
\ No newline at end of file
@@ -4,10 +4,10 @@
 #include "config.h"
 
 // Output control functions
-void setOutput(int outputIndex, float dutyCycle);
-void setAllOutputs(float dutyCycle);
-void enableOutput(int outputIndex, bool enabled);
-bool isOutputEnabled(int outputIndex);
+void setOutput(Channel outputIndex, uint8_t duty);
+void setAllOutputs(uint8_t duty);
+void enableOutput(Channel outputIndex, bool enabled);
+bool isOutputEnabled(Channel outputIndex);
 void initializeOutputs();
 
 #endif
\ No newline at end of file
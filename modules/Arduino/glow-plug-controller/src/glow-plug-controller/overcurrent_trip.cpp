@@ -0,0 +1,34 @@
+#include "overcurrent_trip.h"
+
+// Bit per output, set by the ADC interrupt
+static volatile uint8_t trippedOutputs = 0;
+
+void initializeOvercurrentTrip() {
+  trippedOutputs = 0;
+  DEBUG_LOG("Overcurrent fast-trip at ADC code %u, within %luus", OVERCURRENT_TRIP_CODE, OVERCURRENT_TRIP_BOUND_US);
+}
+
+// Runs for every conversion, so keep it short: one compare on the normal path.
+// Inputs and outputs share an index (InputPins::pin(i) senses OutputPins::pin(i)).
+void checkOvercurrentTrip(Channel inputIndex, uint16_t adcValue) {
+  if (adcValue < OVERCURRENT_TRIP_CODE) {
+    return;
+  }
+  // digitalWrite also disconnects the pin from its PWM timer
+  halDigitalWrite(OutputPins::pin(inputIndex), LOW);
+  trippedOutputs |= 1 << inputIndex;
+}
+
+bool isOutputTripped(Channel outputIndex) {
+  return trippedOutputs & (1 << outputIndex);
+}
+
+void clearOvercurrentTrip(Channel outputIndex) {
+  uint8_t sreg = halEnterCritical();
+  trippedOutputs &= ~(1 << outputIndex);
+  halExitCritical(sreg);
+}
+
+uint8_t getTrippedOutputs() {
+  return trippedOutputs;
+}
@@ -0,0 +1,32 @@
+#ifndef OVERCURRENT_TRIP_H
+#define OVERCURRENT_TRIP_H
+
+#include "config.h"
+#include "fixed_point.h"
+
+// Overcurrent fast-trip
+// Every ADC sample is compared against a precomputed raw code in the conversion
+// complete interrupt, and an output over the limit is switched off right there,
+// in any controller state.  The trip latches until the output is re-enabled;
+// monitorAllCurrents() picks it up to disable the output and flag the fault.
+
+// Lowest ADC code that reads above MAX_CURRENT_MA (same threshold as the
+// lookup table the slow path uses - checked by host/fixed-point-compare)
+constexpr uint16_t OVERCURRENT_TRIP_CODE = (uint16_t)(MAX_CURRENT_MA / MILLIAMPS_PER_ADC_CODE) + 1;
+static_assert(OVERCURRENT_TRIP_CODE <= 1023, "overcurrent limit is above the ADC full scale");
+
+// Worst case from a sustained overcurrent to the output being cut: waiting for
+// the channel's own slot in the next sampling cycle (adc_sampler.h) plus the
+// conversion in flight.
+const unsigned long OVERCURRENT_TRIP_BOUND_US = (NUM_INPUTS + 1) * HAL_ADC_CONVERSION_US;
+static_assert(OVERCURRENT_TRIP_BOUND_US < 1000, "fast-trip must act within a millisecond");
+static_assert(NUM_OUTPUTS <= 8, "trip flags are kept in one byte");
+
+// Function declarations
+void initializeOvercurrentTrip();
+void checkOvercurrentTrip(Channel inputIndex, uint16_t adcValue);  // interrupt context
+bool isOutputTripped(Channel outputIndex);
+void clearOvercurrentTrip(Channel outputIndex);
+uint8_t getTrippedOutputs();
+
+#endif
@@ -0,0 +1,141 @@
+#include "scheduler.h"
+
+static ScheduledTask* taskTable = 0;
+static int numTasks = 0;
+
+// Loop period counters.  The mean comes from the time since the first pass
+// counted, so it can't overflow.
+static uint32_t loopPasses = 0;
+static unsigned long statsStartMs = 0;
+static unsigned long lastPassMicros = 0;
+static unsigned long lastPassMs = 0;
+static uint16_t minPeriodUs = 0xFFFF;
+static uint16_t maxPeriodUs = 0;
+static uint16_t loopHistogram[LOOP_HISTOGRAM_BUCKETS];
+
+void initializeScheduler(ScheduledTask* tasks, int taskCount) {
+  taskTable = tasks;
+  numTasks = taskCount;
+
+  unsigned long now = halMillis();
+  for (int i = 0; i < numTasks; i++) {
+    taskTable[i].nextRunMs = now;
+  }
+  resetSchedulerStats();
+
+  DEBUG_LOG("Scheduler running %d tasks", numTasks);
+}
+
+static void recordLoopPass() {
+  unsigned long passMicros = halMicros();
+  if (loopPasses > 0) {
+    unsigned long period = passMicros - lastPassMicros;
+    uint16_t periodUs = period > 0xFFFF ? 0xFFFF : period;
+    if (periodUs < minPeriodUs) minPeriodUs = periodUs;
+    if (periodUs > maxPeriodUs) maxPeriodUs = periodUs;
+
+    int bucket = 0;
+    while (bucket < LOOP_HISTOGRAM_BUCKETS - 1 && period >= LOOP_HISTOGRAM_LIMITS_MS[bucket] * 1000UL) {
+      bucket++;
+    }
+    if (loopHistogram[bucket] < 0xFFFF) loopHistogram[bucket]++;
+  } else {
+    statsStartMs = halMillis();
+  }
+  lastPassMicros = passMicros;
+  lastPassMs = halMillis();
+  loopPasses++;
+}
+
+void runScheduler() {
+  recordLoopPass();
+
+  for (int i = 0; i < numTasks; i++) {
+    ScheduledTask& task = taskTable[i];
+    unsigned long now = halMillis();
+    if ((long)(now - task.nextRunMs) < 0) {
+      continue;
+    }
+
+    unsigned long release = task.nextRunMs;
+    unsigned long lateness = now - release;
+    if (lateness > task.maxLatenessMs) {
+      task.maxLatenessMs = lateness;
+    }
+
+    unsigned long startMicros = halMicros();
+    task.run();
+    unsigned long cost = halMicros() - startMicros;
+    task.runs++;
+
+    uint16_t costUs = cost > 0xFFFF ? 0xFFFF : cost;
+    if (costUs < task.minCostUs) task.minCostUs = costUs;
+    if (costUs > task.maxCostUs) task.maxCostUs = costUs;
+    task.totalCostUs = task.totalCostUs > 0xFFFFFFFF - cost ? 0xFFFFFFFF : task.totalCostUs + cost;
+
+    unsigned long finished = halMillis();
+    if (finished - release > task.periodMs) {
+      task.deadlineMisses++;
+    }
+
+    // stay on the original phase, skipping any releases we overran
+    task.nextRunMs = release + task.periodMs;
+    while ((long)(finished - task.nextRunMs) >= 0) {
+      task.nextRunMs += task.periodMs;
+    }
+  }
+
+  // Nothing else to do until the next task is due
+  unsigned long nextDue = taskTable[0].nextRunMs;
+  for (int i = 1; i < numTasks; i++) {
+    if ((long)(taskTable[i].nextRunMs - nextDue) < 0) {
+      nextDue = taskTable[i].nextRunMs;
+    }
+  }
+  halIdleUntil(nextDue);
+}
+
+int getScheduledTaskCount() {
+  return numTasks;
+}
+
+const ScheduledTask* getScheduledTask(int index) {
+  if (index < 0 || index >= numTasks) {
+    return 0;
+  }
+  return &taskTable[index];
+}
+
+LoopStats getLoopStats() {
+  LoopStats stats;
+  stats.passes = loopPasses;
+  stats.minPeriodUs = loopPasses > 1 ? minPeriodUs : 0;
+  stats.maxPeriodUs = maxPeriodUs;
+  // float, since elapsed time in us would overflow 32 bits after 71 minutes
+  // up to the last pass, so time asleep in low power isn't counted
+  float meanUs = loopPasses > 1 ? (lastPassMs - statsStartMs) * 1000.0 / (loopPasses - 1) : 0.0;
+  stats.meanPeriodUs = meanUs > 65535.0 ? 0xFFFF : (uint16_t)meanUs;
+  for (int i = 0; i < LOOP_HISTOGRAM_BUCKETS; i++) {
+    stats.histogram[i] = loopHistogram[i];
+  }
+  return stats;
+}
+
+// Clears the timing counters, and the deadline counts with them
+void resetSchedulerStats() {
+  for (int i = 0; i < numTasks; i++) {
+    ScheduledTask& task = taskTable[i];
+    task.runs = 0;
+    task.deadlineMisses = 0;
+    task.maxLatenessMs = 0;
+    task.minCostUs = 0xFFFF;
+    task.maxCostUs = 0;
+    task.totalCostUs = 0;
+  }
+  loopPasses = 0;
+  minPeriodUs = 0xFFFF;
+  maxPeriodUs = 0;
+  for (int i = 0; i < LOOP_HISTOGRAM_BUCKETS; i++) {
+    loopHistogram[i] = 0;
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "config.h"
+
+// Cooperative fixed-period task scheduler
+// Each task runs at its own period.  Its deadline is the end of the period it
+// was released in; finishing later than that counts as a deadline miss, and any
+// releases that were overrun are skipped rather than run back to back.
+// Between tasks the CPU idles until the next interrupt.
+//
+// The scheduler also keeps timing counters: each task's execution time, and
+// the loop period (start of one pass to the start of the next, idle time
+// included) with a coarse histogram.  They cost two micros() reads per task
+// run; timing_report.h sends them out on request.  In the host build the
+// times are virtual, so they only include what the simulator models (serial
+// blocking, analogRead()).
+
+struct ScheduledTask {
+  const char* name;
+  void (*run)();
+  unsigned int periodMs;
+
+  // maintained by the scheduler
+  unsigned long nextRunMs;
+  unsigned int runs;
+  unsigned int deadlineMisses;
+  unsigned int maxLatenessMs;   // worst start time past release
+  uint16_t minCostUs;           // execution time
+  uint16_t maxCostUs;
+  uint32_t totalCostUs;         // saturates; mean is totalCostUs / runs
+};
+
+// Loop period histogram: bucket n counts periods under LOOP_HISTOGRAM_LIMITS_MS[n],
+// the last bucket counts the rest
+const int LOOP_HISTOGRAM_BUCKETS = 8;
+const uint8_t LOOP_HISTOGRAM_LIMITS_MS[LOOP_HISTOGRAM_BUCKETS - 1] = {1, 2, 3, 4, 6, 10, 20};
+
+struct LoopStats {
+  uint32_t passes;
+  uint16_t minPeriodUs;
+  uint16_t maxPeriodUs;         // saturates at 65535
+  uint16_t meanPeriodUs;
+  uint16_t histogram[LOOP_HISTOGRAM_BUCKETS];  // saturate
+};
+
+// Function declarations
+void initializeScheduler(ScheduledTask* tasks, int taskCount);
+void runScheduler();
+int getScheduledTaskCount();
+const ScheduledTask* getScheduledTask(int index);
+LoopStats getLoopStats();
+void resetSchedulerStats();
+
+#endif
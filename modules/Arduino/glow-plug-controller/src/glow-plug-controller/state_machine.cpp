@@ -1,87 +1,125 @@
 #include "state_machine.h"
 #include "output_control.h"
 #include "current_monitor.h"
+#include "temperature_control.h"
+#include "boot_trace.h"
+#include "fault_indication.h"
+#include "event_log.h"
 
+// Plugs are started one at a time, in order: the next as soon as the measured
+// supply current leaves room for another cold plug under SUPPLY_CURRENT_BUDGET,
+// or ADMISSION_MAX_WAIT_MS after the last one at the latest.
+static uint16_t lastAdmissionMs = 0;
+
+// The measurement pulse starts straight away and runs during the boot delay.
+// Each plug moves on to heating by itself once its reading is in and
+// START_WAIT_MS has passed.
 void initializeStateMachine() {
-  stateStartTime = millis();
-  currentState = STATE_BOOT_DELAY;
+  stateStartTime = halMillis();
+  heatingStartTime = stateStartTime;
+  lastAdmissionMs = START_WAIT_MS;
+  currentState = STATE_MEASURING;
+  
+  // Plugs that failed last time stay off without being probed again
+  uint8_t knownDead = getKnownDeadOutputs();
+  for (Channel i : Channel::all()) {
+    if (knownDead & (1 << i)) {
+      DEBUG_LOG("Output %d failed last run, skipping", i);
+      setOutputFault(i, true);
+      enableOutput(i, false);
+    }
+  }
   
-  DEBUG_PRINT("Boot delay started - waiting ");
-  DEBUG_PRINT(START_WAIT_SECONDS);
-  DEBUG_PRINTLN(" seconds");
+  startInitialTemperatureMeasurement();
+  traceBootEvent(BOOT_TRACE_MEASURE_START);
 }
 
 void enterLowPowerMode() {
-  DEBUG_PRINTLN("Entering low power mode");
+  DEBUG_LOG("Entering low power mode");
   
   // Turn off all outputs
-  setAllOutputs(0.0);
+  setAllOutputs(DUTY_OFF);
   
-  // Turn off built-in LED
-  digitalWrite(LED_BUILTIN, LOW);
+  // The LED goes back to showing only the fault codes
+  setActiveIndication(false);
   
-  // Put processor to sleep (if supported)
-  // This is Arduino-specific and may vary by board
-  // For now, just enter idle state
+  // The loop puts the processor to sleep once the log records below are
+  // written (low_power.h)
   currentState = STATE_LOW_POWER;
-}
-
-
-void startFullPowerPhase() {
-  DEBUG_PRINTLN("Starting staggered output full power phases");
-  digitalWrite(LED_BUILTIN, HIGH);
   
-  unsigned long currentTime = millis();
-  for (int i = 0; i < NUM_OUTPUTS; i++) {
-    if (outputEnabled[i]) {
-      outputStates[i] = OUTPUT_WAITING_TO_START;
-      outputStaggerStartTime[i] = currentTime + (i * STAGGER_DELAY_MS);
-      
-      DEBUG_PRINT("Output ");
-      DEBUG_PRINT(i);
-      DEBUG_PRINT(" will start in ");
-      DEBUG_PRINT(i * STAGGER_DELAY_MS / 1000.0);
-      DEBUG_PRINT("s - total duration: ");
-      DEBUG_PRINT(outputTotalDuration[i] / 1000);
-      DEBUG_PRINTLN("s");
-    }
-  }
+  logRunSummary();
+  
+  printBootTrace();
 }
 
 void updateIndividualOutputs() {
-  unsigned long currentTime = millis();
+  uint16_t currentTime = heatingMillis();
   bool anyOutputActive = false;
   bool anyOutputInRampDown = false;
+  bool admissionChecked = false;
   
-  for (int i = 0; i < NUM_OUTPUTS; i++) {
-    if (!outputEnabled[i]) {
-      outputStates[i] = OUTPUT_FINISHED;
+  for (Channel i : Channel::all()) {
+    GlowChannel& channel = glowChannels[i];
+    if (!channel.enabled) {
+      channel.state = OUTPUT_FINISHED;
       continue;
     }
     
-    unsigned long outputElapsed = currentTime - outputStartTimes[i];
+    uint16_t outputElapsed = currentTime - channel.phaseStartMs;
     
-    switch (outputStates[i]) {
+    // Each plug is classified as soon as its own reading has settled, and
+    // can be admitted in the same pass
+    if (channel.state == OUTPUT_MEASURING &&
+        (readGlowPlugCurrent(i).isSettled || outputElapsed >= MEASURE_SETTLE_MS)) {
+      finishInitialTemperatureMeasurement(i);
+      traceBootEvent(BOOT_TRACE_READING_VALID, i);
+      channel.state = OUTPUT_WAITING_TO_START;
+    }
+    
+    switch ((OutputState)channel.state) {
+      case OUTPUT_MEASURING:
+        anyOutputActive = true;
+        break;
+        
+
       case OUTPUT_WAITING_TO_START:
-        if (currentTime >= outputStaggerStartTime[i]) {
-          DEBUG_PRINT("Output ");
-          DEBUG_PRINT(i);
-          DEBUG_PRINTLN(" starting full power phase");
-          outputStates[i] = OUTPUT_FULL_POWER;
-          outputStartTimes[i] = currentTime;
-          setOutput(i, 1.0);
+        // only the first waiting plug is considered each pass, and none before
+        // the boot delay is over; the one just started counts at full inrush
+        // until it has a reading
+        if (!admissionChecked && currentTime >= START_WAIT_MS) {
+          admissionChecked = true;
+          bool waitedLongest = (uint16_t)(currentTime - lastAdmissionMs) >= ADMISSION_MAX_WAIT_MS;
+          if (waitedLongest || getTotalLoadMilliamps() + PLUG_INRUSH_MA <= SUPPLY_CURRENT_BUDGET_MA) {
+            if (waitedLongest) {
+              DEBUG_LOG("Output %d starting full power phase (max wait)", i);
+            } else {
+              DEBUG_LOG("Output %d starting full power phase", i);
+            }
+            lastAdmissionMs = currentTime;
+            channel.state = OUTPUT_FULL_POWER;
+            channel.phaseStartMs = currentTime;
+            startTemperatureControl(i);
+            setOutput(i, DUTY_FULL);
+            traceBootEvent(BOOT_TRACE_HEAT_START, i);
+            
+            if (currentState == STATE_MEASURING) {
+              DEBUG_LOG("First plug heating");
+              currentState = STATE_FULL_POWER;
+              stateStartTime = halMillis();
+              setActiveIndication(true);
+            }
+          }
         }
         anyOutputActive = true; // Still considered active while waiting
         break;
         
       case OUTPUT_FULL_POWER:
-        if (outputElapsed >= FULL_POWER_DURATION_MS) {
-          DEBUG_PRINT("Output ");
-          DEBUG_PRINT(i);
-          DEBUG_PRINTLN(" switching to reduced power (60%)");
-          outputStates[i] = OUTPUT_REDUCED_POWER;
-          outputStartTimes[i] = currentTime; // Reset timer for reduced power phase
-          setOutput(i, REDUCED_DUTY_CYCLE);
+        // The temperature controller sets the duty; this only decides when the
+        // plug is up to temperature, or gives up waiting for it
+        if (readGlowPlugCurrent(i).estimatedTempQ4 >= TARGET_REACHED_Q4 ||
+            outputElapsed >= FULL_POWER_DURATION_MS) {
+          DEBUG_LOG("Output %d holding temperature after %ums", i, outputElapsed);
+          channel.state = OUTPUT_REDUCED_POWER;
           anyOutputActive = true; // Still active in reduced power mode
         } else {
           anyOutputActive = true;
@@ -89,23 +127,16 @@ void updateIndividualOutputs() {
         break;
         
       case OUTPUT_REDUCED_POWER:
-        {
-          // Calculate time spent in reduced power phase
-          unsigned long reducedPowerElapsed = currentTime - outputStartTimes[i];
-          unsigned long reducedPowerDuration = outputTotalDuration[i] - FULL_POWER_DURATION_MS;
-          
-          if (reducedPowerElapsed >= reducedPowerDuration) {
-            DEBUG_PRINT("Output ");
-            DEBUG_PRINT(i);
-            DEBUG_PRINTLN(" heating cycle complete");
-            outputStates[i] = OUTPUT_FINISHED;
-            setOutput(i, 0.0);
-          } else {
-            // Continue at 60% duty cycle
-            setOutput(i, REDUCED_DUTY_CYCLE);
-            anyOutputActive = true;
-            anyOutputInRampDown = true; // Consider this as "finishing phase"
-          }
+        // phaseStartMs is still when heating started, so reaching temperature
+        // early lengthens this phase rather than shortening the total
+        if (outputElapsed >= channel.totalDurationMs) {
+          DEBUG_LOG("Output %d heating cycle complete", i);
+          channel.state = OUTPUT_FINISHED;
+          setOutput(i, DUTY_OFF);
+        } else {
+          // Continue holding temperature
+          anyOutputActive = true;
+          anyOutputInRampDown = true; // Consider this as "finishing phase"
         }
         break;
         
@@ -116,35 +147,25 @@ void updateIndividualOutputs() {
   }
   
   // Update main state based on individual output states
-  if (currentState == STATE_FULL_POWER && !anyOutputActive && !anyOutputInRampDown) {
-    DEBUG_PRINTLN("All outputs finished - entering low power mode");
-    digitalWrite(LED_BUILTIN, LOW);
+  if ((currentState == STATE_MEASURING || currentState == STATE_FULL_POWER) &&
+      !anyOutputActive && !anyOutputInRampDown) {
+    DEBUG_LOG("All outputs finished - entering low power mode");
     enterLowPowerMode();
   }
 }
 
 void updateStateMachine() {
-  unsigned long currentTime = millis();
-  unsigned long elapsedTime = currentTime - stateStartTime;
-  
   switch (currentState) {
-    case STATE_BOOT_DELAY:
-      if (elapsedTime >= (START_WAIT_SECONDS * 1000)) {
-        DEBUG_PRINTLN("Boot delay complete - measuring initial temperatures");
-        measureInitialTemperatures();
-        
-        currentState = STATE_FULL_POWER;
-        stateStartTime = currentTime;
-        startFullPowerPhase();
-      }
-      break;
-      
+    case STATE_MEASURING:
     case STATE_FULL_POWER:
       updateIndividualOutputs();
       break;
       
+    case STATE_BOOT_DELAY:
+    case STATE_MEASURE_PAUSE:
+    case STATE_RAMP_DOWN:
     case STATE_IDLE:
     case STATE_LOW_POWER:
       break;
   }
-}
\ No newline at end of file
+}
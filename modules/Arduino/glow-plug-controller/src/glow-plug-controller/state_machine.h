@@ -3,11 +3,12 @@
 
 #include "config.h"
 
+const int STATE_MACHINE_PERIOD_MS = 10;
+
 // State machine functions
 void initializeStateMachine();
 void updateStateMachine();
 void enterLowPowerMode();
 void updateIndividualOutputs();
-void startFullPowerPhase();
 
 #endif
\ No newline at end of file
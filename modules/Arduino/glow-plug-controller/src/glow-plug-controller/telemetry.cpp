@@ -0,0 +1,74 @@
+#include "telemetry.h"
+#include "current_monitor.h"
+
+static uint8_t sequence = 0;
+static uint16_t droppedFrames = 0;
+
+void initializeTelemetry() {
+  sequence = 0;
+  droppedFrames = 0;
+}
+
+uint16_t telemetryChecksum(const uint8_t* data, int length) {
+  // Fletcher-16: far cheaper than a CRC on the AVR, and plenty for a serial link
+  uint16_t sum1 = 0;
+  uint16_t sum2 = 0;
+  // both sums stay below 255, so a conditional subtract replaces the modulo
+  for (int i = 0; i < length; i++) {
+    sum1 += data[i];
+    if (sum1 >= 255) sum1 -= 255;
+    sum2 += sum1;
+    if (sum2 >= 255) sum2 -= 255;
+  }
+  return (sum2 << 8) | sum1;
+}
+
+static uint8_t* putWord(uint8_t* p, uint16_t value) {
+  *p++ = value & 0xFF;
+  *p++ = value >> 8;
+  return p;
+}
+
+void sendTelemetry() {
+  // Never wait on the UART - if the frame doesn't fit, drop it
+  if (Serial.availableForWrite() < TELEMETRY_FRAME_SIZE) {
+    droppedFrames++;
+    return;
+  }
+
+  uint8_t frame[TELEMETRY_FRAME_SIZE];
+  uint8_t* p = frame;
+
+  *p++ = TELEMETRY_SYNC1;
+  *p++ = TELEMETRY_SYNC2;
+  *p++ = TELEMETRY_PAYLOAD_SIZE;
+  *p++ = sequence++;
+  p = putWord(p, (uint16_t)halMillis());
+  *p++ = (uint8_t)currentState;
+
+  uint8_t faulted = 0;
+  uint8_t enabled = 0;
+  for (Channel i : Channel::all()) {
+    if (glowChannels[i].faulted) faulted |= 1 << i;
+    if (glowChannels[i].enabled) enabled |= 1 << i;
+  }
+  *p++ = faulted;
+  *p++ = enabled;
+  p = putWord(p, droppedFrames);
+
+  for (Channel i : Channel::all()) {
+    CurrentReading reading = readGlowPlugCurrent(i);
+    *p++ = glowChannels[i].duty;
+    p = putWord(p, reading.milliamps);
+    p = putWord(p, (uint16_t)reading.estimatedTempQ4);
+  }
+
+  // checksum covers the length byte and payload
+  p = putWord(p, telemetryChecksum(frame + 2, TELEMETRY_PAYLOAD_SIZE + 1));
+
+  Serial.write(frame, TELEMETRY_FRAME_SIZE);
+}
+
+unsigned int getDroppedTelemetryFrames() {
+  return droppedFrames;
+}
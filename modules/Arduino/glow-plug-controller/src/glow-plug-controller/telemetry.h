@@ -0,0 +1,43 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "config.h"
+
+// Binary telemetry
+// One frame per loop pass, written only if it fits in the serial TX buffer
+// (which the UART interrupt drains), so it never blocks the control loop.
+// Frames that don't fit are counted and dropped.
+//
+// Frame layout, multi-byte fields little endian:
+//   0      0xA5 0x5A sync
+//   2      payload length (8 + 5 * channels)
+//   3      sequence number
+//   4      time, ms (low 16 bits)
+//   6      controller state
+//   7      faulted outputs, bit n = output n
+//   8      enabled outputs, bit n = output n
+//   9      dropped frame count (16 bits, wraps)
+//   11     per channel: duty (0-255), filtered current (mA, 16 bits), temperature (1/16 C, 16 bits)
+//   3+len  Fletcher-16 over the length byte and payload
+
+const uint8_t TELEMETRY_SYNC1 = 0xA5;
+const uint8_t TELEMETRY_SYNC2 = 0x5A;
+const int TELEMETRY_HEADER_SIZE = 3;           // sync + length
+const int TELEMETRY_FIXED_PAYLOAD_SIZE = 8;    // seq through dropped count
+const int TELEMETRY_CHANNEL_SIZE = 5;
+const int TELEMETRY_CHECKSUM_SIZE = 2;
+const int TELEMETRY_PAYLOAD_SIZE = TELEMETRY_FIXED_PAYLOAD_SIZE + TELEMETRY_CHANNEL_SIZE * NUM_OUTPUTS;
+const int TELEMETRY_FRAME_SIZE = TELEMETRY_HEADER_SIZE + TELEMETRY_PAYLOAD_SIZE + TELEMETRY_CHECKSUM_SIZE;
+
+static_assert(NUM_OUTPUTS <= 8, "fault/enable bitmasks are 8 bits");
+static_assert(TELEMETRY_FRAME_SIZE <= 64, "a frame has to fit in the serial TX buffer");
+
+const int TELEMETRY_PERIOD_MS = 10;
+
+// Function declarations
+void initializeTelemetry();
+void sendTelemetry();
+unsigned int getDroppedTelemetryFrames();
+uint16_t telemetryChecksum(const uint8_t* data, int length);
+
+#endif
@@ -0,0 +1,48 @@
+#include "temperature_control.h"
+#include "current_filter.h"
+#include "output_control.h"
+
+// Integral term per plug, in 1/4096 duty counts
+static int32_t integrators[NUM_OUTPUTS];
+
+void startTemperatureControl(Channel outputIndex) {
+  // Start from the configured holding duty so the plug doesn't sag while the
+  // integrator finds the real one
+  integrators[outputIndex] = (int32_t)DUTY_REDUCED << TEMP_CONTROL_SHIFT;
+}
+
+uint8_t runTemperatureControl(Channel outputIndex, tempq4_t temperatureQ4) {
+  int32_t error = (int32_t)TARGET_PLUG_TEMP_Q4 - temperatureQ4;
+  int32_t integral = integrators[outputIndex] + error * TEMP_CONTROL_KI_Q;
+  int32_t output = error * TEMP_CONTROL_KP_Q + integral;
+
+  // anti-windup: conditional integration
+  bool saturatedHigh = output >= TEMP_CONTROL_MAX;
+  bool saturatedLow = output <= TEMP_CONTROL_MIN;
+  if ((!saturatedHigh && !saturatedLow) || (saturatedHigh && error < 0) || (saturatedLow && error > 0)) {
+    integrators[outputIndex] = constrain(integral, 0L, TEMP_CONTROL_MAX);
+  }
+
+  output = constrain(output, TEMP_CONTROL_MIN, TEMP_CONTROL_MAX);
+  return (uint8_t)(output >> TEMP_CONTROL_SHIFT);
+}
+
+void updateTemperatureControl() {
+  for (Channel i : Channel::all()) {
+    OutputState state = (OutputState)glowChannels[i].state;
+    if (state != OUTPUT_FULL_POWER && state != OUTPUT_REDUCED_POWER) {
+      continue;
+    }
+    if (!isOutputEnabled(i)) {
+      continue;
+    }
+
+    // keep the current duty until the filter has something to go on
+    CurrentReading reading = readGlowPlugCurrent(i);
+    if (!reading.isValid || reading.sampleCount < FILTER_OVERSAMPLE) {
+      continue;
+    }
+
+    setOutput(i, runTemperatureControl(i, reading.estimatedTempQ4));
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef TEMPERATURE_CONTROL_H
+#define TEMPERATURE_CONTROL_H
+
+#include "config.h"
+#include "fixed_point.h"
+#include "current_monitor.h"
+
+// Closed loop temperature regulation
+// A PI controller per plug drives the filtered temperature estimate toward
+// TARGET_PLUG_TEMP at a fixed rate.  A cold plug saturates at full duty, so it
+// heats as fast as before, then the duty backs off as it nears the target
+// instead of switching to a fixed reduced duty after a fixed time.
+//
+// Integer math throughout: the error is in 1/16 C, the output in 1/4096 of a
+// duty count.  The integrator only moves while the output is not saturated
+// (or when the error pulls it back out), so it can't wind up during the
+// full power heat or while a plug cools from above the target.
+
+const int TEMPERATURE_CONTROL_PERIOD_MS = 20;
+
+constexpr float TEMP_CONTROL_KP = 2.0;  // duty counts (of 255) per C of error
+constexpr float TEMP_CONTROL_KI = 4.0;  // duty counts per C of error per second
+constexpr float TARGET_REACHED_BAND = 10.0;  // heating is done within this of the target
+
+const int TEMP_CONTROL_SHIFT = 12;
+constexpr int32_t TEMP_CONTROL_ONE = 1L << TEMP_CONTROL_SHIFT;
+constexpr int32_t TEMP_CONTROL_MAX = 255L << TEMP_CONTROL_SHIFT;
+// Never below the measurement duty: with the output fully off the sense line
+// reads nothing and the controller would lose track of the plug
+constexpr int32_t TEMP_CONTROL_MIN = (int32_t)MEASURE_DUTY << TEMP_CONTROL_SHIFT;
+constexpr int32_t TEMP_CONTROL_KP_Q = (int32_t)(TEMP_CONTROL_KP / TEMP_Q4_ONE * TEMP_CONTROL_ONE + 0.5);
+constexpr int32_t TEMP_CONTROL_KI_Q =
+  (int32_t)(TEMP_CONTROL_KI * TEMPERATURE_CONTROL_PERIOD_MS / 1000.0 / TEMP_Q4_ONE * TEMP_CONTROL_ONE + 0.5);
+static_assert(TEMP_CONTROL_KI_Q > 0, "integral gain too small for the fixed point scale");
+
+constexpr tempq4_t TARGET_PLUG_TEMP_Q4 = (tempq4_t)(TARGET_PLUG_TEMP * TEMP_Q4_ONE);
+constexpr tempq4_t TARGET_REACHED_Q4 = (tempq4_t)((TARGET_PLUG_TEMP - TARGET_REACHED_BAND) * TEMP_Q4_ONE);
+static_assert(TARGET_PLUG_TEMP < MAX_ESTIMATED_TEMP, "target must be below the estimate clamp");
+
+// Function declarations
+void startTemperatureControl(Channel outputIndex);
+uint8_t runTemperatureControl(Channel outputIndex, tempq4_t temperatureQ4);
+void updateTemperatureControl();
+
+#endif
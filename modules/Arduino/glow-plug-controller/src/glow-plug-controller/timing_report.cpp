@@ -0,0 +1,125 @@
+#include "timing_report.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "adc_sampler.h"
+
+static_assert(TIMING_LOOP_PAYLOAD_SIZE == 11 + 2 * LOOP_HISTOGRAM_BUCKETS, "loop frame layout");
+
+// Largest payload of each frame type; the frame buffer holds any of them
+const int TIMING_TASK_PAYLOAD_SIZE = TIMING_TASK_FIXED_PAYLOAD_SIZE + TIMING_MAX_NAME;
+const int TIMING_SAMPLING_PAYLOAD_SIZE = TIMING_SAMPLING_HEADER_SIZE + TIMING_SAMPLING_INPUT_SIZE * NUM_INPUTS;
+const int TIMING_MAX_PAYLOAD_SIZE =
+  TIMING_LOOP_PAYLOAD_SIZE > TIMING_TASK_PAYLOAD_SIZE
+    ? (TIMING_LOOP_PAYLOAD_SIZE > TIMING_SAMPLING_PAYLOAD_SIZE ? TIMING_LOOP_PAYLOAD_SIZE : TIMING_SAMPLING_PAYLOAD_SIZE)
+    : (TIMING_TASK_PAYLOAD_SIZE > TIMING_SAMPLING_PAYLOAD_SIZE ? TIMING_TASK_PAYLOAD_SIZE : TIMING_SAMPLING_PAYLOAD_SIZE);
+static_assert(TIMING_LOOP_PAYLOAD_SIZE <= TIMING_MAX_PAYLOAD_SIZE &&
+              TIMING_TASK_PAYLOAD_SIZE <= TIMING_MAX_PAYLOAD_SIZE &&
+              TIMING_SAMPLING_PAYLOAD_SIZE <= TIMING_MAX_PAYLOAD_SIZE, "timing frame buffer too small");
+static_assert(TIMING_MAX_PAYLOAD_SIZE <= 255, "timing frame length doesn't fit its byte");
+
+// Next frame of a report in progress: -1 for none, 0 for the loop frame, then
+// one per task and the sampling frame
+static int nextFrame = -1;
+static bool resetAfterReport = false;
+
+void initializeTimingReport() {
+  nextFrame = -1;
+  resetAfterReport = false;
+}
+
+static uint8_t* putWord(uint8_t* p, uint16_t value) {
+  *p++ = value & 0xFF;
+  *p++ = value >> 8;
+  return p;
+}
+
+static int buildLoopFrame(uint8_t* payload) {
+  LoopStats stats = getLoopStats();
+  uint8_t* p = payload;
+  *p++ = TIMING_FRAME_LOOP;
+  p = putWord(p, stats.passes & 0xFFFF);
+  p = putWord(p, stats.passes >> 16);
+  p = putWord(p, stats.minPeriodUs);
+  p = putWord(p, stats.maxPeriodUs);
+  p = putWord(p, stats.meanPeriodUs);
+  for (int i = 0; i < LOOP_HISTOGRAM_BUCKETS; i++) {
+    p = putWord(p, stats.histogram[i]);
+  }
+  return p - payload;
+}
+
+static int buildTaskFrame(uint8_t* payload, int index) {
+  const ScheduledTask* task = getScheduledTask(index);
+  uint8_t* p = payload;
+  *p++ = TIMING_FRAME_TASK;
+  *p++ = index;
+  p = putWord(p, task->runs);
+  p = putWord(p, task->deadlineMisses);
+  p = putWord(p, task->maxLatenessMs);
+  p = putWord(p, task->runs ? task->minCostUs : 0);
+  p = putWord(p, task->maxCostUs);
+  p = putWord(p, task->runs ? task->totalCostUs / task->runs : 0);
+  for (int i = 0; i < TIMING_MAX_NAME && task->name[i]; i++) {
+    *p++ = task->name[i];
+  }
+  return p - payload;
+}
+
+static int buildSamplingFrame(uint8_t* payload) {
+  uint8_t* p = payload;
+  *p++ = TIMING_FRAME_SAMPLING;
+  *p++ = HAL_ADC_CONVERSION_US;
+  for (Channel i : Channel::all()) {
+    ChannelSampling sampling = getChannelSampling(i);
+    *p++ = sampling.priority;
+    *p++ = sampling.slots;
+    *p++ = sampling.worstGap;
+  }
+  return p - payload;
+}
+
+void serviceTimingQuery() {
+  if (nextFrame < 0) {
+    while (Serial.available() > 0) {
+      int command = Serial.read();
+      if (command == TIMING_QUERY || command == TIMING_RESET) {
+        nextFrame = 0;
+        resetAfterReport = (command == TIMING_RESET);
+      }
+    }
+    if (nextFrame < 0) {
+      return;
+    }
+  }
+
+  uint8_t frame[TELEMETRY_HEADER_SIZE + TIMING_MAX_PAYLOAD_SIZE + TELEMETRY_CHECKSUM_SIZE];
+  uint8_t* payload = frame + TELEMETRY_HEADER_SIZE;
+  int length;
+  if (nextFrame == 0) {
+    length = buildLoopFrame(payload);
+  } else if (nextFrame <= getScheduledTaskCount()) {
+    length = buildTaskFrame(payload, nextFrame - 1);
+  } else {
+    length = buildSamplingFrame(payload);
+  }
+  int frameSize = TELEMETRY_HEADER_SIZE + length + TELEMETRY_CHECKSUM_SIZE;
+
+  // Never wait on the UART - try again next period
+  if (Serial.availableForWrite() < frameSize) {
+    return;
+  }
+
+  frame[0] = TELEMETRY_SYNC1;
+  frame[1] = TIMING_SYNC2;
+  frame[2] = length;
+  putWord(payload + length, telemetryChecksum(frame + 2, length + 1));
+  Serial.write(frame, frameSize);
+
+  nextFrame++;
+  if (nextFrame > getScheduledTaskCount() + 1) {
+    nextFrame = -1;
+    if (resetAfterReport) {
+      resetSchedulerStats();
+    }
+  }
+}
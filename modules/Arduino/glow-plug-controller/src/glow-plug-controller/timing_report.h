@@ -0,0 +1,63 @@
+#ifndef TIMING_REPORT_H
+#define TIMING_REPORT_H
+
+#include "config.h"
+
+// Timing report on request
+// Send one byte on the serial port - TIMING_QUERY for a report, TIMING_RESET
+// for a report followed by clearing the counters - and the controller answers
+// with the scheduler's timing counters (scheduler.h).  Nothing is sent, and
+// only one available() check per period is spent, unless someone asks.
+//
+// The report is one loop frame, one frame per task, then a sampling frame with
+// each current-sense input's share of the ADC schedule (adc_sampler.h).  A frame is
+// only written when it fits in the serial TX buffer, like the telemetry, so the
+// report never blocks the control loop; it just takes a few periods to go out.
+// The framing matches telemetry.h with a different second sync byte, so both
+// can share the port and host/telemetry-decode reads both.
+//
+// Frame layout, multi-byte fields little endian:
+//   0      0xA5 0x5B sync
+//   2      payload length
+//   3      frame type (TimingFrameType)
+//   loop frame:
+//   4      loop passes (32 bits)
+//   8      loop period min, max, mean (us, 16 bits each)
+//   14     period histogram, LOOP_HISTOGRAM_BUCKETS x 16 bit counts
+//   task frame:
+//   4      task index
+//   5      runs (16 bits)
+//   7      deadline misses (16 bits)
+//   9      worst lateness (ms, 16 bits)
+//   11     execution time min, max, mean (us, 16 bits each)
+//   17     task name (the rest of the payload, not terminated)
+//   sampling frame:
+//   4      conversion time (us)
+//   5      per input: SamplingPriority, samples per cycle of NUM_INPUTS
+//          conversions, most conversions from one sample to the next
+//   3+len  Fletcher-16 over the length byte and payload
+
+const uint8_t TIMING_QUERY = 'T';
+const uint8_t TIMING_RESET = 'R';
+
+const uint8_t TIMING_SYNC2 = 0x5B;   // first sync byte is TELEMETRY_SYNC1
+
+enum TimingFrameType {
+  TIMING_FRAME_LOOP = 0,
+  TIMING_FRAME_TASK = 1,
+  TIMING_FRAME_SAMPLING = 2
+};
+
+const int TIMING_LOOP_PAYLOAD_SIZE = 11 + 2 * 8;  // 8 = LOOP_HISTOGRAM_BUCKETS
+const int TIMING_TASK_FIXED_PAYLOAD_SIZE = 14;
+const int TIMING_MAX_NAME = 12;
+const int TIMING_SAMPLING_HEADER_SIZE = 2;
+const int TIMING_SAMPLING_INPUT_SIZE = 3;
+
+const int TIMING_QUERY_PERIOD_MS = 20;
+
+// Function declarations
+void initializeTimingReport();
+void serviceTimingQuery();
+
+#endif
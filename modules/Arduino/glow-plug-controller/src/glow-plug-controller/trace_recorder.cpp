@@ -0,0 +1,165 @@
+#include "trace_recorder.h"
+#include "overcurrent_trip.h"
+
+// Filled by the ADC interrupt.  The head and tail are free running counters
+// (the ring size divides 256), so head - tail is the number of samples held.
+static volatile uint16_t ring[TRACE_RING_SIZE];
+static volatile uint8_t ringHead = 0;
+static volatile uint8_t ringTail = 0;
+static volatile uint16_t conversions = 0;  // including any the ring had no room for
+static volatile bool overflowed = false;
+
+static bool recording = false;
+static bool snapshotTaken = false;
+static uint16_t samplesWritten = 0;
+static uint8_t lastState;
+static uint8_t lastDuty[NUM_OUTPUTS];
+static uint8_t lastFlags[NUM_OUTPUTS];
+
+void initializeTraceRecorder() {
+  ringHead = 0;
+  ringTail = 0;
+  conversions = 0;
+  overflowed = false;
+  snapshotTaken = false;
+  samplesWritten = 0;
+
+  const uint8_t start[TRACE_START_SIZE] = {
+    TRACE_MAGIC1, TRACE_MAGIC2, TRACE_VERSION, NUM_INPUTS, (uint8_t)HAL_ADC_CONVERSION_US
+  };
+  Serial.write(start, TRACE_START_SIZE);
+  recording = true;
+}
+
+void traceAdcSample(Channel input, uint16_t value) {
+  conversions++;
+  if (overflowed) {
+    return;
+  }
+  uint8_t head = ringHead;
+  if ((uint8_t)(head - ringTail) >= TRACE_RING_SIZE) {
+    overflowed = true;
+    return;
+  }
+  ring[head & (TRACE_RING_SIZE - 1)] = value | (uint16_t)input << TRACE_INPUT_SHIFT;
+  ringHead = head + 1;
+}
+
+static uint16_t traceTime() {
+  uint8_t sreg = halEnterCritical();
+  uint16_t time = conversions;
+  halExitCritical(sreg);
+  return time;
+}
+
+static uint8_t outputFlags(Channel i) {
+  const GlowChannel& channel = glowChannels[i];
+  uint8_t flags = channel.state & TRACE_OUTPUT_STATE_MASK;
+  if (channel.enabled) flags |= TRACE_OUTPUT_ENABLED;
+  if (channel.faulted) flags |= TRACE_OUTPUT_FAULTED;
+  if (isOutputTripped(i)) flags |= TRACE_OUTPUT_TRIPPED;
+  return flags;
+}
+
+// A change that doesn't fit in the TX buffer is left for the next run, which
+// will see it is still different from what was last written
+static void traceChanges() {
+  uint16_t time = traceTime();
+  bool complete = true;
+
+  if (!snapshotTaken || currentState != lastState) {
+    if (Serial.availableForWrite() >= TRACE_STATE_SIZE) {
+      uint8_t record[TRACE_STATE_SIZE] = {
+        TRACE_RECORD_STATE, (uint8_t)(time & 0xFF), (uint8_t)(time >> 8), (uint8_t)currentState
+      };
+      Serial.write(record, TRACE_STATE_SIZE);
+      lastState = currentState;
+    } else {
+      complete = false;
+    }
+  }
+
+  for (Channel i : Channel::all()) {
+    uint8_t duty = glowChannels[i].duty;
+    uint8_t flags = outputFlags(i);
+    if (snapshotTaken && duty == lastDuty[i] && flags == lastFlags[i]) {
+      continue;
+    }
+    if (Serial.availableForWrite() < TRACE_OUTPUT_SIZE) {
+      complete = false;
+      break;
+    }
+    uint8_t record[TRACE_OUTPUT_SIZE] = {
+      TRACE_RECORD_OUTPUT, (uint8_t)(time & 0xFF), (uint8_t)(time >> 8), (uint8_t)i, duty, flags
+    };
+    Serial.write(record, TRACE_OUTPUT_SIZE);
+    lastDuty[i] = duty;
+    lastFlags[i] = flags;
+  }
+
+  if (complete) {
+    snapshotTaken = true;
+  }
+}
+
+static void traceSamples() {
+  for (;;) {
+    uint8_t held = ringHead - ringTail;
+    uint8_t groups = held / TRACE_GROUP_SAMPLES;
+    if (groups == 0) {
+      break;
+    }
+    if (groups > TRACE_MAX_GROUPS) {
+      groups = TRACE_MAX_GROUPS;
+    }
+    int size = TRACE_SAMPLES_HEADER_SIZE + groups * TRACE_GROUP_SIZE;
+    if (Serial.availableForWrite() < size) {
+      return;
+    }
+
+    // the interrupt doesn't touch slots between the tail and the head
+    uint8_t record[TRACE_SAMPLES_HEADER_SIZE + TRACE_MAX_GROUPS * TRACE_GROUP_SIZE];
+    uint8_t* p = record;
+    *p++ = TRACE_RECORD_SAMPLES;
+    *p++ = groups;
+    uint8_t tail = ringTail;
+    for (uint8_t g = 0; g < groups; g++) {
+      uint8_t high = 0;
+      uint16_t inputs = 0;
+      for (uint8_t n = 0; n < TRACE_GROUP_SAMPLES; n++) {
+        uint16_t entry = ring[tail++ & (TRACE_RING_SIZE - 1)];
+        *p++ = entry & 0xFF;
+        high |= ((entry >> 8) & 0x03) << (2 * n);
+        inputs |= (entry >> TRACE_INPUT_SHIFT) << (4 * n);
+      }
+      *p++ = high;
+      *p++ = inputs & 0xFF;
+      *p++ = inputs >> 8;
+    }
+    ringTail = tail;
+    samplesWritten += groups * TRACE_GROUP_SAMPLES;
+    Serial.write(record, size);
+  }
+
+  // The ring only stops filling on an overflow, so once it has been emptied
+  // (short of a part group) the trace ends at the first sample it missed
+  if (overflowed && Serial.availableForWrite() >= TRACE_OVERFLOW_SIZE) {
+    uint8_t record[TRACE_OVERFLOW_SIZE] = {
+      TRACE_RECORD_OVERFLOW, (uint8_t)(samplesWritten & 0xFF), (uint8_t)(samplesWritten >> 8)
+    };
+    Serial.write(record, TRACE_OVERFLOW_SIZE);
+    recording = false;
+  }
+}
+
+void updateTraceRecorder() {
+  if (!recording) {
+    return;
+  }
+  traceChanges();
+  traceSamples();
+}
+
+bool isTraceRecording() {
+  return recording;
+}
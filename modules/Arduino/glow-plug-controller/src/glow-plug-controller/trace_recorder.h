@@ -0,0 +1,83 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include "config.h"
+
+// Trace recorder for replaying bench runs on the host
+// With TRACE_RECORD the serial port carries a trace of the run instead of
+// telemetry: every ADC conversion result, in order, and every change to the
+// controller's decisions - its state, and per plug the PWM duty, heating phase
+// and enabled/faulted/tripped flags.  host/trace-replay feeds the samples back
+// through the unmodified controller and checks it decides the same things.
+//
+// The ADC interrupt puts each result in a small ring; the trace task packs
+// them into records and writes them only if they fit in the serial TX buffer,
+// like the telemetry.  If the ring fills anyway the recorder writes an
+// overflow record and stops, since the rest of the trace couldn't be replayed.
+//
+// The ADC is the trace's clock: times are the number of conversions completed
+// (low 16 bits), HAL_ADC_CONVERSION_US apart.  The samples carry no time, but
+// each carries its input, since the sampler's schedule follows the channel
+// states (adc_sampler.h) and so moves with the loop's timing.
+//
+// Record layout, multi-byte fields little endian:
+//   start     'G' 'T' version, input count, conversion time (us)
+//   samples   type, group count, then per group of 4 samples the low 8 bits
+//             of each, a byte with their top 2 bits (sample n in bits 2n) and
+//             16 bits of their inputs (sample n in bits 4n)
+//   state     type, time (16 bits), controller state
+//   output    type, time (16 bits), channel, duty, flags (TraceOutputFlags)
+//   overflow  type, time (16 bits)
+// The first trace task run writes a state record and one output record per
+// plug; after that only changes are written.
+//
+// The timing query works in this build too: its frames (timing_report.h) go
+// out between records.  They start with TELEMETRY_SYNC1, which no record type
+// is, and carry their length, so a reader skips them (trace-replay does) or
+// picks them out (telemetry-decode does).
+//
+// At 500000 baud the samples take about 40% of the link.
+
+const uint8_t TRACE_MAGIC1 = 'G';
+const uint8_t TRACE_MAGIC2 = 'T';
+const uint8_t TRACE_VERSION = 3;
+
+enum TraceRecordType {
+  TRACE_RECORD_SAMPLES = 1,
+  TRACE_RECORD_STATE = 2,
+  TRACE_RECORD_OUTPUT = 3,
+  TRACE_RECORD_OVERFLOW = 4
+};
+
+enum TraceOutputFlags {
+  TRACE_OUTPUT_STATE_MASK = 0x07,   // OutputState
+  TRACE_OUTPUT_ENABLED = 0x08,
+  TRACE_OUTPUT_FAULTED = 0x10,
+  TRACE_OUTPUT_TRIPPED = 0x20
+};
+
+const int TRACE_START_SIZE = 5;
+const int TRACE_GROUP_SAMPLES = 4;
+const int TRACE_GROUP_SIZE = 7;
+const int TRACE_MAX_GROUPS = 4;       // per samples record
+const int TRACE_SAMPLES_HEADER_SIZE = 2;
+const int TRACE_STATE_SIZE = 4;
+const int TRACE_OUTPUT_SIZE = 6;
+const int TRACE_OVERFLOW_SIZE = 3;
+
+const int TRACE_RING_SIZE = 64;       // samples, must be a power of 2
+const uint8_t TRACE_INPUT_SHIFT = 10; // a ring entry is the sample and its input above it
+
+const int TRACE_PERIOD_MS = 2;
+
+static_assert(TRACE_RING_SIZE >= 2 * TRACE_PERIOD_MS * 1000UL / HAL_ADC_CONVERSION_US,
+              "the ring has to hold two trace periods of samples");
+static_assert(NUM_INPUTS <= 16, "inputs are traced in 4 bits");
+
+// Function declarations
+void initializeTraceRecorder();
+void traceAdcSample(Channel input, uint16_t value);   // interrupt context
+void updateTraceRecorder();
+bool isTraceRecording();   // false once the ring has overflowed
+
+#endif
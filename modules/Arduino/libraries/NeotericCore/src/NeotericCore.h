@@ -0,0 +1,19 @@
+#ifndef NEOTERIC_CORE_H
+#define NEOTERIC_CORE_H
+
+// Neoteric embedded core
+// Header only building blocks shared by the modules under modules/Arduino.
+// Everything is constexpr or a template, so scale factors and pin numbers are
+// worked out by the compiler and cost nothing at run time.  Nothing here
+// depends on the Arduino core, so the host builds use it as is.
+//
+// The debug print macros are in neoteric/debug.h, which is included on its
+// own, after DEBUG is decided.
+
+#include "neoteric/adc.h"
+#include "neoteric/channel_set.h"
+#include "neoteric/divider.h"
+#include "neoteric/fixed_point.h"
+#include "neoteric/pwm.h"
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef NEOTERIC_ADC_H
+#define NEOTERIC_ADC_H
+
+#include <stdint.h>
+
+namespace neoteric {
+
+// An ADC with a Bits wide result and a VrefMillivolts reference
+//   typedef neoteric::Adc<10, 5000> BoardAdc;   // Uno, AVcc reference
+//   BoardAdc::volts(512)    2.5
+//   BoardAdc::code(1.08)    221
+// A code stands for the bottom of its step, Vref / 2^Bits wide, as in the
+// AVR datasheet.  code() rounds to the nearest step and clamps to the range.
+template <int Bits, long VrefMillivolts>
+struct Adc {
+  static_assert(Bits > 0 && Bits <= 16, "ADC result must fit 16 bits");
+  static_assert(VrefMillivolts > 0, "reference must be positive");
+
+  static constexpr int BITS = Bits;
+  static constexpr long STEPS = 1L << Bits;
+  static constexpr uint16_t MAX_CODE = (uint16_t)(STEPS - 1);
+  static constexpr float VREF = VrefMillivolts / 1000.0f;
+  static constexpr float VOLTS_PER_CODE = VREF / STEPS;
+
+  static constexpr float volts(uint16_t code) {
+    return code * VOLTS_PER_CODE;
+  }
+
+  static constexpr uint16_t code(float volts) {
+    return volts <= 0 ? 0
+         : volts / VOLTS_PER_CODE + 0.5f >= MAX_CODE ? MAX_CODE
+         : (uint16_t)(volts / VOLTS_PER_CODE + 0.5f);
+  }
+};
+
+template <int Bits, long VrefMillivolts> constexpr int Adc<Bits, VrefMillivolts>::BITS;
+template <int Bits, long VrefMillivolts> constexpr long Adc<Bits, VrefMillivolts>::STEPS;
+template <int Bits, long VrefMillivolts> constexpr uint16_t Adc<Bits, VrefMillivolts>::MAX_CODE;
+template <int Bits, long VrefMillivolts> constexpr float Adc<Bits, VrefMillivolts>::VREF;
+template <int Bits, long VrefMillivolts> constexpr float Adc<Bits, VrefMillivolts>::VOLTS_PER_CODE;
+
+}  // namespace neoteric
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef NEOTERIC_CHANNEL_SET_H
+#define NEOTERIC_CHANNEL_SET_H
+
+#include <stdint.h>
+
+namespace neoteric {
+
+// Index of one of Count channels, which is always in range
+// There is no way to make one from a plain int without going through
+// fromInt(), so functions that take a ChannelIndex don't need to check it.
+// Loops go through all():
+//   for (Channel channel : Channel::all()) { ... }
+// and fixed channels through at<N>(), which is checked by the compiler.  It
+// converts to uint8_t, so it indexes arrays and prints like a number.
+template <int Count>
+class ChannelIndex {
+public:
+  static_assert(Count > 0 && Count <= 255, "1 to 255 channels");
+
+  static constexpr int COUNT = Count;
+
+  template <int Index>
+  static constexpr ChannelIndex at() {
+    static_assert(Index >= 0 && Index < Count, "channel out of range");
+    return ChannelIndex(Index);
+  }
+
+  static constexpr ChannelIndex first() {
+    return ChannelIndex(0);
+  }
+
+  // For an index from outside the program (a command, a log record): false
+  // if it is out of range
+  static bool fromInt(int index, ChannelIndex& channel) {
+    if (index < 0 || index >= Count) {
+      return false;
+    }
+    channel = ChannelIndex(index);
+    return true;
+  }
+
+  constexpr operator uint8_t() const {
+    return value;
+  }
+
+  // The channel after this one, back to the first after the last
+  constexpr ChannelIndex nextWrapped() const {
+    return ChannelIndex(value + 1 >= Count ? 0 : value + 1);
+  }
+
+  // Range for loops
+  class Iterator {
+  public:
+    ChannelIndex operator*() const { return ChannelIndex(value); }
+    Iterator& operator++() { value++; return *this; }
+    bool operator!=(const Iterator& other) const { return value != other.value; }
+  private:
+    friend class ChannelIndex;
+    explicit constexpr Iterator(uint8_t value) : value(value) {}
+    uint8_t value;
+  };
+
+  class Range {
+  public:
+    constexpr Iterator begin() const { return Iterator(0); }
+    constexpr Iterator end() const { return Iterator(Count); }
+  };
+
+  static constexpr Range all() {
+    return Range();
+  }
+
+private:
+  explicit constexpr ChannelIndex(uint8_t value) : value(value) {}
+  uint8_t value;
+};
+
+template <int Count> constexpr int ChannelIndex<Count>::COUNT;
+
+// A fixed set of pins, one per channel
+//   typedef neoteric::ChannelSet<3, 5, 6, 9, 10, 11> OutputPins;
+//   OutputPins::COUNT                 6
+//   OutputPins::pin(channel)          pin of a ChannelIndex, no range check
+//   OutputPins::pin<2>()              6, at compile time
+//   OutputPins::contains(13)          false, at compile time
+// Sets with the same number of pins share an index type, so one channel can
+// stand for a pin in each (an output and the input that senses it).
+template <int... Pins>
+struct ChannelSet {
+  static constexpr int COUNT = sizeof...(Pins);
+  typedef ChannelIndex<COUNT> Index;
+
+  static constexpr uint8_t PINS[COUNT] = {Pins...};
+
+  static constexpr uint8_t pin(Index channel) {
+    return PINS[channel];
+  }
+
+  template <int Channel>
+  static constexpr uint8_t pin() {
+    return PINS[(uint8_t)Index::template at<Channel>()];
+  }
+
+  // true if pin is in the set, e.g. to check another use of a pin at compile time
+  static constexpr bool contains(int pin, int from = 0) {
+    return from < COUNT && (PINS[from] == pin || contains(pin, from + 1));
+  }
+};
+
+template <int... Pins> constexpr int ChannelSet<Pins...>::COUNT;
+template <int... Pins> constexpr uint8_t ChannelSet<Pins...>::PINS[];
+
+}  // namespace neoteric
+
+#endif
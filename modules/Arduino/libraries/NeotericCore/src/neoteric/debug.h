@@ -0,0 +1,15 @@
+#ifndef NEOTERIC_DEBUG_H
+#define NEOTERIC_DEBUG_H
+
+// Debug print macros.  If DEBUG is not defined, they do nothing.  Include this
+// after DEBUG is (or isn't) defined; it goes to whatever Serial is.
+
+#ifdef DEBUG
+  #define DEBUG_PRINT(x) Serial.print(x)
+  #define DEBUG_PRINTLN(x) Serial.println(x)
+#else
+  #define DEBUG_PRINT(x)
+  #define DEBUG_PRINTLN(x)
+#endif
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef NEOTERIC_DIVIDER_H
+#define NEOTERIC_DIVIDER_H
+
+namespace neoteric {
+
+// Resistor divider, R1 from the input to the tap and R2 from the tap to ground
+//   typedef neoteric::Divider<4700, 1500> SenseDivider;
+//   SenseDivider::inputVolts(1.2)     4.96, what the tap reading means
+//   SenseDivider::outputVolts(12.0)   2.90, what the tap sees
+template <long R1, long R2>
+struct Divider {
+  static_assert(R1 >= 0 && R2 > 0, "R2 is needed for a divider");
+
+  static constexpr float RATIO = (float)R2 / (R1 + R2);   // tap / input
+
+  static constexpr float outputVolts(float inputVolts) {
+    return inputVolts * R2 / (R1 + R2);
+  }
+
+  static constexpr float inputVolts(float outputVolts) {
+    return outputVolts * (R1 + R2) / R2;
+  }
+};
+
+template <long R1, long R2> constexpr float Divider<R1, R2>::RATIO;
+
+}  // namespace neoteric
+
+#endif
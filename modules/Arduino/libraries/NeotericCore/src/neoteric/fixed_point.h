@@ -0,0 +1,47 @@
+#ifndef NEOTERIC_FIXED_POINT_H
+#define NEOTERIC_FIXED_POINT_H
+
+#include <stdint.h>
+
+namespace neoteric {
+
+// Fixed point scheme: values carried in a Raw integer with FracBits fraction
+// bits.  The values themselves stay plain integers (so they pack into structs
+// and go out over telemetry as they are); this is the scale that goes with
+// them, and the compile time conversions.
+//   typedef neoteric::Fixed<int16_t, 4> TempQ4;   // 1/16 degree steps
+//   TempQ4::Raw ambient = TempQ4::fromFloat(25.0);   // 400
+//   TempQ4::toInt(ambient)                         // 25
+template <typename Raw_, int FracBits>
+struct Fixed {
+  typedef Raw_ Raw;
+  static_assert(FracBits >= 0 && FracBits < (int)(8 * sizeof(Raw_)), "fraction bits must fit the raw type");
+
+  static constexpr int FRAC_BITS = FracBits;
+  static constexpr Raw ONE = (Raw)((Raw)1 << FracBits);
+
+  // Rounds to the nearest step
+  static constexpr Raw fromFloat(float value) {
+    return (Raw)(value * ONE + (value < 0 ? -0.5f : 0.5f));
+  }
+
+  static constexpr Raw fromInt(long value) {
+    return (Raw)(value * ONE);
+  }
+
+  static constexpr float toFloat(Raw raw) {
+    return (float)raw / ONE;
+  }
+
+  // Whole part, rounded towards zero
+  static constexpr long toInt(Raw raw) {
+    return (long)raw / ONE;
+  }
+};
+
+template <typename Raw, int FracBits> constexpr int Fixed<Raw, FracBits>::FRAC_BITS;
+template <typename Raw, int FracBits> constexpr typename Fixed<Raw, FracBits>::Raw Fixed<Raw, FracBits>::ONE;
+
+}  // namespace neoteric
+
+#endif
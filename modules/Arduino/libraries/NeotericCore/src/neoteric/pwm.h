@@ -0,0 +1,36 @@
+#ifndef NEOTERIC_PWM_H
+#define NEOTERIC_PWM_H
+
+namespace neoteric {
+
+// PWM duty for a timer that counts to Top, driving a pin from a
+// VrefMillivolts supply.  analogWrite() is Pwm<255>.
+//   neoteric::Pwm<255>::fromFraction(0.6)   153
+//   neoteric::Pwm<1023>::fromVolts(1.5)     307
+// Rounds to the nearest step and clamps to 0 - Top.
+template <int Top, long VrefMillivolts = 5000>
+struct Pwm {
+  static_assert(Top > 0, "PWM needs at least two levels");
+
+  static constexpr int TOP = Top;
+  static constexpr float VREF = VrefMillivolts / 1000.0f;
+
+  static constexpr int fromFraction(float fraction) {
+    return fraction <= 0 ? 0 : fraction >= 1 ? Top : (int)(fraction * Top + 0.5f);
+  }
+
+  static constexpr int fromVolts(float volts) {
+    return fromFraction(volts / VREF);
+  }
+
+  static constexpr float volts(int duty) {
+    return duty * VREF / Top;
+  }
+};
+
+template <int Top, long VrefMillivolts> constexpr int Pwm<Top, VrefMillivolts>::TOP;
+template <int Top, long VrefMillivolts> constexpr float Pwm<Top, VrefMillivolts>::VREF;
+
+}  // namespace neoteric
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host stand-in for the Arduino core
+// Just enough of it to build t-case-switch-converter.ino on Linux: a virtual
+// microsecond clock that only moves in delay() and sleepUntilInterrupt(),
+// analog inputs that the host code sets (now or at a scheduled time), PWM
+// outputs that it can read back or watch, and a serial port that writes to
+// stdout (or nowhere).  Nothing here is compiled for the board.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define LED_BUILTIN 13
+
+#define HOST_NUM_PINS 20
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int analogRead(int pin);
+void analogWrite(int pin, int value);
+
+// There is no real concurrency: the simulated interrupts only fire while the
+// virtual clock is being advanced
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// The sketch's background sampling, sleep and Timer1 output, which are
+// register code on the board.  Timer0 overflows every HOST_TIMER0_PERIOD_US;
+// once sampling is started each overflow starts a conversion of the selected
+// pin, and HOST_ADC_CONVERSION_US later onAdcConversion() gets the value the
+// pin had when it started.  Sleeping advances the clock to the next interrupt.
+// The Timer1 output is OC1A, D9.
+const unsigned long HOST_TIMER0_PERIOD_US = 1024;
+const unsigned long HOST_ADC_CONVERSION_US = 104;
+const int HOST_TIMER1_OUTPUT_PIN = 9;
+
+void startInputSampling(int pin);
+void selectSamplingPin(int pin);
+void sleepUntilInterrupt();
+void onAdcConversion(int adcValue);  // supplied by the sketch
+void startHighResOutput(int top);
+void writeHighResOutput(int value);
+
+class HostSerial {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  size_t print(const char* s);
+  size_t print(int n);
+  size_t print(unsigned int n);
+  size_t print(long n);
+  size_t print(unsigned long n);
+  size_t print(double n, int digits = 2);
+
+  template <typename T> size_t println(T value) {
+    size_t n = print(value);
+    return n + print("\r\n");
+  }
+  size_t println() { return print("\r\n"); }
+
+  // host-side plumbing
+  void setEcho(FILE* f) { echo = f; }
+
+private:
+  FILE* echo = nullptr;
+};
+
+extern HostSerial Serial;
+
+// Host control
+void hostSetAnalogInput(int pin, int value);
+// Changes the input at a later time, while the clock is advanced.  Changes
+// have to be scheduled in time order; false if too many are waiting.
+bool hostScheduleAnalogInput(int pin, unsigned long atMicros, int value);
+// Reads the pin from a function of the virtual time instead, e.g. a model of
+// whatever drives it; nullptr goes back to the value set above
+void hostSetAnalogSource(int pin, int (*source)(unsigned long atMicros));
+int hostGetPwm(int pin);
+// Called with every analogWrite() and Timer1 output write, at the virtual
+// time it happens
+void hostSetPwmObserver(void (*observer)(int pin, int value, unsigned long atMicros));
+void hostAdvanceMicros(unsigned long us);
+unsigned long hostGetSleeps();
+
+// Benchmark timer for the BENCHMARK build: the host's own clock in nanoseconds
+const char* const BENCH_TICK_UNIT = "ns";
+void benchStart();
+uint32_t benchElapsed();
+
+#endif
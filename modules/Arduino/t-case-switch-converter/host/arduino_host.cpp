@@ -0,0 +1,215 @@
+#include "Arduino.h"
+
+#include <time.h>
+
+HostSerial Serial;
+
+static unsigned long hostMicros = 0;
+static int analogInput[HOST_NUM_PINS];
+static int (*analogSource[HOST_NUM_PINS])(unsigned long atMicros);
+static int pwmValue[HOST_NUM_PINS];
+static void (*pwmObserver)(int pin, int value, unsigned long atMicros) = nullptr;
+
+// Timer0 and the ADC
+static unsigned long nextOverflowMicros = HOST_TIMER0_PERIOD_US;
+static int samplingPin = -1;
+static bool conversionRunning = false;
+static unsigned long conversionDoneMicros = 0;
+static int conversionValue = 0;
+static unsigned long sleeps = 0;
+
+// Scheduled input changes, in time order
+struct InputChange {
+  unsigned long atMicros;
+  int pin;
+  int value;
+};
+const int MAX_INPUT_CHANGES = 64;
+static InputChange inputChanges[MAX_INPUT_CHANGES];
+static int inputChangeHead = 0;
+static int inputChangeCount = 0;
+
+static int readAnalogInput(int pin) {
+  return analogSource[pin] ? analogSource[pin](hostMicros) : analogInput[pin];
+}
+
+static void applyInputChanges(unsigned long upToMicros) {
+  while (inputChangeCount > 0 && inputChanges[inputChangeHead].atMicros <= upToMicros) {
+    const InputChange& change = inputChanges[inputChangeHead];
+    analogInput[change.pin] = change.value;
+    inputChangeHead = (inputChangeHead + 1) % MAX_INPUT_CHANGES;
+    inputChangeCount--;
+  }
+}
+
+static unsigned long nextInterruptMicros() {
+  return conversionRunning && conversionDoneMicros < nextOverflowMicros ? conversionDoneMicros : nextOverflowMicros;
+}
+
+// Moves the clock to `when`, which is no later than the next interrupt, and
+// fires that interrupt if it is due
+static void advanceTo(unsigned long when) {
+  applyInputChanges(when);
+  hostMicros = when;
+  if (conversionRunning && hostMicros >= conversionDoneMicros) {
+    conversionRunning = false;
+    onAdcConversion(conversionValue);
+  }
+  if (hostMicros >= nextOverflowMicros) {
+    nextOverflowMicros += HOST_TIMER0_PERIOD_US;
+    if (samplingPin >= 0) {
+      conversionRunning = true;
+      conversionDoneMicros = hostMicros + HOST_ADC_CONVERSION_US;
+      conversionValue = readAnalogInput(samplingPin);
+    }
+  }
+}
+
+void hostAdvanceMicros(unsigned long us) {
+  unsigned long target = hostMicros + us;
+  while (nextInterruptMicros() <= target) {
+    advanceTo(nextInterruptMicros());
+  }
+  applyInputChanges(target);
+  hostMicros = target;
+}
+
+unsigned long millis() {
+  return hostMicros / 1000;
+}
+
+unsigned long micros() {
+  return hostMicros;
+}
+
+void delay(unsigned long ms) {
+  hostAdvanceMicros(ms * 1000);
+}
+
+void startInputSampling(int pin) {
+  if (pin < 0 || pin >= HOST_NUM_PINS) return;
+  samplingPin = pin;
+}
+
+void selectSamplingPin(int pin) {
+  startInputSampling(pin);
+}
+
+void sleepUntilInterrupt() {
+  sleeps++;
+  advanceTo(nextInterruptMicros());
+}
+
+unsigned long hostGetSleeps() {
+  return sleeps;
+}
+
+void pinMode(int pin, int mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(int pin, int value) {
+  if (pin < 0 || pin >= HOST_NUM_PINS) return;
+  pwmValue[pin] = value ? 255 : 0;
+}
+
+int analogRead(int pin) {
+  if (pin < 0 || pin >= HOST_NUM_PINS) return 0;
+  return readAnalogInput(pin);
+}
+
+static void writePwm(int pin, int value) {
+  pwmValue[pin] = value;
+  if (pwmObserver) {
+    pwmObserver(pin, value, hostMicros);
+  }
+}
+
+void analogWrite(int pin, int value) {
+  if (pin < 0 || pin >= HOST_NUM_PINS) return;
+  writePwm(pin, constrain(value, 0, 255));
+}
+
+static int timer1Top = 0;
+
+void startHighResOutput(int top) {
+  timer1Top = top;
+}
+
+void writeHighResOutput(int value) {
+  writePwm(HOST_TIMER1_OUTPUT_PIN, constrain(value, 0, timer1Top));
+}
+
+void hostSetAnalogInput(int pin, int value) {
+  if (pin < 0 || pin >= HOST_NUM_PINS) return;
+  analogInput[pin] = value;
+}
+
+void hostSetAnalogSource(int pin, int (*source)(unsigned long atMicros)) {
+  if (pin < 0 || pin >= HOST_NUM_PINS) return;
+  analogSource[pin] = source;
+}
+
+bool hostScheduleAnalogInput(int pin, unsigned long atMicros, int value) {
+  if (pin < 0 || pin >= HOST_NUM_PINS || inputChangeCount >= MAX_INPUT_CHANGES) return false;
+  inputChanges[(inputChangeHead + inputChangeCount) % MAX_INPUT_CHANGES] = {atMicros, pin, value};
+  inputChangeCount++;
+  return true;
+}
+
+int hostGetPwm(int pin) {
+  if (pin < 0 || pin >= HOST_NUM_PINS) return 0;
+  return pwmValue[pin];
+}
+
+void hostSetPwmObserver(void (*observer)(int pin, int value, unsigned long atMicros)) {
+  pwmObserver = observer;
+}
+
+static struct timespec benchStartTime;
+
+void benchStart() {
+  clock_gettime(CLOCK_MONOTONIC, &benchStartTime);
+}
+
+uint32_t benchElapsed() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - benchStartTime.tv_sec) * 1000000000UL + (now.tv_nsec - benchStartTime.tv_nsec);
+}
+
+// Serial
+
+size_t HostSerial::print(const char* s) {
+  if (echo) {
+    fputs(s, echo);
+  }
+  return strlen(s);
+}
+
+size_t HostSerial::print(int n) {
+  return print((long)n);
+}
+
+size_t HostSerial::print(unsigned int n) {
+  return print((unsigned long)n);
+}
+
+size_t HostSerial::print(long n) {
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%ld", n);
+  return print(buffer);
+}
+
+size_t HostSerial::print(unsigned long n) {
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%lu", n);
+  return print(buffer);
+}
+
+size_t HostSerial::print(double n, int digits) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+  return print(buffer);
+}
@@ -0,0 +1,18 @@
+// Host run of the converter's benchmarks (the BENCHMARK section of the sketch)
+//
+// Exits non-zero if anything is over its host budget.
+
+#include "Arduino.h"
+
+int runBenchmarks();
+
+int main() {
+  Serial.setEcho(stdout);
+
+  int overBudget = runBenchmarks();
+  if (overBudget) {
+    printf("\nFAIL: %d benchmark(s) over budget\n", overBudget);
+    return 1;
+  }
+  return 0;
+}
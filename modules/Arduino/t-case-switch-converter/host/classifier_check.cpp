@@ -0,0 +1,103 @@
+// Checks the switch position classifier against the float nearest-neighbour
+// search it replaced, and checks its hysteresis
+//
+//   classifier-check
+//
+// Prints the decision boundaries and the codes where a slow sweep up and down
+// changes position.  Exits non-zero if any reading well away from a boundary
+// classifies differently from the nearest table entry, if noise inside a
+// hysteresis band changes position, or if a sweep chatters.
+
+#include "../t-case-switch-converter.ino"
+
+#include <stdlib.h>
+
+// The original getVoltageMapping(): nearest table entry in volts
+static int nearestPosition(int adcValue) {
+  float inputVoltage = (adcValue / 1023.0) * 5.0;
+  int closestIndex = 0;
+  float minDistance = fabs(inputVoltage - VOLTAGE_TABLE[0].inputVoltage);
+  for (int i = 1; i < TABLE_SIZE; i++) {
+    float distance = fabs(inputVoltage - VOLTAGE_TABLE[i].inputVoltage);
+    if (distance < minDistance) {
+      minDistance = distance;
+      closestIndex = i;
+    }
+  }
+  return closestIndex;
+}
+
+static const char* positionName(int position) {
+  return position == NO_POSITION ? "none" : VOLTAGE_TABLE[position].gearName;
+}
+
+static bool nearBoundary(int adcValue) {
+  for (int n = 0; n <= TABLE_SIZE; n++) {
+    if (abs(adcValue - BOUNDARY_CODES[n]) <= HYSTERESIS_CODES) return true;
+  }
+  return false;
+}
+
+int main() {
+  int failures = 0;
+
+  printf("boundaries (hysteresis +/-%d codes):", HYSTERESIS_CODES);
+  for (int n = 0; n <= TABLE_SIZE; n++) {
+    printf(" %d (%.2fV)", BOUNDARY_CODES[n], InputAdc::volts(BOUNDARY_CODES[n]));
+  }
+  printf("\n");
+
+  // Away from the boundaries the answer doesn't depend on the current position
+  for (int code = 0; code <= 1023; code++) {
+    if (nearBoundary(code)) continue;
+    bool outside = code < BOUNDARY_CODES[0] || code >= BOUNDARY_CODES[TABLE_SIZE];
+    int expected = outside ? NO_POSITION : nearestPosition(code);
+    for (int current = NO_POSITION; current < TABLE_SIZE; current++) {
+      int position = classifySwitchPosition(code, current);
+      if (position != expected) {
+        printf("FAIL: code %d from %s gives %s, expected %s\n", code, positionName(current),
+               positionName(position), positionName(expected));
+        failures++;
+      }
+    }
+  }
+
+  // Settled in a position, noise up to the hysteresis band doesn't move it
+  for (int position = 0; position < TABLE_SIZE; position++) {
+    int low = BOUNDARY_CODES[position] - HYSTERESIS_CODES;
+    int high = BOUNDARY_CODES[position + 1] + HYSTERESIS_CODES - 1;
+    for (int code = low; code <= high; code++) {
+      if (classifySwitchPosition(code, position) != position) {
+        printf("FAIL: code %d inside the hysteresis band moves %s\n", code, positionName(position));
+        failures++;
+      }
+    }
+  }
+
+  // Slow sweeps: one change per boundary, each way
+  for (int direction = 1; direction >= -1; direction -= 2) {
+    int position = NO_POSITION;
+    int changes = 0;
+    printf("sweep %s:", direction > 0 ? "up  " : "down");
+    for (int step = 0; step <= 1023; step++) {
+      int code = direction > 0 ? step : 1023 - step;
+      int next = classifySwitchPosition(code, position);
+      if (next != position) {
+        printf(" %s at %d,", positionName(next), code);
+        position = next;
+        changes++;
+      }
+    }
+    printf("\n");
+    if (changes != TABLE_SIZE + 1) {
+      printf("FAIL: %d position changes, expected %d\n", changes, TABLE_SIZE + 1);
+      failures++;
+    }
+  }
+
+  if (failures) {
+    printf("\nFAIL: %d classification errors\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Measures switch-to-output latency through the sketch's real setup()/loop()
+//
+//   latency-check
+//
+// Runs the converter against the host's Timer0/ADC model and throws switch
+// changes at it: random gear to gear (and open wiring) moves, each starting at
+// a random point in the sample period, with up to MAX_BOUNCE_US of contact
+// bounce between the old position, the new one and open circuit, then a few
+// codes of noise.  Some trials bounce and come back to where they started.
+//
+// Latency is from the contacts settling to the output being written.  Exits
+// non-zero if a change takes longer than LATENCY_LIMIT_US, if a change
+// writes anything but the new position's PWM, or if bounce alone writes the
+// output at all.
+
+#include "../t-case-switch-converter.ino"
+
+#include <stdlib.h>
+
+static_assert(SAMPLE_PERIOD_MICROS == HOST_TIMER0_PERIOD_US, "sketch and host disagree on the sample period");
+
+const int TRIALS = 400;
+const unsigned long MAX_BOUNCE_US = 3000;
+const unsigned long MIN_BOUNCE_SEGMENT_US = 100;
+const unsigned long SETTLE_WATCH_US = 20000;  // time given to each change
+const int NOISE_CODES = 4;
+
+// A sample period to be sampled at all, the debounce, then another period for
+// it to be counted out in whole samples
+const unsigned long LATENCY_LIMIT_US = DEBOUNCE_MICROS + 2 * SAMPLE_PERIOD_MICROS;
+
+const int OPEN_WIRE_CODE = 1023;
+
+static int writes = 0;
+static int lastWriteValue = 0;
+static unsigned long lastWriteMicros = 0;
+
+static void onPwmWrite(int pin, int value, unsigned long atMicros) {
+  if (pin != OUTPUT_PIN) return;
+  writes++;
+  lastWriteValue = value;
+  lastWriteMicros = atMicros;
+}
+
+static int codeFor(int position) {
+  return position == NO_POSITION ? OPEN_WIRE_CODE : inputCode(position);
+}
+
+static const char* positionName(int position) {
+  return position == NO_POSITION ? "none" : VOLTAGE_TABLE[position].gearName;
+}
+
+static void runUntil(unsigned long endMicros) {
+  while (micros() < endMicros) {
+    loop();
+  }
+}
+
+int main() {
+  int failures = 0;
+  srand(17);
+
+  hostSetAnalogInput(INPUT_PIN, codeFor(0));
+  setup();
+  hostSetPwmObserver(onPwmWrite);
+  runUntil(micros() + SETTLE_WATCH_US);
+  if (switchPosition != 0) {
+    printf("FAIL: did not pick up %s at start up\n", positionName(0));
+    return 1;
+  }
+
+  int position = 0;
+  int changes = 0;
+  unsigned long worstLatency = 0;
+  unsigned long totalLatency = 0;
+  unsigned long startMicros = micros();
+  unsigned long startSleeps = hostGetSleeps();
+
+  for (int trial = 0; trial < TRIALS; trial++) {
+    bool bounceOnly = trial % 5 == 4;
+    int target = position;
+    while (!bounceOnly && target == position) {
+      target = rand() % (TABLE_SIZE + 1) - 1;
+    }
+
+    unsigned long t = micros() + 2000 + rand() % SAMPLE_PERIOD_MICROS;
+    unsigned long bounceEnd = t + rand() % (MAX_BOUNCE_US + 1);
+    while (t + MIN_BOUNCE_SEGMENT_US < bounceEnd) {
+      int choice = rand() % 3;
+      int code = choice == 0 ? codeFor(position) : choice == 1 ? codeFor(target) : OPEN_WIRE_CODE;
+      hostScheduleAnalogInput(INPUT_PIN, t, code);
+      t += MIN_BOUNCE_SEGMENT_US + rand() % 300;
+    }
+    unsigned long settledMicros = bounceEnd;
+    hostScheduleAnalogInput(INPUT_PIN, settledMicros, codeFor(target));
+    for (unsigned long noise = settledMicros + 700; noise < settledMicros + SETTLE_WATCH_US; noise += 700) {
+      int code = codeFor(target) + rand() % (2 * NOISE_CODES + 1) - NOISE_CODES;
+      hostScheduleAnalogInput(INPUT_PIN, noise, target == NO_POSITION ? OPEN_WIRE_CODE : code);
+    }
+
+    writes = 0;
+    runUntil(settledMicros + SETTLE_WATCH_US);
+
+    if (bounceOnly) {
+      if (writes) {
+        printf("FAIL: bounce on %s wrote the output %d times\n", positionName(position), writes);
+        failures++;
+      }
+      continue;
+    }
+
+    if (writes != 1 || lastWriteValue != pwmForPosition(target)) {
+      printf("FAIL: %s to %s wrote the output %d times, last PWM %d, expected once with %d\n",
+             positionName(position), positionName(target), writes, lastWriteValue, pwmForPosition(target));
+      failures++;
+    } else {
+      unsigned long latency = lastWriteMicros - settledMicros;
+      totalLatency += latency;
+      if (latency > worstLatency) worstLatency = latency;
+      changes++;
+      if (latency > LATENCY_LIMIT_US) {
+        printf("FAIL: %s to %s took %luus\n", positionName(position), positionName(target), latency);
+        failures++;
+      }
+    }
+    position = target;
+  }
+
+  unsigned long elapsedMicros = micros() - startMicros;
+  printf("switch settled to output: worst %luus, mean %luus over %d changes (limit %luus)\n",
+         worstLatency, changes ? totalLatency / changes : 0, changes, LATENCY_LIMIT_US);
+  printf("first sample to output, as the sketch measures it: worst %luus\n",
+         (unsigned long)worstSwitchLatencyMicros);
+  printf("wake ups: %.0f per second\n", (hostGetSleeps() - startSleeps) * 1e6 / elapsedMicros);
+
+  if (failures) {
+    printf("\nFAIL: %d latency errors\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,234 @@
+// Output filter model: settling time, ripple and accuracy of the converter's
+// output, through the sketch's real setup()/loop()
+//
+//   output-model            today's output, analogWrite() on D3
+//   output-model-highres    built with -DHIGH_RES_OUTPUT
+//   output-model-readback   built with -DHIGH_RES_OUTPUT -DOUTPUT_READBACK
+//
+// The PWM pin is modelled tick by tick as the timer drives it (Timer2 phase
+// correct at 490Hz, or Timer1 fast PWM at 15.6kHz) into a series R, L and a C
+// to ground, loaded by the transfer case controller.  With OUTPUT_READBACK the
+// ADC reads the filter output back on READBACK_PIN.  After a warm up the
+// switch steps 4L -> 4H -> 2H -> 4L, and for each filter the worst step gives:
+//   settle  time from the output write until the output, averaged over a PWM
+//           period, stays within SETTLE_BAND_VOLTS of where it ends up
+//   ripple  peak to peak once settled
+//   error   settled average less the table voltage
+//
+// Exits non-zero if the high resolution output through the filter meant for
+// it takes longer than the sketch's OUTPUT_SETTLE_MS, or if the readback build
+// doesn't hold the table voltages to within READBACK_ERROR_LIMIT_VOLTS.
+
+#include "../t-case-switch-converter.ino"
+
+#include <stdlib.h>
+#include <vector>
+
+struct Filter {
+  const char* name;
+  double ohms;
+  double henries;   // 0 for a plain RC
+  double farads;
+  unsigned long stepMillis;
+};
+
+// Today's filter, per the readme's schematic, and one for the 15.6kHz carrier
+// with about the same ripple
+const Filter TODAY_FILTER = {"1k 100mH 47uF", 1000, 0.1, 47e-6, 1000};
+const Filter FAST_FILTER = {"1k 2.2uF", 1000, 0, 2.2e-6, 300};
+
+// Controller input, as implied by the 1.067 calibration factor with the 1k
+const double LOAD_OHMS = 15000;
+
+const double SETTLE_BAND_VOLTS = 0.02;
+const double READBACK_ERROR_LIMIT_VOLTS = 0.015;
+const double CPU_HZ = 16e6;
+
+#ifdef HIGH_RES_OUTPUT
+const char* const OUTPUT_NAME = "10-bit 15.6kHz D9";
+const unsigned long TICK_CYCLES = 1;                  // Timer1, no prescaler
+const unsigned long PERIOD_TICKS = OUTPUT_TOP + 1;
+#ifdef OUTPUT_READBACK
+// the trim waits OUTPUT_SETTLE_MS, which is for the fast filter
+const Filter* const FILTERS[] = {&FAST_FILTER};
+#else
+const Filter* const FILTERS[] = {&TODAY_FILTER, &FAST_FILTER};
+#endif
+
+static bool pwmHigh(unsigned long tick, int value) {
+  // fast PWM, non-inverting: set at BOTTOM, cleared after the compare match
+  return (int)tick <= value;
+}
+#else
+const char* const OUTPUT_NAME = "8-bit 490Hz D3";
+const unsigned long TICK_CYCLES = 64;                 // Timer2, /64 prescaler
+const unsigned long PERIOD_TICKS = 510;
+const Filter* const FILTERS[] = {&TODAY_FILTER};
+
+static bool pwmHigh(unsigned long tick, int value) {
+  // analogWrite() drives 0 and 255 as plain digital levels; in between,
+  // phase correct PWM counts up then down and is high below the compare value
+  if (value == 0 || value == 255) return value == 255;
+  unsigned long count = tick <= 255 ? tick : PERIOD_TICKS - tick;
+  return (int)count < value;
+}
+#endif
+
+#ifdef OUTPUT_READBACK
+const char* const LOOP_NAME = "readback";
+#else
+const char* const LOOP_NAME = "open loop";
+#endif
+
+const int NUM_FILTERS = sizeof(FILTERS) / sizeof(FILTERS[0]);
+
+// One PWM period of filter output
+struct Period {
+  float mean;
+  float min;
+  float max;
+};
+
+// Filter state
+static const Filter* filter = nullptr;
+static double inductorAmps = 0;
+static double outputVolts = 0;
+static unsigned long long cycle = 0;     // CPU cycles since setup()
+static unsigned long tickInPeriod = 0;
+static int pwmValue = 0;
+static Period period = {0, 1e9, -1e9};
+static double periodSum = 0;
+static std::vector<Period> periods;    // since the last output write we care about
+
+static void advanceFilterTo(unsigned long micros) {
+  unsigned long long target = (unsigned long long)micros * (unsigned long long)(CPU_HZ / 1e6);
+  double dt = TICK_CYCLES / CPU_HZ;
+  while (cycle < target) {
+    double volts = pwmHigh(tickInPeriod, pwmValue) ? ACTUAL_VCC : 0;
+    double loadAmps = outputVolts / LOAD_OHMS;
+    if (filter->henries > 0) {
+      inductorAmps += (volts - filter->ohms * inductorAmps - outputVolts) / filter->henries * dt;
+    } else {
+      inductorAmps = (volts - outputVolts) / filter->ohms;
+    }
+    outputVolts += (inductorAmps - loadAmps) / filter->farads * dt;
+    cycle += TICK_CYCLES;
+
+    periodSum += outputVolts;
+    if (outputVolts < period.min) period.min = outputVolts;
+    if (outputVolts > period.max) period.max = outputVolts;
+    if (++tickInPeriod == PERIOD_TICKS) {
+      tickInPeriod = 0;
+      period.mean = periodSum / PERIOD_TICKS;
+      periods.push_back(period);
+      period = {0, 1e9, -1e9};
+      periodSum = 0;
+    }
+  }
+}
+
+static void onPwmWrite(int pin, int value, unsigned long atMicros) {
+  if (pin != OUTPUT_PIN) return;
+  advanceFilterTo(atMicros);
+  pwmValue = value;
+}
+
+static int readbackSource(unsigned long atMicros) {
+  advanceFilterTo(atMicros);
+  return InputAdc::code(outputVolts);
+}
+
+static void runFor(unsigned long millis) {
+  unsigned long end = micros() + millis * 1000;
+  while (micros() < end) {
+    loop();
+  }
+  advanceFilterTo(micros());
+}
+
+struct StepResult {
+  double settleMillis;
+  double rippleVolts;
+  double errorVolts;
+};
+
+// Steps the switch to a position and measures the output from the moment it
+// is written
+static StepResult step(int position) {
+  hostSetAnalogInput(INPUT_PIN, inputCode(position));
+  while (switchPosition != position) {
+    loop();
+  }
+  advanceFilterTo(micros());
+  periods.clear();
+  runFor(filter->stepMillis);
+
+  // the last quarter is taken as settled
+  size_t settledFrom = periods.size() * 3 / 4;
+  double sum = 0;
+  float low = 1e9, high = -1e9;
+  for (size_t i = settledFrom; i < periods.size(); i++) {
+    sum += periods[i].mean;
+    if (periods[i].min < low) low = periods[i].min;
+    if (periods[i].max > high) high = periods[i].max;
+  }
+  double final = sum / (periods.size() - settledFrom);
+
+  size_t lastOutside = 0;
+  for (size_t i = 0; i < periods.size(); i++) {
+    if (fabs(periods[i].mean - final) > SETTLE_BAND_VOLTS) lastOutside = i + 1;
+  }
+  double periodMillis = PERIOD_TICKS * TICK_CYCLES / CPU_HZ * 1000;
+  return {lastOutside * periodMillis, high - low, final - VOLTAGE_TABLE[position].outputVoltage};
+}
+
+int main() {
+  int failures = 0;
+
+  hostSetAnalogInput(INPUT_PIN, inputCode(0));
+  filter = FILTERS[0];
+  setup();
+  hostSetPwmObserver(onPwmWrite);
+  hostSetAnalogSource(READBACK_PIN, readbackSource);
+
+  printf("output, loop, filter, settle ms, ripple mV p-p, error mV (load %.0f ohms)\n", LOAD_OHMS);
+  for (int f = 0; f < NUM_FILTERS; f++) {
+    filter = FILTERS[f];
+    inductorAmps = 0;
+    outputVolts = 0;
+    runFor(3 * filter->stepMillis);   // settled, and trimmed with a readback
+
+    StepResult worst = {0, 0, 0};
+    const int sequence[] = {1, 2, 0};
+    for (int position : sequence) {
+      StepResult result = step(position);
+      if (result.settleMillis > worst.settleMillis) worst.settleMillis = result.settleMillis;
+      if (result.rippleVolts > worst.rippleVolts) worst.rippleVolts = result.rippleVolts;
+      if (fabs(result.errorVolts) > fabs(worst.errorVolts)) worst.errorVolts = result.errorVolts;
+    }
+    printf("%s, %s, %s, %.1f, %.1f, %+.1f\n", OUTPUT_NAME, LOOP_NAME, filter->name,
+           worst.settleMillis, worst.rippleVolts * 1000, worst.errorVolts * 1000);
+
+#ifdef HIGH_RES_OUTPUT
+    if (filter == &FAST_FILTER && worst.settleMillis > OUTPUT_SETTLE_MS) {
+      printf("FAIL: settles in %.1fms, OUTPUT_SETTLE_MS is %lu\n", worst.settleMillis, OUTPUT_SETTLE_MS);
+      failures++;
+    }
+#endif
+#ifdef OUTPUT_READBACK
+    if (filter == &FAST_FILTER && fabs(worst.errorVolts) > READBACK_ERROR_LIMIT_VOLTS) {
+      printf("FAIL: readback leaves a %.1fmV error\n", worst.errorVolts * 1000);
+      failures++;
+    }
+#endif
+  }
+#ifdef OUTPUT_READBACK
+  printf("output gain trimmed to %.3f\n", outputGain);
+#endif
+
+  if (failures) {
+    printf("\nFAIL: %d output model errors\n", failures);
+    return 1;
+  }
+  return 0;
+}
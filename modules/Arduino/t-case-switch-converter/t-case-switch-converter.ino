@@ -16,28 +16,73 @@
  */
 
  #include <Arduino.h>
+ #include <NeotericCore.h>
 
 // Uncomment this line to enable debug output
 #define DEBUG
 
+// Uncomment this line (or pass -DBENCHMARK) to build the benchmarks at the end
+// of this file instead of the converter.  They time the release build.
+//#define BENCHMARK
+
+// Uncomment this line for the high resolution output: 10-bit PWM at 15.6kHz
+// from Timer1 on D9, instead of analogWrite()'s 8-bit PWM at 490Hz on D3.
+// The filter input moves from D3 to D9, and the filter can be a lot faster
+// (see the readme).
+//#define HIGH_RES_OUTPUT
+
+// Uncomment this line if the filtered output is wired back to READBACK_PIN.
+// The output then trims itself to the table voltages, and
+// PWM_CALIBRATION_FACTOR is only where it starts from.  Needs HIGH_RES_OUTPUT.
+//#define OUTPUT_READBACK
+
+#ifdef BENCHMARK
+  #undef DEBUG
+#endif
+
+#if defined(OUTPUT_READBACK) && !defined(HIGH_RES_OUTPUT)
+  // the 490Hz ripple would be read back at nearly the same point every time
+  #error "OUTPUT_READBACK needs HIGH_RES_OUTPUT"
+#endif
+
+#include <neoteric/debug.h>
+
 #ifdef DEBUG
-  // slower in debug to not overload the console output
-  const int LOOP_WAIT = 1000;
-#else
-  // faster is release for responsiveness
-  const int LOOP_WAIT = 100;
+  // status line period, slow enough not to overload the console
+  const unsigned long DEBUG_REPORT_MS = 1000;
 #endif
 
 // const 
 // Pin definitions
 const int INPUT_PIN = A1;   
-const int OUTPUT_PIN = 3;
+const int READBACK_PIN = A2;
 
-const float ACTUAL_VCC = 5.0;
+#ifdef HIGH_RES_OUTPUT
+  // Timer1 fast PWM with no prescaler, 1025 steps.  Timer1 only has D9 and D10.
+  // Not 1024: the readback is triggered off Timer0, every 16384 cycles, and a
+  // period that divides that would always catch the ripple at the same point.
+  // With 1025 cycles the eight readbacks trimOutput() averages are spread
+  // over one whole period.
+  const int OUTPUT_PIN = 9;
+  const int OUTPUT_TOP = 1024;
+  // settling time of the 1k, 2.2uF filter to within 20mV, with some margin
+  const unsigned long OUTPUT_SETTLE_MS = 20;
+#else
+  // analogWrite(), Timer2 phase correct PWM at 490Hz
+  const int OUTPUT_PIN = 3;
+  const int OUTPUT_TOP = 255;
+#endif
+
+typedef neoteric::Adc<10, 5000> InputAdc;         // 10-bit, referenced to VCC
+typedef neoteric::Pwm<OUTPUT_TOP, 5000> OutputPwm; // driven from VCC
+constexpr float ACTUAL_VCC = InputAdc::VREF;
 // due to impedance, etc of RC filter, we need to accound for a voltage drop
 // Calibration = Target_Voltage / Measured_Voltage
 const float PWM_CALIBRATION_FACTOR = 1.0;// 1.067;
 
+// Calibration in use; trimmed from the readback with OUTPUT_READBACK
+float outputGain = PWM_CALIBRATION_FACTOR;
+
 // Voltage mapping structure
 struct VoltageMap {
   const char* gearName;
@@ -45,8 +90,8 @@ struct VoltageMap {
   float outputVoltage;
 };
 
-// Single lookup table with gear->input->output mappings
-const VoltageMap VOLTAGE_TABLE[] = {
+// Single lookup table with gear->input->output mappings, in order of input voltage
+constexpr VoltageMap VOLTAGE_TABLE[] = {
   {"4L",   1.08, 1.5},  
   {"4H",   1.83, 3.0},  
   {"2H",   2.85, 2.0}   
@@ -55,88 +100,347 @@ const VoltageMap VOLTAGE_TABLE[] = {
 // Variables
 int inputValue = 0;
 
-// Debug macros.  If #debug is not defined, they do nothing
-#ifdef DEBUG
-  #define DEBUG_PRINT(x) Serial.print(x)
-  #define DEBUG_PRINTLN(x) Serial.println(x)
-#else
-  #define DEBUG_PRINT(x)
-  #define DEBUG_PRINTLN(x)
-#endif
-
-const int TABLE_SIZE = sizeof(VOLTAGE_TABLE) / sizeof(VOLTAGE_TABLE[0]);
-
-// Function to find the closest voltage mapping entry
-const VoltageMap* getVoltageMapping(int adcValue) {
-  // Convert ADC value to voltage (5V reference, 10-bit ADC)
-  float inputVoltage = (adcValue / 1023.0) * 5.0;
-  
-  DEBUG_PRINT("input voltage: ");
-  DEBUG_PRINTLN(inputVoltage);
-
-  int closestIndex = 0;
-  float minDistance = fabs(inputVoltage - VOLTAGE_TABLE[0].inputVoltage);
-  
-  // Find the closest input voltage
-  for (int i = 1; i < TABLE_SIZE; i++) {
-    float distance = fabs(inputVoltage - VOLTAGE_TABLE[i].inputVoltage);
-    if (distance < minDistance) {
-      minDistance = distance;
-      closestIndex = i;
+constexpr int TABLE_SIZE = sizeof(VOLTAGE_TABLE) / sizeof(VOLTAGE_TABLE[0]);
+
+// Switch position classification
+// The table is turned into ADC code decision boundaries by the compiler:
+// midway between neighbouring positions, and half a step beyond the first and
+// last.  Readings outside the outer boundaries mean open (near 5V) or shorted
+// (near 0V) wiring, and classify as no position at all.
+//
+// Each boundary has a hysteresis band.  The current position is kept until
+// the reading is more than HYSTERESIS_CODES past one of its own boundaries, so
+// a noisy reading near a midpoint can't flip gears.  Staying put - the usual
+// case - is two integer compares.
+const int NO_POSITION = -1;
+
+// Output while there is no valid position.  0V is outside every gear's
+// output, so the transfer case controller sees a fault rather than a gear.
+const float NO_POSITION_OUTPUT_VOLTAGE = 0.0;
+
+constexpr float HYSTERESIS_VOLTS = 0.05;
+
+constexpr int voltsToAdcCode(float volts) {
+  return InputAdc::code(volts);
+}
+
+constexpr int inputCode(int position) {
+  return voltsToAdcCode(VOLTAGE_TABLE[position].inputVoltage);
+}
+
+// Boundary n is the lower edge of position n; boundary TABLE_SIZE is the upper
+// edge of the last one
+constexpr int boundaryCode(int n) {
+  return n == 0 ? inputCode(0) - (inputCode(1) - inputCode(0)) / 2
+       : n == TABLE_SIZE ? inputCode(TABLE_SIZE - 1) + (inputCode(TABLE_SIZE - 1) - inputCode(TABLE_SIZE - 2)) / 2
+       : (inputCode(n - 1) + inputCode(n)) / 2;
+}
+
+constexpr int HYSTERESIS_CODES = voltsToAdcCode(HYSTERESIS_VOLTS);
+
+// One entry per position plus one; add a line here with each new table row
+const int16_t BOUNDARY_CODES[] = {
+  boundaryCode(0),
+  boundaryCode(1),
+  boundaryCode(2),
+  boundaryCode(3)
+};
+
+static_assert(sizeof(BOUNDARY_CODES) / sizeof(BOUNDARY_CODES[0]) == TABLE_SIZE + 1,
+              "BOUNDARY_CODES needs one entry more than VOLTAGE_TABLE");
+static_assert(TABLE_SIZE >= 2, "boundaries are placed from the gaps between positions");
+
+constexpr bool boundariesSeparated(int n) {
+  return n >= TABLE_SIZE ||
+         (boundaryCode(n + 1) - boundaryCode(n) > 2 * HYSTERESIS_CODES && boundariesSeparated(n + 1));
+}
+static_assert(boundaryCode(0) > HYSTERESIS_CODES && boundaryCode(TABLE_SIZE) + HYSTERESIS_CODES < InputAdc::MAX_CODE,
+              "table too close to the rails to tell open or shorted wiring apart");
+static_assert(boundariesSeparated(0), "positions must be in voltage order and more than two hysteresis bands apart");
+
+// Position for an ADC reading, with hysteresis around the current position
+int classifySwitchPosition(int adcValue, int currentPosition) {
+  if (currentPosition == NO_POSITION) {
+    // leaving the fault band needs a reading clearly inside the valid range
+    if (adcValue < BOUNDARY_CODES[0] + HYSTERESIS_CODES ||
+        adcValue >= BOUNDARY_CODES[TABLE_SIZE] - HYSTERESIS_CODES) {
+      return NO_POSITION;
     }
+  } else if (adcValue >= BOUNDARY_CODES[currentPosition] - HYSTERESIS_CODES &&
+             adcValue < BOUNDARY_CODES[currentPosition + 1] + HYSTERESIS_CODES) {
+    return currentPosition;
   }
-  
-  DEBUG_PRINT("switch: ");
-  DEBUG_PRINTLN(VOLTAGE_TABLE[closestIndex].gearName);
 
-  return &VOLTAGE_TABLE[closestIndex];
+  if (adcValue < BOUNDARY_CODES[0] || adcValue >= BOUNDARY_CODES[TABLE_SIZE]) {
+    return NO_POSITION;
+  }
+  int position = 0;
+  while (adcValue >= BOUNDARY_CODES[position + 1]) {
+    position++;
+  }
+  return position;
 }
 
-// Convert desired voltage to PWM value (0-255)
-// Assumes 5V supply for PWM output
+// Convert desired voltage to PWM value (0-OUTPUT_TOP)
 int voltageToPWM(float voltage) {
-  if (voltage < 0) voltage = 0;
-  if (voltage > 5.0) voltage = 5.0;
-  
-  float calibratedVoltage = voltage * PWM_CALIBRATION_FACTOR;
+  return OutputPwm::fromVolts(voltage * outputGain);
+}
+
+#ifdef ARDUINO
+#include <avr/sleep.h>
+
+void onAdcConversion(int adcValue);
+
+// Free-running conversions, started by each Timer0 overflow.  Timer0 overflow
+// has its interrupt enabled (millis()), which clears the flag the auto
+// trigger needs cleared to fire again.  analogRead() can't be used after
+// this, it would take the ADC over.
+void selectSamplingPin(int pin) {
+  DIDR0 |= _BV(pin - A0);                     // digital input buffer off, saves power
+  ADMUX = _BV(REFS0) | ((pin - A0) & 0x07);   // AVcc reference, as analogRead()
+}
+
+void startInputSampling(int pin) {
+  selectSamplingPin(pin);
+  ADCSRB = _BV(ADTS2);                        // trigger: Timer0 overflow
+  ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) |
+           _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);  // 125kHz ADC clock, 104us a conversion
+}
+
+ISR(ADC_vect) {
+  onAdcConversion(ADC);
+}
 
-  return (int)((calibratedVoltage / ACTUAL_VCC) * 255);
+// Idle sleep keeps the timers (PWM), the ADC and the UART running; any
+// interrupt wakes it, at the latest the next Timer0 overflow
+void sleepUntilInterrupt() {
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_mode();
 }
 
-void processVoltageIO() {
-  // Read input and get the voltage mapping
-  int adcReading = analogRead(INPUT_PIN);
-  const VoltageMap* mapping = getVoltageMapping(adcReading);
-  
-  // Convert to PWM and output to pin D3
-  int pwmValue = voltageToPWM(mapping->outputVoltage);
+#ifdef HIGH_RES_OUTPUT
+// Fast PWM with TOP = ICR1 and no prescaler: 16MHz / (top + 1), non-inverting
+// on OC1A.  OCR1A is double buffered, so a new value starts on a whole period.
+void startHighResOutput(int top) {
+  TCCR1A = _BV(COM1A1) | _BV(WGM11);
+  TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS10);
+  ICR1 = top;
+  OCR1A = 0;
+}
+
+void writeHighResOutput(int value) {
+  OCR1A = value;
+}
+#endif
+#endif
+
+void writeOutput(int pwmValue) {
+#ifdef HIGH_RES_OUTPUT
+  writeHighResOutput(pwmValue);
+#else
   analogWrite(OUTPUT_PIN, pwmValue);
-  
-  // Debug output
+#endif
+}
+
+// Input sampling
+// INPUT_PIN is converted in the background, once per Timer0 overflow (the
+// 1.024ms millis() tick, so no extra timer), and every result goes to
+// onInputSample() from the ADC interrupt.  A new position has to read the
+// same for DEBOUNCE_MICROS before it is taken; a contact bouncing back to the
+// old position, or open between detents, starts the wait over.  The output is
+// written right there in the interrupt, so nothing loop() does can hold it up.
+// loop() only reports changes, and sleeps in between.
+//
+// From the switch settling to the output changing is at most a sample period
+// (to be sampled at all), plus the debounce rounded up to whole sample periods,
+// plus one conversion: 1024 + 5120 + 104us.  host/latency_check.cpp measures it.
+const unsigned long SAMPLE_PERIOD_MICROS = 1024;
+const unsigned long DEBOUNCE_MICROS = 5000;
+
+// PWM value per position, worked out up front (updateOutputTable()) so the
+// interrupt doesn't do float math
+int positionPwm[TABLE_SIZE];
+int noPositionPwm = 0;
+
+volatile int switchPosition = NO_POSITION;   // debounced
+volatile int lastInputSample = 0;
+volatile bool switchPositionChanged = false;
+// First sample of a new position to the output being written: the debounce,
+// as measured, plus the time in the interrupt
+volatile unsigned long worstSwitchLatencyMicros = 0;
+
+static int pendingPosition = NO_POSITION;
+static unsigned long pendingSinceMicros = 0;
+
+#ifdef OUTPUT_READBACK
+// Every READBACK_EVERY-th conversion reads the filtered output instead of the
+// switch.  That costs the debounce up to one more sample period.
+const uint8_t READBACK_EVERY = 8;
+static uint8_t conversionsUntilReadback = READBACK_EVERY;
+static bool readingBack = false;
+volatile int lastReadback = 0;
+volatile bool readbackReady = false;
+volatile unsigned long outputChangedMillis = 0;
+#endif
+
+int pwmForPosition(int position) {
+  return position == NO_POSITION ? noPositionPwm : positionPwm[position];
+}
+
+// Called from the ADC interrupt with each conversion of INPUT_PIN
+void onInputSample(int adcValue) {
+  lastInputSample = adcValue;
+  int position = classifySwitchPosition(adcValue, switchPosition);
+  if (position == switchPosition) {
+    pendingPosition = position;
+    return;
+  }
+
+  unsigned long now = micros();
+  if (position != pendingPosition) {
+    pendingPosition = position;
+    pendingSinceMicros = now;
+    return;
+  }
+  if (now - pendingSinceMicros < DEBOUNCE_MICROS) {
+    return;
+  }
+
+  switchPosition = position;
+  writeOutput(pwmForPosition(position));
+  switchPositionChanged = true;
+#ifdef OUTPUT_READBACK
+  outputChangedMillis = millis();
+#endif
+
+  unsigned long latency = micros() - pendingSinceMicros;
+  if (latency > worstSwitchLatencyMicros) {
+    worstSwitchLatencyMicros = latency;
+  }
+}
+
+// Called from the ADC interrupt with every conversion.  The mux is switched
+// right after a conversion, in time for the next trigger.
+void onAdcConversion(int adcValue) {
+#ifdef OUTPUT_READBACK
+  if (readingBack) {
+    readingBack = false;
+    selectSamplingPin(INPUT_PIN);
+    lastReadback = adcValue;
+    readbackReady = true;
+    return;
+  }
+  if (--conversionsUntilReadback == 0) {
+    conversionsUntilReadback = READBACK_EVERY;
+    readingBack = true;
+    selectSamplingPin(READBACK_PIN);
+  }
+#endif
+  onInputSample(adcValue);
+}
+
+// Works out the PWM value of every position for the current outputGain
+void updateOutputTable() {
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    int pwmValue = voltageToPWM(VOLTAGE_TABLE[i].outputVoltage);
+    noInterrupts();
+    positionPwm[i] = pwmValue;
+    interrupts();
+  }
+  int pwmValue = voltageToPWM(NO_POSITION_OUTPUT_VOLTAGE);
+  noInterrupts();
+  noPositionPwm = pwmValue;
+  interrupts();
+}
+
+#ifdef OUTPUT_READBACK
+// Closed loop trim
+// Once the output has been still for OUTPUT_SETTLE_MS, TRIM_READBACKS
+// readbacks are averaged (which takes out the PWM ripple) and outputGain is
+// moved half way to where it would put the output on the table voltage.  The
+// filter's drop into the load and the PWM's own offset both scale with the
+// output, so one gain covers every position.  The PWM and the ADC both work
+// off the 5V rail, so its exact voltage drops out.  A reading way off (the
+// readback not wired, or the output shorted) is ignored, and the gain stays
+// within MIN_OUTPUT_GAIN - MAX_OUTPUT_GAIN.
+const int TRIM_READBACKS = 8;
+const float TRIM_DEADBAND_VOLTS = 0.006;
+const float MAX_TRIM_ERROR = 0.25;   // of the target voltage
+const float MIN_OUTPUT_GAIN = 0.8;
+const float MAX_OUTPUT_GAIN = 1.25;
+
+void trimOutput() {
+  static long readbackSum = 0;
+  static int readbackCount = 0;
+
+  noInterrupts();
+  bool ready = readbackReady;
+  int readback = lastReadback;
+  int position = switchPosition;
+  unsigned long changedMillis = outputChangedMillis;
+  readbackReady = false;
+  interrupts();
+  if (!ready) {
+    return;
+  }
+
+  if (position == NO_POSITION || millis() - changedMillis < OUTPUT_SETTLE_MS) {
+    readbackSum = 0;
+    readbackCount = 0;
+    return;
+  }
+  readbackSum += readback;
+  if (++readbackCount < TRIM_READBACKS) {
+    return;
+  }
+
+  float target = VOLTAGE_TABLE[position].outputVoltage;
+  float measured = InputAdc::volts(readbackSum) / readbackCount;
+  float error = target - measured;
+  readbackSum = 0;
+  readbackCount = 0;
+  if (fabs(error) <= TRIM_DEADBAND_VOLTS || fabs(error) > target * MAX_TRIM_ERROR) {
+    return;
+  }
+
+  outputGain = constrain(outputGain * (1 + 0.5 * error / measured), MIN_OUTPUT_GAIN, MAX_OUTPUT_GAIN);
+  updateOutputTable();
+  noInterrupts();
+  writeOutput(pwmForPosition(switchPosition));
+  outputChangedMillis = millis();
+  interrupts();
+}
+#endif
+
+#ifndef BENCHMARK
+
+void reportSwitchPosition(int position, int adcValue, unsigned long worstLatencyMicros) {
+  const char* gearName = position == NO_POSITION ? "none" : VOLTAGE_TABLE[position].gearName;
+  float outputVoltage = position == NO_POSITION ? NO_POSITION_OUTPUT_VOLTAGE : VOLTAGE_TABLE[position].outputVoltage;
+
 #ifdef DEBUG
-  float inputVoltage = (adcReading / 1023.0) * 5.0;
+  float inputVoltage = InputAdc::volts(adcValue);
   Serial.print("Gear: ");
-  Serial.print(mapping->gearName);
+  Serial.print(gearName);
   Serial.print(" (");
   Serial.print(inputVoltage);
   Serial.print("V) -> Output: ");
-  Serial.print(mapping->outputVoltage);
+  Serial.print(outputVoltage);
   Serial.print("V (PWM: ");
-  Serial.print(pwmValue);
-  Serial.println(")");
+  Serial.print(pwmForPosition(position));
+#ifdef OUTPUT_READBACK
+  Serial.print(", gain ");
+  Serial.print(outputGain, 3);
+#endif
+  Serial.print(") worst latency ");
+  Serial.print(worstLatencyMicros);
+  Serial.println("us");
 #else
-// Debug output only when switch position changes
-  static const char* previousGear = "";  // Remember previous gear
-  
-  if (strcmp(mapping->gearName, previousGear) != 0) {
-    Serial.print("Switch changed to: ");
-    Serial.print(mapping->gearName);
-    Serial.print(" -> Output: ");
-    Serial.print(mapping->outputVoltage);
-    Serial.println("V");
-    
-    previousGear = mapping->gearName;  // Update for next comparison
-  }
+  Serial.print("Switch changed to: ");
+  Serial.print(gearName);
+  Serial.print(" -> Output: ");
+  Serial.print(outputVoltage);
+  Serial.println("V");
 #endif
 }
 
@@ -144,12 +448,176 @@ void setup() {
   Serial.begin(9600);
   DEBUG_PRINTLN("Switch Converter Initialized");
 
+  updateOutputTable();
+
   pinMode(OUTPUT_PIN, OUTPUT);  // Set output for PWM
+#ifdef HIGH_RES_OUTPUT
+  startHighResOutput(OUTPUT_TOP);
+#endif
+  writeOutput(noPositionPwm);
+  startInputSampling(INPUT_PIN);
 }
 
 void loop() {
-  processVoltageIO();
+  // A change that lands between the check and the sleep is reported on the
+  // next wake, a millisecond later; the output itself is already written
+  bool report = switchPositionChanged;
+#ifdef DEBUG
+  static unsigned long lastReportMillis = 0;
+  if (millis() - lastReportMillis >= DEBUG_REPORT_MS) {
+    lastReportMillis = millis();
+    report = true;
+  }
+#endif
+
+  if (report) {
+    noInterrupts();
+    int position = switchPosition;
+    int adcValue = lastInputSample;
+    unsigned long worstLatencyMicros = worstSwitchLatencyMicros;
+    switchPositionChanged = false;
+    interrupts();
+    reportSwitchPosition(position, adcValue, worstLatencyMicros);
+  }
+
+#ifdef OUTPUT_READBACK
+  trimOutput();
+#endif
 
-  // Short delay for stability
-  delay(LOOP_WAIT);
+  sleepUntilInterrupt();
 }
+#else
+
+// Microbenchmarks
+// Same scheme as the glow plug controller's benchmark.h: the best of
+// BENCH_REPEATS timings, less the cost of timing an empty function, checked
+// against a budget per function.  On the board the timer is Timer1 at the
+// full clock (one tick per cycle, unused by this sketch) and each call is
+// timed on its own with interrupts off.  On the host (host/Makefile,
+// `make bench`) host/Arduino.h supplies a nanosecond clock and batches of
+// calls are timed.  Host budgets are about 10x what a desktop takes.
+
+#ifdef ARDUINO
+const char* const BENCH_TICK_UNIT = "cycles";
+const int BENCH_BATCH = 1;  // the timer wraps after 4ms
+
+inline void benchStart() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+}
+
+inline uint32_t benchElapsed() {
+  uint16_t ticks = TCNT1;
+  return (TIFR1 & _BV(TOV1)) ? 0xFFFF : ticks;
+}
+#else
+const int BENCH_BATCH = 10000;
+#endif
+const int BENCH_REPEATS = 8;
+
+struct Benchmark {
+  const char* name;
+  void (*run)();
+  uint32_t boardBudget;  // cycles
+  uint32_t hostBudget;   // ns
+};
+
+// volatile in and out, so the compiler can't fold or drop the work
+static volatile int benchAdcValue = 372;  // between 4H and 2H
+static volatile float benchVoltage = 3.0;
+static volatile int benchResult;
+
+static void benchEmpty() {
+}
+
+static void benchClassifySwitchPosition() {
+  benchResult = classifySwitchPosition(benchAdcValue, NO_POSITION);
+}
+
+// The interrupt's usual case: a reading in the position already held
+static void benchOnInputSample() {
+  onInputSample(benchAdcValue);
+}
+
+static void benchVoltageToPWM() {
+  benchResult = voltageToPWM(benchVoltage);
+}
+
+static const Benchmark benchmarks[] = {
+  {"classifySwitchPosition", benchClassifySwitchPosition, 150,  20},
+  {"onInputSample",          benchOnInputSample,          150,  20},
+  {"voltageToPWM",           benchVoltageToPWM,           1400, 40},
+};
+const int NUM_BENCHMARKS = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+static uint32_t timeBest(void (*run)()) {
+  uint32_t best = 0xFFFFFFFF;
+  for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+#ifdef ARDUINO
+    uint8_t sreg = SREG;
+    cli();
+#endif
+    benchStart();
+    for (int i = 0; i < BENCH_BATCH; i++) {
+      run();
+    }
+    uint32_t elapsed = benchElapsed();
+#ifdef ARDUINO
+    SREG = sreg;
+#endif
+    if (elapsed < best) best = elapsed;
+  }
+  return best;
+}
+
+// Prints the results, returns the number over budget
+int runBenchmarks() {
+  switchPosition = classifySwitchPosition(benchAdcValue, NO_POSITION);
+  uint32_t overhead = timeBest(benchEmpty);
+  int overBudget = 0;
+
+  Serial.print("benchmark, ");
+  Serial.print(BENCH_TICK_UNIT);
+  Serial.println(" per call, budget");
+  for (int b = 0; b < NUM_BENCHMARKS; b++) {
+    const Benchmark& benchmark = benchmarks[b];
+    uint32_t best = timeBest(benchmark.run);
+    uint32_t ticks = best > overhead ? best - overhead : 0;
+#ifdef ARDUINO
+    uint32_t budget = benchmark.boardBudget;
+#else
+    uint32_t budget = benchmark.hostBudget;
+#endif
+    // tenths, so a few ns per call on the host still shows
+    uint32_t perCallTenths = ticks * 10 / BENCH_BATCH;
+    bool ok = perCallTenths <= budget * 10;
+    if (!ok) overBudget++;
+
+    Serial.print(benchmark.name);
+    Serial.print(", ");
+    Serial.print(perCallTenths / 10);
+    Serial.print(".");
+    Serial.print(perCallTenths % 10);
+    Serial.print(", ");
+    Serial.print(budget);
+    Serial.println(ok ? "" : ", OVER BUDGET");
+  }
+  return overBudget;
+}
+
+// Benchmark build: run them once, print the results and light the LED if
+// any of them is over budget
+void setup() {
+  Serial.begin(9600);
+  pinMode(LED_BUILTIN, OUTPUT);
+  int overBudget = runBenchmarks();
+  Serial.println(overBudget ? "FAIL" : "PASS");
+  digitalWrite(LED_BUILTIN, overBudget ? HIGH : LOW);
+}
+
+void loop() {
+}
+
+#endif